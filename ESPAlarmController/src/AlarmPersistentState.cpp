@@ -15,7 +15,8 @@ const String alarmStateFileName = "/alarm_state.dat";
 
 AlarmPersistentState::AlarmPersistentState()
     :
-    _state(AlarmState::Uknknown)
+    _state(AlarmState::Uknknown),
+    _armedZones(allZones)
 {
 }
 
@@ -47,6 +48,11 @@ bool AlarmPersistentState::begin()
         return false;
     }
 
+    if (stateFile->read(reinterpret_cast<uint8_t*>(&_armedZones), sizeof(_armedZones)) != sizeof(_armedZones) || _armedZones == 0)
+    {
+        _armedZones = allZones;
+    }
+
     if (_state != AlarmState::Disarmed &&
         _state != AlarmState::Armed &&
         _state != AlarmState::Triggerd &&
@@ -66,7 +72,12 @@ AlarmPersistentState::AlarmState AlarmPersistentState::get() const
     return _state;
 }
 
-bool AlarmPersistentState::set(AlarmState state)
+ZoneMask AlarmPersistentState::armedZones() const
+{
+    return _armedZones;
+}
+
+bool AlarmPersistentState::set(AlarmState state, ZoneMask armedZones)
 {
     auto stateFile = AutoFile(SPIFFS.open(alarmStateFileName, FILE_WRITE));
     if (!stateFile)
@@ -75,11 +86,13 @@ bool AlarmPersistentState::set(AlarmState state)
         return false;
     }
 
-    if (!stateFile->write(reinterpret_cast<const uint8_t*>(&state), sizeof(state)))
+    if (!stateFile->write(reinterpret_cast<const uint8_t*>(&state), sizeof(state)) ||
+        !stateFile->write(reinterpret_cast<const uint8_t*>(&armedZones), sizeof(armedZones)))
     {
         log_e("Error reading alarm state file");
     }
 
     _state = state;
+    _armedZones = armedZones;
     return true;
 }
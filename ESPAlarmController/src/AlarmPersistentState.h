@@ -1,5 +1,7 @@
 #pragma once
 
+#include "AlarmZone.h"
+
 
 class AlarmPersistentState
 {
@@ -15,7 +17,11 @@ public:
     AlarmPersistentState();
     bool begin();
     AlarmState get() const;
-    bool set(AlarmState state);
+    // The zones that were armed. Files written before zones existed arm
+    // all of them.
+    ZoneMask armedZones() const;
+    bool set(AlarmState state, ZoneMask armedZones = allZones);
 private:
     AlarmState _state;
+    ZoneMask _armedZones;
 };
@@ -8,6 +8,218 @@
 #include "SoundPlayer.h"
 
 
+namespace
+{
+
+// What handleSensorState() and checkSensor() do for one combination of their
+// inputs. Both look the combination up in a table built at compile time
+// rather than walking a chain of ifs.
+struct Rule
+{
+    bool triggerAlarm;
+    bool cancelArming;
+    SoundPlayer::Sound sound;
+    // The sound is the fault chime, played at most once every
+    // SENSOR_FAULT_CHIME_INTERVAL_MS per sensor.
+    bool faultChime;
+    ActivityLog::EventType event;
+};
+
+constexpr Rule noRule = { false, false, SoundPlayer::Sound::Silence, false, ActivityLog::EventType::Nothing };
+constexpr Rule triggerRule = { true, false, SoundPlayer::Sound::Silence, false, ActivityLog::EventType::AlarmTriggered };
+
+constexpr Rule chimeRule(SoundPlayer::Sound sound, ActivityLog::EventType event)
+{
+    return Rule{ false, false, sound, false, event };
+}
+
+constexpr Rule faultChimeRule(bool cancelArming, ActivityLog::EventType event)
+{
+    return Rule{ false, cancelArming, SoundPlayer::Sound::SensorFault, true, event };
+}
+
+static_assert(static_cast<size_t>(AlarmState::AlarmTriggered) == 3, "alarm state table size out of date");
+static_assert(SensorState::Unknown == 3, "sensor state table size out of date");
+constexpr size_t alarmStateCount = 4;
+constexpr size_t sensorStateCount = 4;
+
+// Reports are looked up by alarm state, the sensor's last state, the reported
+// state and whether the sensor reported before.
+constexpr size_t reportRuleCount = alarmStateCount * sensorStateCount * sensorStateCount * 2;
+// Periodic checks by alarm state, whether the sensor timed out and whether
+// its last state was Fault.
+constexpr size_t checkRuleCount = alarmStateCount * 2 * 2;
+
+constexpr Rule reportRule(AlarmState alarmState, SensorState::State oldState, SensorState::State newState, bool reportedBefore)
+{
+    return alarmState == AlarmState::Disarmed
+        ? (oldState != SensorState::Open && newState == SensorState::Open && reportedBefore
+            ? chimeRule(SoundPlayer::Sound::SensorChimeOpened, ActivityLog::EventType::SensorOpened)
+            : oldState != SensorState::Closed && newState == SensorState::Closed && reportedBefore
+            ? chimeRule(SoundPlayer::Sound::SensorChimeClosed, ActivityLog::EventType::SensorClosed)
+            : newState == SensorState::Fault
+            ? faultChimeRule(false, ActivityLog::EventType::SensorFault)
+            : noRule)
+        // Armed sensors faulting are handled as opened
+        : alarmState == AlarmState::Armed && (newState == SensorState::Open || newState == SensorState::Fault)
+        ? triggerRule
+        : noRule;
+}
+
+constexpr Rule checkRule(AlarmState alarmState, bool timedOut, bool faulted)
+{
+    return timedOut
+        ? (alarmState == AlarmState::Arming ? faultChimeRule(true, ActivityLog::EventType::AlarmArmingFailed)
+            : alarmState == AlarmState::Disarmed ? faultChimeRule(false, ActivityLog::EventType::Nothing)
+            : alarmState == AlarmState::Armed ? triggerRule
+            : noRule)
+        // Keeps chiming for faulted sensors while disarmed
+        : faulted && alarmState == AlarmState::Disarmed
+        ? faultChimeRule(false, ActivityLog::EventType::Nothing)
+        : noRule;
+}
+
+constexpr AlarmState reportAlarmState(size_t index) { return static_cast<AlarmState>(index / (sensorStateCount * sensorStateCount * 2)); }
+constexpr SensorState::State reportOldState(size_t index) { return static_cast<SensorState::State>(index / (sensorStateCount * 2) % sensorStateCount); }
+constexpr SensorState::State reportNewState(size_t index) { return static_cast<SensorState::State>(index / 2 % sensorStateCount); }
+constexpr bool reportReportedBefore(size_t index) { return index % 2 != 0; }
+
+constexpr AlarmState checkAlarmState(size_t index) { return static_cast<AlarmState>(index / 4); }
+constexpr bool checkTimedOut(size_t index) { return index / 2 % 2 != 0; }
+constexpr bool checkFaulted(size_t index) { return index % 2 != 0; }
+
+template<size_t... I>
+struct Indices
+{
+};
+
+template<size_t N, size_t... I>
+struct MakeIndices : MakeIndices<N - 1, N - 1, I...>
+{
+};
+
+template<size_t... I>
+struct MakeIndices<0, I...>
+{
+    typedef Indices<I...> type;
+};
+
+template<size_t N>
+struct RuleTable
+{
+    Rule rules[N];
+};
+
+template<size_t... I>
+constexpr RuleTable<sizeof...(I)> makeReportRules(Indices<I...>)
+{
+    return RuleTable<sizeof...(I)>{ { reportRule(reportAlarmState(I), reportOldState(I), reportNewState(I), reportReportedBefore(I))... } };
+}
+
+template<size_t... I>
+constexpr RuleTable<sizeof...(I)> makeCheckRules(Indices<I...>)
+{
+    return RuleTable<sizeof...(I)>{ { checkRule(checkAlarmState(I), checkTimedOut(I), checkFaulted(I))... } };
+}
+
+constexpr RuleTable<reportRuleCount> reportRules = makeReportRules(MakeIndices<reportRuleCount>::type());
+constexpr RuleTable<checkRuleCount> checkRules = makeCheckRules(MakeIndices<checkRuleCount>::type());
+
+constexpr bool isNoRule(const Rule& rule)
+{
+    return !rule.triggerAlarm && !rule.cancelArming && rule.sound == SoundPlayer::Sound::Silence && rule.event == ActivityLog::EventType::Nothing;
+}
+
+// Holds for every rule in either table
+constexpr bool ruleConsistent(const Rule& rule)
+{
+    return (!rule.triggerAlarm || (rule.sound == SoundPlayer::Sound::Silence && rule.event == ActivityLog::EventType::AlarmTriggered))
+        && (!rule.cancelArming || rule.event == ActivityLog::EventType::AlarmArmingFailed)
+        && rule.faultChime == (rule.sound == SoundPlayer::Sound::SensorFault)
+        && !(rule.triggerAlarm && rule.cancelArming)
+        && (rule.event != ActivityLog::EventType::AlarmTriggered || rule.triggerAlarm);
+}
+
+constexpr bool reportRuleValid(size_t index)
+{
+    return ruleConsistent(reportRules.rules[index])
+        && !reportRules.rules[index].cancelArming
+        // The receive callback's guess at which reports trigger the alarm must hold
+        && reportRules.rules[index].triggerAlarm == AlarmPolicy::canTriggerAlarm(true, reportNewState(index), reportAlarmState(index) == AlarmState::Armed)
+        // Chimes are for disarmed alarms only
+        && (reportRules.rules[index].sound == SoundPlayer::Sound::Silence || reportAlarmState(index) == AlarmState::Disarmed)
+        && (reportAlarmState(index) != AlarmState::AlarmTriggered || isNoRule(reportRules.rules[index]))
+        && (reportAlarmState(index) != AlarmState::Arming || isNoRule(reportRules.rules[index]));
+}
+
+constexpr bool checkRuleValid(size_t index)
+{
+    return ruleConsistent(checkRules.rules[index])
+        && checkRules.rules[index].triggerAlarm == (checkAlarmState(index) == AlarmState::Armed && checkTimedOut(index))
+        && checkRules.rules[index].cancelArming == (checkAlarmState(index) == AlarmState::Arming && checkTimedOut(index))
+        // A sensor that timed out is faulty whatever it last reported
+        && (!checkTimedOut(index) || (checkRules.rules[index].faultChime == (checkAlarmState(index) == AlarmState::Disarmed || checkAlarmState(index) == AlarmState::Arming)))
+        && (checkRules.rules[index].sound == SoundPlayer::Sound::Silence || checkAlarmState(index) == AlarmState::Disarmed || checkAlarmState(index) == AlarmState::Arming)
+        && (checkAlarmState(index) != AlarmState::AlarmTriggered || isNoRule(checkRules.rules[index]));
+}
+
+constexpr bool reportRulesValid(size_t index)
+{
+    return index == reportRuleCount || (reportRuleValid(index) && reportRulesValid(index + 1));
+}
+
+constexpr bool checkRulesValid(size_t index)
+{
+    return index == checkRuleCount || (checkRuleValid(index) && checkRulesValid(index + 1));
+}
+
+static_assert(sizeof(reportRules.rules) / sizeof(Rule) == reportRuleCount, "report rule table size");
+static_assert(sizeof(checkRules.rules) / sizeof(Rule) == checkRuleCount, "check rule table size");
+static_assert(reportRulesValid(0), "invalid sensor report rule");
+static_assert(checkRulesValid(0), "invalid sensor check rule");
+
+size_t sensorStateIndex(SensorState::State state)
+{
+    // Anything out of range came off the air; it does what Unknown does.
+    auto index = static_cast<size_t>(static_cast<unsigned>(state));
+    return index < sensorStateCount ? index : static_cast<size_t>(SensorState::Unknown);
+}
+
+size_t reportRuleIndex(AlarmState alarmState, SensorState::State oldState, SensorState::State newState, bool reportedBefore)
+{
+    return ((static_cast<size_t>(alarmState) * sensorStateCount + sensorStateIndex(oldState)) * sensorStateCount + sensorStateIndex(newState)) * 2
+        + (reportedBefore ? 1 : 0);
+}
+
+size_t checkRuleIndex(AlarmState alarmState, bool timedOut, bool faulted)
+{
+    return (static_cast<size_t>(alarmState) * 2 + (timedOut ? 1 : 0)) * 2 + (faulted ? 1 : 0);
+}
+
+void applyRule(const Rule& rule, AlarmPolicy::Actions& actions, AlarmSensor& sensor, unsigned long now, ActivityLog& log)
+{
+    actions.triggerAlarm |= rule.triggerAlarm;
+    actions.cancelArming |= rule.cancelArming;
+
+    if (rule.sound != SoundPlayer::Sound::Silence && (!rule.faultChime || now - sensor.faultLastHandled >= SENSOR_FAULT_CHIME_INTERVAL_MS))
+    {
+        actions.requestPlaySound(rule.sound);
+        if (rule.faultChime)
+        {
+            sensor.faultLastHandled = now;
+        }
+    }
+
+    if (rule.event != ActivityLog::EventType::Nothing)
+    {
+        log.logEvent(rule.event, sensor.id);
+    }
+}
+
+}
+
+
+
 AlarmPolicy::AlarmPolicy(ActivityLog& log)
     :
     _log(log)
@@ -22,44 +234,18 @@ void AlarmPolicy::handleSensorState(Actions& actions, AlarmSensor& sensor, Senso
         return;
     }
 
-    if (alarmState == AlarmState::Disarmed)
-    {
-        if (sensor.state != SensorState::Open && newState == SensorState::Open && sensor.lastUpdate > 0)
-        {
-            actions.requestPlaySound(SoundPlayer::Sound::SensorChimeOpened);
-            _log.logEvent(ActivityLog::EventType::SensorOpened, sensor.id);
-        }
-        else if (sensor.state != SensorState::Closed && newState == SensorState::Closed && sensor.lastUpdate > 0)
-        {
-            actions.requestPlaySound(SoundPlayer::Sound::SensorChimeClosed);
-            _log.logEvent(ActivityLog::EventType::SensorClosed, sensor.id);
-        }
-        else if (newState == SensorState::Fault)
-        {
-            if (millis() - sensor.faultLastHandled >= SENSOR_FAULT_CHIME_INTERVAL_MS)
-            {
-                actions.requestPlaySound(SoundPlayer::Sound::SensorFault);
-                sensor.faultLastHandled = millis();
-            }
-
-            _log.logEvent(ActivityLog::EventType::SensorFault, sensor.id);
-        }
-    }
-    else if (alarmState == AlarmState::Armed)
+    const auto& rule = reportRules.rules[reportRuleIndex(alarmState, sensor.state, newState, sensor.lastUpdate > 0)];
+    if (rule.triggerAlarm)
     {
-        switch (newState)
+        if (newState == SensorState::Fault)
         {
-        case SensorState::Fault:
             log_a("ALARM: sensor %016llX fault! Handling as opened!", sensor.id);
-            // Fall through and sound the alarm
-        case SensorState::Open:
-            log_a("ALARM: sensor %016llX has been opened!", sensor.id);
-            actions.triggerAlarm = true;
-            _log.logEvent(ActivityLog::EventType::AlarmTriggered, sensor.id);
-        default:
-            break;
         }
+        log_a("ALARM: sensor %016llX has been opened!", sensor.id);
     }
+
+    // Only the fault chime needs the time
+    applyRule(rule, actions, sensor, rule.faultChime ? millis() : 0, _log);
 }
 
 
@@ -71,90 +257,90 @@ void AlarmPolicy::checkSensor(Actions& actions, AlarmSensor& sensor, AlarmState
         return;
     }
 
-    auto timeSinceLastUpdate = millis() - sensor.lastUpdate;
-    auto timeout = alarmState == AlarmState::Armed ? MAX_SENSOR_UPDATE_TIMEOUT_ARMED_MS : MAX_SENSOR_UPDATE_TIMEOUT_DISARMED_MS;
-    if (timeSinceLastUpdate >= timeout)
+    auto now = millis();
+    auto timeSinceLastUpdate = now - sensor.lastUpdate;
+    bool timedOut = timeSinceLastUpdate >= sensorUpdateTimeout(alarmState);
+    const auto& rule = checkRules.rules[checkRuleIndex(alarmState, timedOut, sensor.state == SensorState::Fault)];
+    if (timedOut)
     {
         log_a("FAULT: Sensor %016llX has not updated in over %lu seconds", sensor.id, timeSinceLastUpdate / 1000);
-
-        switch (alarmState)
+        if (rule.cancelArming)
         {
-        case AlarmState::Arming:
-            log_a("FAULT: Alarm currently arming. Cancelling arming");
             // TODO: Make extra sure this gets reported in the UI and play the fault sound
-            // Cancel the arming sound
-            actions.cancelArming = true;
-            _log.logEvent(ActivityLog::EventType::AlarmArmingFailed, sensor.id);
-            /* Fall through */
-        case AlarmState::Disarmed:
-            if (millis() - sensor.faultLastHandled >= SENSOR_FAULT_CHIME_INTERVAL_MS)
-            {
-                actions.requestPlaySound(SoundPlayer::Sound::SensorFault);
-                sensor.faultLastHandled = millis();
-            }
-            break;
-        case AlarmState::Armed:
-            {
-                log_a("ALARM: Sounding alarm on sensor fault");
-                bool firstTriggered = alarmState != AlarmState::AlarmTriggered;
-
-                actions.triggerAlarm = true;
-
-                if (firstTriggered)
-                {
-                    _log.logEvent(ActivityLog::EventType::AlarmTriggered, sensor.id);
-                }
-            }
-            break;
-        case AlarmState::AlarmTriggered:
-            break;
+            log_a("FAULT: Alarm currently arming. Cancelling arming");
         }
-    }
-    else
-    {
-        if (sensor.state == SensorState::Fault && alarmState == AlarmState::Disarmed)
+        if (rule.triggerAlarm)
         {
-            log_a("FAULT: Sensor %016llX fault", sensor.id);
-            if (millis() - sensor.faultLastHandled >= SENSOR_FAULT_CHIME_INTERVAL_MS)
-            {
-                actions.requestPlaySound(SoundPlayer::Sound::SensorFault);
-                sensor.faultLastHandled = millis();
-            }
+            log_a("ALARM: Sounding alarm on sensor fault");
         }
     }
+    else if (rule.faultChime)
+    {
+        log_a("FAULT: Sensor %016llX fault", sensor.id);
+    }
+
+    applyRule(rule, actions, sensor, now, _log);
 }
 
-bool AlarmPolicy::canArm(const SensorMap& sensors) const
+bool AlarmPolicy::nextSensorCheck(const AlarmSensor& sensor, AlarmState alarmState, unsigned long& checkTime) const
 {
-    if (sensors.empty())
+    if (!sensor.enabled)
     {
         return false;
     }
 
-    auto enabledSensors = 0;
-    for (auto pair : sensors)
+    auto now = millis();
+    auto timeout = sensorUpdateTimeout(alarmState);
+    auto chimeTime = now - sensor.faultLastHandled >= SENSOR_FAULT_CHIME_INTERVAL_MS ? now : sensor.faultLastHandled + SENSOR_FAULT_CHIME_INTERVAL_MS;
+    if (now - sensor.lastUpdate >= timeout)
     {
-        const auto& sensor = pair.second;
-        if (sensor.enabled)
+        switch (alarmState)
         {
-            if (sensor.state != SensorState::Closed)
-            {
-                return false;
-            }
-            enabledSensors++;
+        case AlarmState::Arming:
+        case AlarmState::Armed:
+            // Cancels arming or triggers the alarm right away.
+            checkTime = now;
+            return true;
+        case AlarmState::Disarmed:
+            // Keeps chiming until the sensor reports again.
+            checkTime = chimeTime;
+            return true;
+        case AlarmState::AlarmTriggered:
+            break;
         }
+        return false;
     }
 
-    return enabledSensors > 0;
+    checkTime = sensor.lastUpdate + timeout;
+    if (sensor.state == SensorState::Fault && alarmState == AlarmState::Disarmed && chimeTime - now < checkTime - now)
+    {
+        checkTime = chimeTime;
+    }
+    return true;
 }
 
+unsigned long AlarmPolicy::sensorUpdateTimeout(AlarmState alarmState)
+{
+    return alarmState == AlarmState::Armed ? MAX_SENSOR_UPDATE_TIMEOUT_ARMED_MS : MAX_SENSOR_UPDATE_TIMEOUT_DISARMED_MS;
+}
 
-std::vector<AlarmOperation> AlarmPolicy::validOperations(const SensorMap& sensors, AlarmState alarmState) const
+bool AlarmPolicy::canArm(const SensorCounts& counts, ZoneMask zones) const
+{
+    return (counts.populatedZones & zones) != 0 && (counts.notReadyZones & zones) == 0;
+}
+
+bool AlarmPolicy::canArm(const SensorMap& sensors) const
+{
+    return canArm(SensorCounts(sensors));
+}
+
+
+std::vector<AlarmOperation> AlarmPolicy::validOperations(const SensorCounts& counts, AlarmState alarmState, ZoneMask zones) const
 {
     switch (alarmState)
     {
     case AlarmState::Disarmed:
-        if (canArm(sensors))
+        if (canArm(counts, zones))
         {
             return { AlarmOperation::Arm };
         }
@@ -167,6 +353,11 @@ std::vector<AlarmOperation> AlarmPolicy::validOperations(const SensorMap& sensor
     }
 }
 
+std::vector<AlarmOperation> AlarmPolicy::validOperations(const SensorMap& sensors, AlarmState alarmState) const
+{
+    return validOperations(SensorCounts(sensors), alarmState);
+}
+
 bool AlarmPolicy::canModifySensors(AlarmState alarmState) const
 {
     return alarmState == AlarmState::Disarmed;
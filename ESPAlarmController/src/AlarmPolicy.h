@@ -5,7 +5,9 @@
 #include "AlarmOperation.h"
 #include "AlarmSensor.h"
 #include "AlarmState.h"
+#include "AlarmZone.h"
 #include "protocol.h"
+#include "SensorCounts.h"
 #include "SoundPlayer.h"
 
 
@@ -30,10 +32,36 @@ public:
         }
     };
     void handleSensorState(Actions& actions, AlarmSensor& sensor, SensorState::State newState, AlarmState alarmState) const;
+    // Whether handleSensorState() may trigger the alarm on the report. Only
+    // needs what the receive callback knows without taking the lock, so it
+    // can put these reports ahead of the rest.
+    static constexpr bool canTriggerAlarm(bool sensorEnabled, SensorState::State newState, bool armed)
+    {
+        return sensorEnabled && armed && (newState == SensorState::Open || newState == SensorState::Fault);
+    }
     void checkSensor(Actions& actions, AlarmSensor& sensor, AlarmState alarmState) const;
+    // When checkSensor() may next have something to do for the sensor, as
+    // long as neither the sensor nor the alarm state change. Returns false
+    // if it has nothing to do until then.
+    bool nextSensorCheck(const AlarmSensor& sensor, AlarmState alarmState, unsigned long& checkTime) const;
+    // Whether the zones can be armed: all their enabled sensors are closed,
+    // and there is at least one.
+    bool canArm(const SensorCounts& counts, ZoneMask zones = allZones) const;
+    std::vector<AlarmOperation> validOperations(const SensorCounts& counts, AlarmState alarmState, ZoneMask zones = allZones) const;
+    // Count the sensors first, prefer the SensorCounts versions if they are kept
     bool canArm(const SensorMap& sensors) const;
     std::vector<AlarmOperation> validOperations(const SensorMap& sensors, AlarmState alarmState) const;
+    // The alarm state as it applies to a sensor when only some zones are
+    // armed. Sensors outside the armed zones are handled as if the alarm
+    // was disarmed.
+    static constexpr AlarmState sensorAlarmState(AlarmState alarmState, ZoneMask sensorZones, ZoneMask armedZones)
+    {
+        return (alarmState == AlarmState::Arming || alarmState == AlarmState::Armed) && (sensorZones & armedZones) == 0
+            ? AlarmState::Disarmed
+            : alarmState;
+    }
     bool canModifySensors(AlarmState alarmState) const;
 private:
+    static unsigned long sensorUpdateTimeout(AlarmState alarmState);
     ActivityLog& _log;
 };
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "AlarmSystem.h"
 
+#include <ArduinoJson.h>
+
 
 String toString(uint64_t v)
 {
@@ -62,3 +64,89 @@ bool fromString(const String& str, uint64_t& v)
     v = ret;
     return true;
 }
+
+
+String zonesToString(ZoneMask zones)
+{
+    String str;
+    for (size_t zoneId = 0; zoneId < maxZones; ++zoneId)
+    {
+        if (zones & zoneBit(zoneId))
+        {
+            if (!str.isEmpty())
+            {
+                str += ',';
+            }
+            str += static_cast<unsigned>(zoneId);
+        }
+    }
+    return str;
+}
+
+bool zonesToJson(const ZoneList& zones, ZoneMask armedZones, ZoneMask readyZones, String& output)
+{
+    // Up to 32 zones with names of up to 31 characters, so sized for the
+    // actual list. The names are copied into the document, the keys and
+    // "yes"/"no" are not.
+    size_t capacity = JSON_ARRAY_SIZE(zones.size()) + zones.size() * JSON_OBJECT_SIZE(4);
+    for (const auto& zone : zones)
+    {
+        capacity += zone.name.length() + 1;
+    }
+
+    DynamicJsonDocument doc(capacity);
+    auto arrayObject = doc.to<JsonArray>();
+    for (const auto& zone : zones)
+    {
+        auto zoneObj = arrayObject.createNestedObject();
+        zoneObj["id"] = zone.id;
+        zoneObj["name"] = zone.name;
+        zoneObj["armed"] = armedZones & zoneBit(zone.id) ? "yes" : "no";
+        zoneObj["ready"] = readyZones & zoneBit(zone.id) ? "yes" : "no";
+    }
+
+    if (doc.overflowed())
+    {
+        return false;
+    }
+
+    serializeJson(doc, output);
+    return true;
+}
+
+bool zonesFromString(const String& str, ZoneMask& zones)
+{
+    ZoneMask ret = 0;
+    unsigned zoneId = 0;
+    size_t digits = 0;
+    for (auto c : str)
+    {
+        if (c >= '0' && c <= '9')
+        {
+            zoneId = zoneId * 10 + static_cast<unsigned>(c - '0');
+            if (++digits > 2 || zoneId >= maxZones)
+            {
+                return false;
+            }
+        }
+        else if (c == ',' && digits > 0)
+        {
+            ret |= zoneBit(zoneId);
+            zoneId = 0;
+            digits = 0;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    if (digits == 0)
+    {
+        // Empty, or ends with a comma
+        return false;
+    }
+
+    zones = ret | zoneBit(zoneId);
+    return true;
+}
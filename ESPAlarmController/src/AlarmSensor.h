@@ -1,9 +1,10 @@
 #pragma once
 
 #include <cassert>
-#include <map>
 
+#include "AlarmZone.h"
 #include "protocol.h"
+#include "SensorTable.h"
 
 
 class AlarmSensor
@@ -14,6 +15,7 @@ public:
         id(0),
         enabled(0),
         state(SensorState::Unknown),
+        zones(defaultZones),
         lastUpdate(0),
         faultLastHandled(0)
     {
@@ -25,6 +27,7 @@ public:
         enabled(enabled),
         name(name),
         state(state),
+        zones(defaultZones),
         lastUpdate(0),
         faultLastHandled(0)
     {
@@ -41,12 +44,14 @@ public:
     String name;
 
     SensorState::State state;
+    // Never 0, every sensor is in at least one zone
+    ZoneMask zones;
     unsigned long lastUpdate;
     unsigned long faultLastHandled;
 };
 
 
-using SensorMap = std::map<uint64_t, AlarmSensor>;
+using SensorMap = SensorTable<AlarmSensor>;
 
 
 String toString(uint64_t v);
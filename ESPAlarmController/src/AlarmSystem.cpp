@@ -8,6 +8,8 @@
 #include <alarm_config.h>
 #include "protocol.h"
 
+#include <algorithm>
+
 
 #define htonll(x)   (((uint64_t)htonl(x & 0xFFFFFFFF) << 32) | (uint64_t)htonl(x >> 32))
 
@@ -15,6 +17,32 @@
 namespace
 {
 
+const UBaseType_t alarmTaskPriority = 3;
+const UBaseType_t serviceTaskPriority = 1;
+const BaseType_t alarmTasksCore = 1;
+const uint32_t alarmTaskStackSize = 8192;
+const uint32_t serviceTaskStackSize = 8192;
+const unsigned long alarmCheckIntervalMs = 1 * 1000;
+const unsigned long webServerPollIntervalMs = 2;
+const unsigned long activityLogCheckIntervalMs = 1 * 1000;
+// In the order of AlarmSystem::Subsystem
+const char* const subsystemNames[] = {
+    "sensor_events",
+    "sound_player",
+    "check_sensors",
+    "web_server",
+    "activity_log",
+    "mem_tracker"
+};
+// In the order of AlarmSystem::FrameStage
+const char* const frameStageNames[] = {
+    "queued",
+    "policy",
+    "siren_start",
+    "first_buffer",
+    "frame_to_siren"
+};
+
 uint64_t macAddressToId(const uint8_t* macAddress)
 {
     uint64_t sensorId = 0;
@@ -35,9 +63,41 @@ AlarmSystem::AlarmSystem(const String& apSSID, const String& apPassword, int bcl
     _webServer(*this, _log),
     _policy(_log),
     _alarmState(AlarmState::Disarmed),
-    _lastCheck(0),
-    _sensorEventQueue(nullptr)
+    _armedZones(allZones),
+    _eventTrace{false, 0, 0},
+    _sirenTrace{false, 0, 0},
+    _nextEventSequence(0),
+    _priorityEvents(0),
+    _supersededEvents(0),
+    _armed(false),
+    _invalidFrames(0),
+    _droppedBatchEvents(0),
+    _maxEventsPerLoop(0),
+    _maxEventTimeMsPerLoop(0),
+    _eventsProcessed(0),
+    _lock(xSemaphoreCreateRecursiveMutex()),
+    _alarmTask(nullptr),
+    _tasksRunning(false),
+    _activeTasks(0)
+{
+}
+
+AlarmSystem::~AlarmSystem()
+{
+    stopTasks();
+    vSemaphoreDelete(_lock);
+}
+
+AlarmSystem::Lock::Lock(const AlarmSystem& alarmSystem)
+    :
+    _alarmSystem(alarmSystem)
+{
+    xSemaphoreTakeRecursive(_alarmSystem._lock, portMAX_DELAY);
+}
+
+AlarmSystem::Lock::~Lock()
 {
+    xSemaphoreGiveRecursive(_alarmSystem._lock);
 }
 
 bool AlarmSystem::begin()
@@ -61,22 +121,43 @@ bool AlarmSystem::begin()
     log_a("Initializing web server");
     _webServer.begin();
 
-    _sensorEventQueue = xQueueCreate(16, sizeof(SensorEventMessage));
-    if (_sensorEventQueue == nullptr)
-    {
-        log_e("Failed to create sensor event queue");
-        return false;
-    }
-
     initTime();
 
     _log.begin();
 
     _log.logEvent(ActivityLog::EventType::SystemStart);
 
+    addJobs();
+
     return true;
 }
 
+void AlarmSystem::addJobs()
+{
+    // Everything runs once right away, e.g. to resume the siren after a
+    // restart while the alarm was triggered.
+    auto now = millis();
+    _alarmJobs.addJob("check_sensors", alarmCheckIntervalMs, [this]() {
+        LatencyHistogram::Timer timer(latency(Subsystem::SensorChecks));
+        onCheckTimer();
+    }, now, 0);
+
+    // The web server can only be polled.
+    _serviceJobs.addJob("web_server", webServerPollIntervalMs, [this]() {
+        LatencyHistogram::Timer timer(latency(Subsystem::WebServer));
+        _webServer.onLoop();
+    }, now, 0);
+    _serviceJobs.addJob("activity_log", activityLogCheckIntervalMs, [this]() {
+        Lock lock(*this);
+        LatencyHistogram::Timer timer(latency(Subsystem::ActivityLog));
+        _log.onLoop();
+    }, now, 0);
+    _serviceJobs.addJob("mem_tracker", MemTracker::reportIntervalMs, [this]() {
+        LatencyHistogram::Timer timer(latency(Subsystem::MemTracker));
+        _memTracker.report();
+    }, now, 0);
+}
+
 void AlarmSystem::loadAlarmSensorsFromDb()
 {
     log_a("Initializing sensor database");
@@ -87,19 +168,37 @@ void AlarmSystem::loadAlarmSensorsFromDb()
         return;
     }
 
-    SensorList sensors;
-    if (!_sensorDb.getAlarmSensors(sensors))
+    if (!_sensorDb.getZones(_zones))
     {
-        log_e("Failed to load sensors from sensor database");
+        log_e("Failed to load zones from sensor database");
         // Still keep running
         return;
     }
 
+    // Straight from the file into _sensors, one sensor at a time
     log_a("Alarm sensors loaded from sensor DB:");
-    for (const auto& sensor : sensors)
-    {
+    _sensors.reserve(_sensorDb.sensorCount());
+    auto loaded = _sensorDb.forEachSensor([this](AlarmSensor&& sensor) {
         log_a("  %016llX", sensor.id);
-        _sensors[sensor.id] = sensor;
+        if (_sensors.size() >= maxSensors)
+        {
+            log_e("More than %u sensors in sensor DB, not loading sensor %016llX", maxSensors, sensor.id);
+            return;
+        }
+        auto& storedSensor = _sensors[sensor.id];
+        _sensorCounts.remove(storedSensor);
+        storedSensor = std::move(sensor);
+        _sensorCounts.add(storedSensor);
+        if (!_sensorIds.set(storedSensor.id, storedSensor.enabled))
+        {
+            log_e("Too many sensors to track sensor %016llX on receive", storedSensor.id);
+        }
+        scheduleSensorCheck(storedSensor);
+    });
+    if (!loaded)
+    {
+        log_e("Failed to load sensors from sensor database");
+        // Still keep running
     }
     log_a("end of loaded alarm sensor list");
 }
@@ -118,16 +217,16 @@ void AlarmSystem::loadPersistedState()
         {
         case AlarmPersistentState::AlarmState::Disarmed:
             log_a("Persisted alarm state: Disarmed");
-            _alarmState = AlarmState::Disarmed;
+            setAlarmState(AlarmState::Disarmed, allZones);
             break;
         case AlarmPersistentState::AlarmState::Armed:
-            log_a("Persisted alarm state: Armed");
-            _alarmState = AlarmState::Armed;
+            log_a("Persisted alarm state: Armed, zones %s", zonesToString(_flashState.armedZones()).c_str());
+            setAlarmState(AlarmState::Armed, _flashState.armedZones());
             _log.logEvent(ActivityLog::EventType::AlarmArmed);
             break;
         case AlarmPersistentState::AlarmState::Triggerd:
             log_a("ALARM: Persisted alarm state: Triggered. Resounding alarm");
-            _alarmState = AlarmState::AlarmTriggered;
+            setAlarmState(AlarmState::AlarmTriggered, _flashState.armedZones());
             _log.logEvent(ActivityLog::EventType::AlarmTriggered);
             break;
         default:
@@ -153,49 +252,236 @@ void AlarmSystem::initTime()
     }
 }
 
-void AlarmSystem::onLoop()
+unsigned long AlarmSystem::onLoop()
 {
-    handleSensorEvents();
-    _webServer.onLoop();
-    _soundPlayer.onLoop();
-    _webServer.onLoop();
+    auto alarmWaitMs = onAlarmLoop();
+    auto serviceWaitMs = onServiceLoop();
+    return std::min(alarmWaitMs, serviceWaitMs);
+}
 
-    auto now = millis();
+void AlarmSystem::waitForWork(unsigned long maxWaitMs)
+{
+    if (_alarmTask == nullptr)
+    {
+        // So the receive callback wakes us up.
+        _alarmTask = xTaskGetCurrentTaskHandle();
+    }
+
+    // Both loops run here, so both were idle.
+    auto idleUs = waitForSensorEvent(maxWaitMs);
+    _serviceJobs.recordIdle(idleUs, micros());
+}
+
+uint32_t AlarmSystem::waitForSensorEvent(unsigned long maxWaitMs)
+{
+    uint32_t start = micros();
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(maxWaitMs));
+    uint32_t now = micros();
+    _alarmJobs.recordIdle(now - start, now);
+    return now - start;
+}
+
+bool AlarmSystem::startTasks()
+{
+    if (_tasksRunning)
+    {
+        return true;
+    }
+
+    _tasksRunning = true;
+    _activeTasks = 2;
+
+    TaskHandle_t alarmTask = nullptr;
+    if (xTaskCreatePinnedToCore(alarmTaskMain, "alarm", alarmTaskStackSize, this, alarmTaskPriority, &alarmTask, alarmTasksCore) != pdPASS)
+    {
+        log_e("Failed to create alarm task");
+        _tasksRunning = false;
+        _activeTasks = 0;
+        return false;
+    }
+    _alarmTask = alarmTask;
+
+    if (xTaskCreatePinnedToCore(serviceTaskMain, "alarm_service", serviceTaskStackSize, this, serviceTaskPriority, nullptr, alarmTasksCore) != pdPASS)
+    {
+        log_e("Failed to create alarm service task");
+        _activeTasks--;
+        stopTasks();
+        return false;
+    }
+
+    log_a("Alarm system tasks started");
+    return true;
+}
+
+void AlarmSystem::stopTasks()
+{
+    if (!_tasksRunning)
+    {
+        return;
+    }
+
+    _tasksRunning = false;
+    auto alarmTask = _alarmTask.load();
+    if (alarmTask != nullptr)
+    {
+        xTaskNotifyGive(alarmTask);
+    }
+
+    while (_activeTasks > 0)
+    {
+        vTaskDelay(1);
+    }
+    _alarmTask = nullptr;
+}
 
-    if (now - _lastCheck > 1 * 1000)
+void AlarmSystem::alarmTaskMain(void* param)
+{
+    auto* alarmSystem = static_cast<AlarmSystem*>(param);
+    while (alarmSystem->_tasksRunning)
+    {
+        auto waitMs = alarmSystem->onAlarmLoop();
+        // Sleep until a sensor event arrives or there is periodic work to do.
+        alarmSystem->waitForSensorEvent(waitMs);
+    }
+
+    alarmSystem->_activeTasks--;
+    vTaskDelete(nullptr);
+}
+
+void AlarmSystem::serviceTaskMain(void* param)
+{
+    auto* alarmSystem = static_cast<AlarmSystem*>(param);
+    while (alarmSystem->_tasksRunning)
     {
-        _lastCheck = now;
+        auto waitMs = alarmSystem->onServiceLoop();
+        uint32_t start = micros();
+        vTaskDelay(pdMS_TO_TICKS(waitMs));
+        uint32_t now = micros();
+        alarmSystem->_serviceJobs.recordIdle(now - start, now);
+    }
+
+    alarmSystem->_activeTasks--;
+    vTaskDelete(nullptr);
+}
 
-        if (_alarmState == AlarmState::AlarmTriggered)
+unsigned long AlarmSystem::onAlarmLoop()
+{
+    Lock lock(*this);
+
+    {
+        LatencyHistogram::Timer timer(latency(Subsystem::SensorEvents));
+        handleSensorEvents();
+    }
+    {
+        LatencyHistogram::Timer timer(latency(Subsystem::SoundPlayer));
+        _soundPlayer.onLoop();
+    }
+    traceSirenOutput();
+
+    auto waitMs = _alarmJobs.run(millis());
+
+    if (!_sensorEventQueue.empty() || !_priorityEventQueue.empty())
+    {
+        // The event budget ran out. The receive callback's notification was
+        // already taken, so don't wait for another one.
+        return 0;
+    }
+
+    if (_soundPlayer.soundPlaying())
+    {
+        // Keep the WAV decoder fed
+        return 1;
+    }
+
+    return waitMs;
+}
+
+unsigned long AlarmSystem::onServiceLoop()
+{
+    // The web handlers take the lock themselves, around their alarm system
+    // accesses only.
+    return _serviceJobs.run(millis());
+}
+
+void AlarmSystem::onCheckTimer()
+{
+    if (_alarmState == AlarmState::AlarmTriggered)
+    {
+        if (!_soundPlayer.soundPlaying())
         {
-            if (!_soundPlayer.soundPlaying())
+            log_a("ALARM: Resounding alarm!");
+            if (!_soundPlayer.playSound(SoundPlayer::Sound::AlarmSouding))
             {
-                log_a("ALARM: Resounding alarm!");
-                if (!_soundPlayer.playSound(SoundPlayer::Sound::AlarmSouding))
-                {
-                    log_e("Failed to play sound");
-                }
+                log_e("Failed to play sound");
             }
         }
+    }
 
-        checkSensors();
-        _webServer.onLoop();
+    checkSensors();
+}
+
+void AlarmSystem::traceSirenOutput()
+{
+    SoundPlayer::Sound sound;
+    uint32_t outputUs;
+    if (!_soundPlayer.takeFirstOutput(sound, outputUs))
+    {
+        return;
+    }
+
+    if (_sirenTrace.active && sound == SoundPlayer::Sound::AlarmSouding)
+    {
+        recordFrameStage(FrameStage::FirstBuffer, outputUs - _sirenTrace.stageStartUs);
+        recordFrameStage(FrameStage::FrameToSiren, outputUs - _sirenTrace.receivedUs);
     }
+    // Whatever played first, the siren this trace was for has either been
+    // heard or cut off.
+    _sirenTrace.active = false;
+}
+
+void AlarmSystem::recordFrameStage(FrameStage stage, uint32_t us)
+{
+    _frameLatency[static_cast<size_t>(stage)].record(us);
+}
 
-    _webServer.onLoop();
-    _log.onLoop();
+AlarmState AlarmSystem::sensorAlarmState(const AlarmSensor& sensor) const
+{
+    return AlarmPolicy::sensorAlarmState(_alarmState, sensor.zones, _armedZones);
+}
 
-    _memTracker.onLoop();
+void AlarmSystem::setAlarmState(AlarmState state, ZoneMask armedZones)
+{
+    bool changed = state != _alarmState || armedZones != _armedZones;
+    _alarmState = state;
+    _armedZones = armedZones;
+    _armed.store(state != AlarmState::Disarmed, std::memory_order_relaxed);
+    if (changed)
+    {
+        // The timeouts and what happens on them depend on the alarm state
+        // and the armed zones.
+        scheduleSensorChecks();
+    }
 }
 
 AlarmState AlarmSystem::state() const
 {
+    Lock lock(*this);
     return _alarmState;
 }
 
-std::vector<AlarmOperation> AlarmSystem::validOperations() const
+ZoneMask AlarmSystem::armedZones() const
 {
-    return _policy.validOperations(_sensors, _alarmState);
+    Lock lock(*this);
+    return _armedZones;
+}
+
+std::vector<AlarmOperation> AlarmSystem::validOperations(ZoneMask zones) const
+{
+    Lock lock(*this);
+#ifdef ALARM_DEBUG_CHECKS
+    assert(sensorCountsConsistent());
+#endif
+    return _policy.validOperations(_sensorCounts, _alarmState, zones & definedZones());
 }
 
 const SensorMap& AlarmSystem::sensors() const
@@ -203,6 +489,28 @@ const SensorMap& AlarmSystem::sensors() const
     return _sensors;
 }
 
+const ZoneList& AlarmSystem::zones() const
+{
+    return _zones;
+}
+
+ZoneMask AlarmSystem::definedZones() const
+{
+    Lock lock(*this);
+    ZoneMask zones = 0;
+    for (const auto& zone : _zones)
+    {
+        zones |= zoneBit(zone.id);
+    }
+    return zones;
+}
+
+ZoneMask AlarmSystem::readyZones() const
+{
+    Lock lock(*this);
+    return _sensorCounts.populatedZones & ~_sensorCounts.notReadyZones & definedZones();
+}
+
 AlarmSensor* AlarmSystem::getSensor(uint64_t sensorId)
 {
     auto it = _sensors.find(sensorId);
@@ -219,53 +527,214 @@ const AlarmSensor* AlarmSystem::getSensor(uint64_t sensorId) const
     return const_cast<AlarmSystem*>(this)->getSensor(sensorId);
 }
 
-bool AlarmSystem::updateSensor(AlarmSensor& sensor)
+bool AlarmSystem::updateSensor(const AlarmSensor& sensor)
+{
+    return updateSensorConfig(sensor.id, sensor.name, sensor.enabled, sensor.zones);
+}
+
+bool AlarmSystem::updateSensorConfig(uint64_t sensorId, const String& name, bool enabled, ZoneMask zones)
 {
+    Lock lock(*this);
+
     if (!_policy.canModifySensors(_alarmState))
     {
         log_e("Cannot change sesors now");
         return false;
     }
 
-    auto it = _sensors.find(sensor.id);
+    if (zones == 0 || (zones & ~definedZones()) != 0)
+    {
+        log_e("Sensor %016llX put in undefined zones %s", sensorId, zonesToString(zones).c_str());
+        return false;
+    }
+
+    if (name.length() > SensorDataBase::maxNameLength)
+    {
+        log_e("Sensor %016llX name is too long", sensorId);
+        return false;
+    }
+
+    auto it = _sensors.find(sensorId);
     if (it == _sensors.end())
     {
         return false;
     }
-    it->second = sensor;
 
-    return _sensorDb.updateSensor(it->second);  // Use the stored object to catch any bugs
+    // Stored first, so if that fails the sensor is left as it was
+    AlarmSensor config(sensorId, enabled, name, SensorState::Unknown);
+    config.zones = zones;
+    if (!_sensorDb.updateSensor(config))
+    {
+        return false;
+    }
+
+    // Only the configuration changes, a sensor event handled since the
+    // caller looked at the sensor must not be undone.
+    auto& sensor = it->second;
+    _sensorCounts.remove(sensor);
+    sensor.name = std::move(config.name);
+    sensor.enabled = enabled;
+    sensor.zones = zones;
+    _sensorCounts.add(sensor);
+    _sensorIds.set(sensorId, enabled);
+    scheduleSensorCheck(sensor);
+    return true;
 }
 
 
-bool AlarmSystem::canArm() const
+void AlarmSystem::setSensorEventBudget(size_t maxEventsPerLoop, unsigned long maxTimeMsPerLoop)
+{
+    Lock lock(*this);
+    _maxEventsPerLoop = maxEventsPerLoop;
+    _maxEventTimeMsPerLoop = maxTimeMsPerLoop;
+}
+
+AlarmSystem::IngestStats AlarmSystem::ingestStats() const
+{
+    Lock lock(*this);
+    auto sequenceStats = _sensorSequenceFilter.stats();
+    auto admissionStats = _sensorAdmission.stats();
+    return {
+        _eventsProcessed,
+        _sensorEventQueue.overflows() + _priorityEventQueue.overflows() + _droppedBatchEvents.load(std::memory_order_relaxed),
+        _sensorEventCoalescer.mergedEvents() + _supersededEvents,
+        _sensorEventQueue.highWater(),
+        _invalidFrames.load(std::memory_order_relaxed),
+        sequenceStats.duplicates,
+        sequenceStats.outOfOrder,
+        sequenceStats.stale,
+        admissionStats.throttledKnown + admissionStats.throttledUnknown,
+        _priorityEvents,
+        _priorityEventQueue.highWater()
+    };
+}
+
+bool AlarmSystem::getSensorLinkStats(uint64_t sensorId, SensorLinkStats::Stats& stats) const
 {
-    return _policy.canArm(_sensors);
+    // No lock needed, the stats are published lock free by the receive callback.
+    return _sensorLinkStats.get(sensorId, stats);
 }
 
-bool AlarmSystem::arm()
+AlarmSystem::LoopStats AlarmSystem::alarmLoopStats() const
 {
+    return loopStats(_alarmJobs);
+}
+
+AlarmSystem::LoopStats AlarmSystem::serviceLoopStats() const
+{
+    return loopStats(_serviceJobs);
+}
+
+AlarmSystem::LoopStats AlarmSystem::loopStats(const TimerWheel& jobs)
+{
+    // No lock needed, the loops publish their stats lock free. Jobs are only
+    // added by begin().
+    LoopStats stats;
+    stats.idlePermille = jobs.idlePermille();
+    for (size_t i = 0; i < jobs.jobCount(); ++i)
+    {
+        stats.jobs.push_back(jobs.jobStats(i));
+    }
+    return stats;
+}
+
+std::vector<AlarmSystem::LatencyStats> AlarmSystem::latencyStats() const
+{
+    // No lock needed, the histograms are published lock free.
+    static_assert(sizeof(subsystemNames) / sizeof(subsystemNames[0]) == static_cast<size_t>(Subsystem::Count),
+                  "A subsystem is missing its name");
+    std::vector<LatencyStats> stats;
+    for (size_t i = 0; i < static_cast<size_t>(Subsystem::Count); ++i)
+    {
+        stats.push_back({ subsystemNames[i], _latency[i].snapshot() });
+    }
+    return stats;
+}
+
+std::vector<AlarmSystem::LatencyStats> AlarmSystem::frameLatencyStats() const
+{
+    // No lock needed, the histograms are published lock free.
+    static_assert(sizeof(frameStageNames) / sizeof(frameStageNames[0]) == static_cast<size_t>(FrameStage::Count),
+                  "A frame stage is missing its name");
+    std::vector<LatencyStats> stats;
+    for (size_t i = 0; i < static_cast<size_t>(FrameStage::Count); ++i)
+    {
+        stats.push_back({ frameStageNames[i], _frameLatency[i].snapshot() });
+    }
+    return stats;
+}
+
+std::vector<uint8_t> AlarmSystem::policyTrace() const
+{
+    Lock lock(*this);
+    return _policyTrace.serialize();
+}
+
+LatencyHistogram& AlarmSystem::latency(Subsystem subsystem)
+{
+    return _latency[static_cast<size_t>(subsystem)];
+}
+
+bool AlarmSystem::updateZone(const AlarmZone& zone)
+{
+    Lock lock(*this);
+
+    if (!_policy.canModifySensors(_alarmState))
+    {
+        log_e("Cannot change zones now");
+        return false;
+    }
+
+    if (!_sensorDb.updateZone(zone))
+    {
+        return false;
+    }
+
+    return _sensorDb.getZones(_zones);
+}
+
+bool AlarmSystem::canArm(ZoneMask zones) const
+{
+    Lock lock(*this);
+#ifdef ALARM_DEBUG_CHECKS
+    assert(sensorCountsConsistent());
+#endif
+    // Undefined zones have no sensors, so would make any set of zones armable
+    return _policy.canArm(_sensorCounts, zones & definedZones());
+}
+
+bool AlarmSystem::sensorCountsConsistent() const
+{
+    Lock lock(*this);
+    return _sensorCounts == SensorCounts(_sensors);
+}
+
+bool AlarmSystem::arm(ZoneMask zones)
+{
+    Lock lock(*this);
+
+    zones &= definedZones();
     if (_alarmState == AlarmState::Armed)
     {
-        return true;
+        return zones == _armedZones;
     }
 
-    if (!canArm())
+    if (!canArm(zones))
     {
         log_w("Alarm system cannot be armed now");
         return false;
     }
 
     // TODO: Need to handle arming period
-    _alarmState = AlarmState::Armed;
-    log_a("Alarm system armed");
+    setAlarmState(AlarmState::Armed, zones);
+    log_a("Alarm system armed, zones %s", zonesToString(zones).c_str());
     if (!_soundPlayer.playSound(SoundPlayer::Sound::AlarmArm))
     {
         log_e("Failed to play armed sound");
         // Don't fail operation
     }
     log_a("Persisting alarm state as armed");
-    if (!_flashState.set(AlarmPersistentState::AlarmState::Armed))
+    if (!_flashState.set(AlarmPersistentState::AlarmState::Armed, zones))
     {
         log_e("Failed to persist alarm state!");
         // Don't fail.
@@ -277,13 +746,15 @@ bool AlarmSystem::arm()
 
 void AlarmSystem::disarm()
 {
+    Lock lock(*this);
+
     if (_alarmState == AlarmState::Disarmed)
     {
         return;
     }
 
     _soundPlayer.silence();
-    _alarmState = AlarmState::Disarmed;
+    setAlarmState(AlarmState::Disarmed, allZones);
     log_a("Alarm system disarmed");
     if (!_soundPlayer.playSound(SoundPlayer::Sound::AlarmDisarm))
     {
@@ -303,48 +774,237 @@ void AlarmSystem::disarm()
 
 void AlarmSystem::onDataReceive(const uint8_t * mac_addr, const uint8_t *incomingData, int len)
 {
-    log_a("Received sensor message");
     SensorEventMessage message;
+    message.receivedUs = micros();
     memcpy(message.macAddress, mac_addr, sizeof(message.macAddress));
 
-    if (len < sizeof(message.state))
+    uint64_t sensorId = macAddressToId(message.macAddress);
+    auto membership = _sensorIds.find(sensorId);
+    if (membership == SensorIdSet::Membership::Unknown && !_sensorAdmission.admitUnknown(millis()))
     {
-        log_e("Recevied data is too small: %d bytes, %u expected", len, sizeof(message.state));
+        // Most of these are other ESP-NOW devices nearby. Reject them before
+        // decoding, logging or tracking anything.
         return;
     }
 
-    memcpy(&message.state, incomingData, sizeof(message.state));
+    log_a("Received sensor message");
+    SensorFrame frame;
+    if (len < 0 || !frame.decode(incomingData, len))
+    {
+        log_e("Received invalid sensor frame: %d bytes", len);
+        _invalidFrames.store(_invalidFrames.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        _sensorLinkStats.recordInvalidFrame(sensorId);
+        return;
+    }
+    message.state = frame.toSensorState();
+    _sensorLinkStats.recordFrame(sensorId, frame, millis());
+
+    if (membership != SensorIdSet::Membership::Unknown &&
+        !_sensorAdmission.admit(sensorId, membership, frame, _armed.load(std::memory_order_relaxed), millis()))
+    {
+        // Not acked, like a frame lost on the air.
+        log_d("Throttled frame from sensor %016llX", sensorId);
+        return;
+    }
 
-    auto ret = xQueueSend(_sensorEventQueue, &message, 0);
-    if (ret != pdTRUE)
+    // Version 1 frames have no sequence number to check and expect no ack.
+    bool acked = frame.version >= sensorFrameVersion;
+    if (acked)
     {
-        log_e("Failed to queue sensor event. Error: %d", ret);
-        if (ret == errQUEUE_FULL)
+        auto result = _sensorSequenceFilter.accept(sensorId, frame.sequence, frame.sequenceReset);
+        if (result == SensorSequenceFilter::Result::Duplicate)
+        {
+            // The sensor is retrying because our ack got lost.
+            ackSensorFrame(mac_addr, frame);
+        }
+        if (result != SensorSequenceFilter::Result::Accepted)
+        {
+            log_d("Dropped repeated frame %u from sensor %016llX", frame.sequence, sensorId);
+            return;
+        }
+    }
+
+    // A batch goes through one lane, so its events stay in order. While
+    // armed, it takes the priority lane if any of them can trigger the alarm.
+    auto armed = _armed.load(std::memory_order_relaxed);
+    bool priority = false;
+    for (size_t i = 0; i < frame.edgeCount; ++i)
+    {
+        priority = priority || AlarmPolicy::canTriggerAlarm(membership == SensorIdSet::Membership::Enabled, frame.edges[i].state, armed);
+    }
+    auto& queue = priority ? _priorityEventQueue : _sensorEventQueue;
+
+    if (frame.edgeCount > 1 && queue.capacity() - queue.size() < frame.edgeCount)
+    {
+        // Queue batches all or nothing, so the sensor's retry can't repeat
+        // part of one.
+        log_e("No room in sensor event queue for %u events", frame.edgeCount);
+        _droppedBatchEvents.store(_droppedBatchEvents.load(std::memory_order_relaxed) + frame.edgeCount, std::memory_order_relaxed);
+        if (acked)
+        {
+            // Don't ack, so the sensor retries, and let the retry through.
+            _sensorSequenceFilter.forget(sensorId, frame.sequence);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < frame.edgeCount; ++i)
+    {
+        if (frame.edgeCount > 1)
+        {
+            log_d("Batched event %u from sensor %016llX: %s %u ms ago", i, sensorId, SensorState::toString(frame.edges[i].state), frame.edges[i].ageMs);
+        }
+        message.state.state = frame.edges[i].state;
+        message.sequence = _nextEventSequence++;
+        auto queued = priority ? queuePriorityEvent(sensorId, message) : queueSensorEvent(sensorId, message);
+        if (!queued)
         {
             log_e("Sensor event queue full");
+            if (acked)
+            {
+                // Don't ack, so the sensor retries, and let the retry through.
+                _sensorSequenceFilter.forget(sensorId, frame.sequence);
+            }
+            return;
         }
     }
+
+    if (acked)
+    {
+        ackSensorFrame(mac_addr, frame);
+    }
+
+    auto alarmTask = _alarmTask.load();
+    if (alarmTask != nullptr)
+    {
+        xTaskNotifyGive(alarmTask);
+    }
+}
+
+bool AlarmSystem::queueSensorEvent(uint64_t sensorId, const SensorEventMessage& message)
+{
+    auto sequence = _sensorEventQueue.nextPushSequence();
+    if (_sensorEventCoalescer.merge(sensorId, message.state.state, _sensorEventQueue.nextPopSequence(), sequence))
+    {
+        log_d("Merged report from sensor %016llX with queued event", sensorId);
+        return true;
+    }
+
+    if (!_sensorEventQueue.push(message))
+    {
+        return false;
+    }
+
+    _sensorEventCoalescer.queued(sensorId, message.state.state, sequence);
+    return true;
+}
+
+bool AlarmSystem::queuePriorityEvent(uint64_t sensorId, const SensorEventMessage& message)
+{
+    if (!_priorityEventQueue.push(message))
+    {
+        return false;
+    }
+
+    // A later report must not merge with an event this one overtakes, it
+    // would be skipped as superseded.
+    _sensorEventCoalescer.forget(sensorId);
+    return true;
+}
+
+void AlarmSystem::ackSensorFrame(const uint8_t * mac_addr, const SensorFrame& frame)
+{
+    SensorAck ack;
+    ack.sequence = frame.sequence;
+    uint8_t buffer[sensorAckSize];
+    auto len = ack.encode(buffer, sizeof(buffer));
+    if (!_eSPNowServer.send(mac_addr, buffer, len))
+    {
+        log_e("Failed to ack frame %u", frame.sequence);
+    }
 }
 
 void AlarmSystem::handleSensorEvents()
 {
+    auto startTime = millis();
+    size_t eventsHandled = 0;
     SensorEventMessage message;
-    // Only one event per iteration
-    if (xQueueReceive(_sensorEventQueue, &message, 0) == pdTRUE)
+    while (true)
     {
-        uint64_t sensorId = macAddressToId(message.macAddress);
+        // Events that can trigger the alarm go first, whatever the budget.
+        // The lane is checked again after each heartbeat, in case one
+        // arrived meanwhile.
+        if (_priorityEventQueue.pop(message))
+        {
+            handleSensorEvent(message);
+            _priorityEventSequences[macAddressToId(message.macAddress)] = message.sequence;
+            _priorityEvents++;
+            continue;
+        }
+
+        // Drain the queue, up to the configured budget, so bursts of sensor
+        // reports don't back up and overflow the queue.
+        if (sensorEventBudgetExhausted(eventsHandled, startTime) ||
+            !_sensorEventQueue.pop(message))
+        {
+            break;
+        }
 
-        log_a("Sensor %016llX state: wakeup reason: \"%s\", state: %s, vcc: %.2f, @ %.3f",
-                    sensorId,
-                    SensorState::wakeupReasontoString(message.state.wakeupReason),
-                    SensorState::toString(message.state.state),
-                    message.state.vcc,
-                    static_cast<double>(millis()) / 1000.0);
+        if (supersededByPriorityEvent(message))
+        {
+            // The sensor's state already moved on, don't undo that.
+            log_d("Skipped event from sensor %016llX overtaken by a priority event", macAddressToId(message.macAddress));
+            _supersededEvents++;
+            continue;
+        }
 
-        updateSensorState(sensorId, message.state.state);
+        handleSensorEvent(message);
+        eventsHandled++;
     }
 }
 
+bool AlarmSystem::supersededByPriorityEvent(const SensorEventMessage& message) const
+{
+    auto it = _priorityEventSequences.find(macAddressToId(message.macAddress));
+    return it != _priorityEventSequences.end() &&
+           static_cast<int32_t>(message.sequence - it->second) < 0;
+}
+
+bool AlarmSystem::sensorEventBudgetExhausted(size_t eventsHandled, unsigned long startTime) const
+{
+    if (_maxEventsPerLoop > 0 && eventsHandled >= _maxEventsPerLoop)
+    {
+        return true;
+    }
+
+    if (_maxEventTimeMsPerLoop > 0 && millis() - startTime >= _maxEventTimeMsPerLoop)
+    {
+        return true;
+    }
+
+    return false;
+}
+
+void AlarmSystem::handleSensorEvent(const SensorEventMessage& message)
+{
+    uint32_t dequeuedUs = micros();
+    recordFrameStage(FrameStage::Queued, dequeuedUs - message.receivedUs);
+    _eventTrace = { true, message.receivedUs, dequeuedUs };
+
+    uint64_t sensorId = macAddressToId(message.macAddress);
+
+    log_a("Sensor %016llX state: wakeup reason: \"%s\", state: %s, vcc: %.2f, @ %.3f",
+                sensorId,
+                SensorState::wakeupReasontoString(message.state.wakeupReason),
+                SensorState::toString(message.state.state),
+                message.state.vcc,
+                static_cast<double>(millis()) / 1000.0);
+
+    updateSensorState(sensorId, message.state.state);
+    _eventTrace.active = false;
+    _eventsProcessed++;
+}
+
 void AlarmSystem::updateSensorState(uint64_t sensorId, SensorState::State newState)
 {
     log_a("Sensor event: %016llX, new state: %u", sensorId, newState);
@@ -352,16 +1012,20 @@ void AlarmSystem::updateSensorState(uint64_t sensorId, SensorState::State newSta
     if (it == _sensors.end())
     {
         log_a("New sensor: %016llX", sensorId);
+        if (_sensors.size() >= maxSensors)
+        {
+            log_e("Cannot add sensor %016llX, there are already %u sensors", sensorId, maxSensors);
+            return;
+        }
 
-        _sensors[sensorId] = AlarmSensor(sensorId, false, "", newState);
-        it = _sensors.find(sensorId);
-        if (it == _sensors.end())
+        it = _sensors.insert(sensorId, AlarmSensor(sensorId, false, "", newState)).first;
+        _sensorCounts.add(it->second);
+        if (!_sensorIds.set(sensorId, false))
         {
-            log_e("Cannot find sensor that was just added");
-            assert(it != _sensors.end());
+            log_e("Too many sensors to track sensor %016llX on receive", sensorId);
         }
 
-        if (!_sensorDb.storeSensor(_sensors[sensorId]))
+        if (!_sensorDb.storeSensor(it->second))
         {
             log_e("Failed to store sensor %016llX to sensor database", sensorId);
             // Keep running.
@@ -374,24 +1038,72 @@ void AlarmSystem::updateSensorState(uint64_t sensorId, SensorState::State newSta
 
     auto& sensor = it->second;
 
+    _sensorCounts.remove(sensor);
     sensor.updateState(newState);
+    _sensorCounts.add(sensor);
+    scheduleSensorCheck(sensor);
 }
 
 
 void AlarmSystem::handleSensorState(AlarmSensor& sensor, SensorState::State newState)
 {
+    auto alarmState = sensorAlarmState(sensor);
+    auto record = PolicyTrace::capture(PolicyTrace::Input::SensorState, sensor, newState, alarmState, millis());
     AlarmPolicy::Actions actions;
-    _policy.handleSensorState(actions, sensor, newState, _alarmState);
+    _policy.handleSensorState(actions, sensor, newState, alarmState);
+    _policyTrace.add(record, actions);
+    if (_eventTrace.active)
+    {
+        uint32_t now = micros();
+        recordFrameStage(FrameStage::Policy, now - _eventTrace.stageStartUs);
+        _eventTrace.stageStartUs = now;
+    }
     handleAlarmPolicyActions(actions);
 }
 
 void AlarmSystem::checkSensors()
 {
-    for (auto& pair : _sensors)
+    // Only the sensors due are checked. Ones rescheduled for now while
+    // handling these wait for the next pass, like they did when every sensor
+    // was checked each pass.
+    _expiredSensors.clear();
+    _sensorDeadlines.popExpired(millis(), _expiredSensors);
+    for (auto sensorId : _expiredSensors)
     {
+        auto it = _sensors.find(sensorId);
+        if (it == _sensors.end())
+        {
+            continue;
+        }
+
+        auto alarmState = sensorAlarmState(it->second);
+        auto record = PolicyTrace::capture(PolicyTrace::Input::SensorCheck, it->second, it->second.state, alarmState, millis());
         AlarmPolicy::Actions actions;
-        _policy.checkSensor(actions, pair.second, _alarmState);
+        _policy.checkSensor(actions, it->second, alarmState);
+        _policyTrace.add(record, actions);
         handleAlarmPolicyActions(actions);
+        scheduleSensorCheck(it->second);
+    }
+}
+
+void AlarmSystem::scheduleSensorCheck(const AlarmSensor& sensor)
+{
+    unsigned long checkTime;
+    if (_policy.nextSensorCheck(sensor, sensorAlarmState(sensor), checkTime))
+    {
+        _sensorDeadlines.set(sensor.id, checkTime);
+    }
+    else
+    {
+        _sensorDeadlines.remove(sensor.id);
+    }
+}
+
+void AlarmSystem::scheduleSensorChecks()
+{
+    for (const auto& pair : _sensors)
+    {
+        scheduleSensorCheck(pair.second);
     }
 }
 
@@ -407,14 +1119,20 @@ void AlarmSystem::handleAlarmPolicyActions(const AlarmPolicy::Actions& actions)
 
     if (actions.triggerAlarm)
     {
-        _alarmState = AlarmState::AlarmTriggered;
+        setAlarmState(AlarmState::AlarmTriggered, _armedZones);
         log_a("ALARM: Sounding alarm!");
         if (!_soundPlayer.playSound(SoundPlayer::Sound::AlarmSouding))
         {
             log_e("Failed to play sound");
         }
+        else if (_eventTrace.active)
+        {
+            uint32_t now = micros();
+            recordFrameStage(FrameStage::SirenStart, now - _eventTrace.stageStartUs);
+            _sirenTrace = { true, _eventTrace.receivedUs, now };
+        }
         log_i("Persisting alarm state as triggered");
-        if (!_flashState.set(AlarmPersistentState::AlarmState::Triggerd))
+        if (!_flashState.set(AlarmPersistentState::AlarmState::Triggerd, _armedZones))
         {
             log_e("Failed to persist alarm state!");
             // Don't fail.
@@ -433,7 +1151,7 @@ void AlarmSystem::handleAlarmPolicyActions(const AlarmPolicy::Actions& actions)
         else
         {
             _soundPlayer.silence();
-            _alarmState = AlarmState::Disarmed;
+            setAlarmState(AlarmState::Disarmed, allZones);
             log_a("FAULT: Alarm disarmed");
         }
     }
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <ESPNowServer.h>
+#include <LatencyHistogram.h>
 #include <MemTracker.h>
+#include <SpscRing.h>
+#include <TimerWheel.h>
 
 #include "ActivityLog.h"
 #include "AlarmOperation.h"
@@ -9,35 +12,196 @@
 #include "AlarmPolicy.h"
 #include "AlarmState.h"
 #include "AlarmWebServer.h"
+#include "PolicyTrace.h"
+#include "SensorAdmission.h"
+#include "SensorCounts.h"
 #include "SensorDb.h"
+#include "SensorDeadlines.h"
+#include "SensorEventCoalescer.h"
+#include "SensorIdSet.h"
+#include "SensorLimits.h"
+#include "SensorLinkStats.h"
+#include "SensorSequenceFilter.h"
 #include "SoundPlayer.h"
 
+#include <atomic>
 #include <vector>
 
 
+// Threading:
+// onDataReceive() runs on the WiFi task and only touches the sensor event
+// queue and the ingest stages in front of it. Everything else (_sensors,
+// _alarmState, the activity log, sound player and persisted state) may only
+// be used with the alarm system lock held. The public methods take the lock
+// themselves, but the objects returned by sensors() and getSensor() are only
+// valid while the caller holds a Lock. Web handlers must not hold a Lock
+// while doing network I/O, so a busy web client can't delay alarm handling.
 class AlarmSystem
 {
 public:
+    class Lock
+    {
+    public:
+        Lock(const AlarmSystem& alarmSystem);
+        ~Lock();
+        Lock(const Lock&) = delete;
+        Lock& operator=(const Lock&) = delete;
+    private:
+        const AlarmSystem& _alarmSystem;
+    };
+    struct IngestStats
+    {
+        uint32_t eventsProcessed;
+        uint32_t eventsDropped;
+        // Also counts events skipped because a later one for the same
+        // sensor came through the priority lane
+        uint32_t eventsMerged;
+        uint32_t queueHighWater;
+        // Frames dropped before the queue, by reason
+        uint32_t framesInvalid;
+        uint32_t framesDuplicate;
+        uint32_t framesOutOfOrder;
+        uint32_t framesStale;
+        // Frames refused by admission control
+        uint32_t framesThrottled;
+        // Events that could trigger the alarm, taken through the priority lane
+        uint32_t priorityEvents;
+        uint32_t priorityQueueHighWater;
+    };
+    struct LoopStats
+    {
+        // Share of time the loop spent waiting for work, in 1/1000. In single
+        // loop mode both loops report the same.
+        uint32_t idlePermille;
+        std::vector<TimerWheel::JobStats> jobs;
+    };
+    struct LatencyStats
+    {
+        const char* name;
+        LatencyHistogram::Snapshot latency;
+    };
     AlarmSystem(const String& apSSID, const String& apPassword, int bclkPin, int wclkPin, int doutPin);
+    ~AlarmSystem();
     bool begin();
-    void onLoop();
+    // Single loop mode: does all alarm system work on the calling task.
+    // Returns how long in ms until there is more work to do.
+    unsigned long onLoop();
+    // Single loop mode: blocks the calling task until a sensor event arrives
+    // or maxWaitMs have passed.
+    void waitForWork(unsigned long maxWaitMs);
+    // Task mode: runs sensor ingest, policy evaluation and the siren on a
+    // pinned high priority task, and the web server, activity log flushing
+    // and memory tracking on a lower priority task. onLoop() must not be
+    // called after this.
+    bool startTasks();
+    // Stops the tasks started by startTasks(). Only meant for tests.
+    void stopTasks();
     AlarmState state() const;
-    std::vector<AlarmOperation> validOperations() const;
+    // Only meaningful while armed
+    ZoneMask armedZones() const;
+    // Valid operations when arming the zones
+    std::vector<AlarmOperation> validOperations(ZoneMask zones = allZones) const;
     const SensorMap& sensors() const;
+    // Like sensors(), only valid while the caller holds a Lock. Sorted by ID.
+    const ZoneList& zones() const;
+    // The zones that are defined, and those of them that can be armed now
+    ZoneMask definedZones() const;
+    ZoneMask readyZones() const;
+    // Change sensors through updateSensor(), not through the returned
+    // pointer, or the sensor counts go stale.
     AlarmSensor* getSensor(uint64_t sensorId);
     const AlarmSensor* getSensor(uint64_t sensorId) const;
-    bool canArm() const;
-    bool arm();
+    // Whether the maintained sensor counts match a full count of the sensors.
+    // Checked on every use in builds with ALARM_DEBUG_CHECKS defined.
+    bool sensorCountsConsistent() const;
+    bool canArm(ZoneMask zones = allZones) const;
+    // Arms only the sensors in the zones. Arming other zones while armed
+    // needs a disarm first.
+    bool arm(ZoneMask zones = allZones);
     void disarm();
-    bool updateSensor(AlarmSensor& sensor);
+    // Changes a sensor's configuration. Its state stays as the alarm system
+    // keeps it. The zones must all be defined.
+    bool updateSensorConfig(uint64_t sensorId, const String& name, bool enabled, ZoneMask zones);
+    // Like updateSensorConfig() with the sensor's name, enabled flag and
+    // zones. The rest of sensor is ignored, it may be an outdated copy.
+    bool updateSensor(const AlarmSensor& sensor);
+    // Adds or renames a zone
+    bool updateZone(const AlarmZone& zone);
+    // Limits how much sensor event processing is done per onLoop() pass.
+    // 0 means no limit. By default the sensor event queue is drained completely.
+    void setSensorEventBudget(size_t maxEventsPerLoop, unsigned long maxTimeMsPerLoop);
+    IngestStats ingestStats() const;
+    // Returns false if the sensor's link is not tracked.
+    bool getSensorLinkStats(uint64_t sensorId, SensorLinkStats::Stats& stats) const;
+    // The periodic jobs of the alarm loop (sensor checks, the siren) and the
+    // service loop (web server, activity log, memory tracking)
+    LoopStats alarmLoopStats() const;
+    LoopStats serviceLoopStats() const;
+    // How long each part of the loops takes per run: sensor event handling,
+    // the sound player, sensor checks, the web server, activity log
+    // flushing and memory tracking
+    std::vector<LatencyStats> latencyStats() const;
+    // How long sensor events take through each stage from the ESP-NOW
+    // receive callback to the siren's first samples going out:
+    // - queued: receive callback to the alarm loop picking the event up
+    // - policy: to the alarm policy's decision
+    // - siren_start: to the siren WAV file starting
+    // - first_buffer: to its first samples going to the I2S output
+    // - frame_to_siren: all of the above
+    // queued and policy are recorded for every event, the rest only for
+    // events that trigger the alarm.
+    std::vector<LatencyStats> frameLatencyStats() const;
+    // The last inputs to the alarm policy and its actions, see PolicyTrace
+    std::vector<uint8_t> policyTrace() const;
 private:
+    enum class Subsystem
+    {
+        SensorEvents,
+        SoundPlayer,
+        SensorChecks,
+        WebServer,
+        ActivityLog,
+        MemTracker,
+        Count
+    };
+    LatencyHistogram& latency(Subsystem subsystem);
+    enum class FrameStage
+    {
+        Queued,
+        Policy,
+        SirenStart,
+        FirstBuffer,
+        FrameToSiren,
+        Count
+    };
+    void recordFrameStage(FrameStage stage, uint32_t us);
+    // Records the stages the siren has got through when its first samples go out.
+    void traceSirenOutput();
+    static void alarmTaskMain(void* param);
+    static void serviceTaskMain(void* param);
+    void addJobs();
+    // Returns how long in us the calling task was blocked
+    uint32_t waitForSensorEvent(unsigned long maxWaitMs);
+    // Both return how long in ms until there is more work to do
+    unsigned long onAlarmLoop();
+    unsigned long onServiceLoop();
+    void onCheckTimer();
+    static LoopStats loopStats(const TimerWheel& jobs);
     void onDataReceive(const uint8_t * mac_addr, const uint8_t *incomingData, int len);
+    void ackSensorFrame(const uint8_t * mac_addr, const SensorFrame& frame);
     void handleSensorEvents();
+    bool sensorEventBudgetExhausted(size_t eventsHandled, unsigned long startTime) const;
     void updateSensorState(uint64_t sensorId, SensorState::State newState);
     // TODO: The nex two methods need to be moved to a policy class:
     void handleSensorState(AlarmSensor& sensor, SensorState::State newState);
     void checkSensors();
+    // Keeps _sensorDeadlines in step with a sensor or the alarm state.
+    void scheduleSensorCheck(const AlarmSensor& sensor);
+    void scheduleSensorChecks();
     void handleAlarmPolicyActions(const AlarmPolicy::Actions& actions);
+    // The alarm state the policy applies to the sensor, given the armed zones
+    AlarmState sensorAlarmState(const AlarmSensor& sensor) const;
+    void setAlarmState(AlarmState state, ZoneMask armedZones);
     void loadAlarmSensorsFromDb();
     void loadPersistedState();
     void initTime();
@@ -48,14 +212,81 @@ private:
     AlarmPersistentState _flashState;
     ActivityLog _log;
     SensorMap _sensors;    // Well slap me! I used and STL container in FW code!
+    // Kept up to date with every change to _sensors, for canArm()
+    SensorCounts _sensorCounts;
+    PolicyTrace _policyTrace;
+    ZoneList _zones;
+    // When each enabled sensor next needs checking, so checkSensors() only
+    // looks at the sensors due.
+    SensorDeadlines _sensorDeadlines;
+    std::vector<uint64_t> _expiredSensors;
     AlarmPolicy _policy;
     AlarmState _alarmState;
+    ZoneMask _armedZones;
     MemTracker _memTracker;
-    unsigned long _lastCheck;
+    // Periodic work, each only run by its own loop
+    TimerWheel _alarmJobs;
+    TimerWheel _serviceJobs;
+    // Each recorded by the loop running the subsystem
+    LatencyHistogram _latency[static_cast<size_t>(Subsystem::Count)];
+    LatencyHistogram _frameLatency[static_cast<size_t>(FrameStage::Count)];
+    // The sensor event being handled, while it is
+    struct FrameTrace
+    {
+        bool active;
+        uint32_t receivedUs;
+        uint32_t stageStartUs;
+    };
+    FrameTrace _eventTrace;
+    // The event that triggered the alarm, until the siren is heard
+    FrameTrace _sirenTrace;
     struct SensorEventMessage
     {
         uint8_t macAddress[6];
         SensorState state;
+        // micros() when the receive callback was called
+        uint32_t receivedUs;
+        // In the order received, across both queues
+        uint32_t sequence;
     };
-    QueueHandle_t _sensorEventQueue;
+    // Producer side. Returns false if the queue is full.
+    bool queueSensorEvent(uint64_t sensorId, const SensorEventMessage& message);
+    bool queuePriorityEvent(uint64_t sensorId, const SensorEventMessage& message);
+    void handleSensorEvent(const SensorEventMessage& message);
+    // Whether a later event for the sensor already came through the priority lane
+    bool supersededByPriorityEvent(const SensorEventMessage& message) const;
+    static const size_t sensorEventQueueLength = 16;
+    // Filled by the ESP-NOW receive callback (WiFi task), drained by onLoop()
+    SpscRing<SensorEventMessage, sensorEventQueueLength> _sensorEventQueue;
+    // While armed, frames that can trigger the alarm skip the heartbeats in
+    // _sensorEventQueue: they go here, which is drained first, regardless of
+    // the sensor event budget. Heartbeats can't fill it, so it only runs out
+    // of room if this many alarm triggering frames are waiting, and those
+    // are not acked, so the sensors retry.
+    SpscRing<SensorEventMessage, sensorEventQueueLength> _priorityEventQueue;
+    // Producer side, orders events across the two queues
+    uint32_t _nextEventSequence;
+    // Alarm loop side: the last event handled from the priority lane, per
+    // sensor, so older events still in _sensorEventQueue are skipped.
+    SensorTable<uint32_t> _priorityEventSequences;
+    uint32_t _priorityEvents;
+    uint32_t _supersededEvents;
+    // What the receive callback needs to know without taking the lock
+    SensorIdSet _sensorIds;
+    // Whether any zone is armed. The callback doesn't know the sensors'
+    // zones, so it prioritizes reports from sensors in unarmed zones too.
+    std::atomic<bool> _armed;
+    SensorAdmission _sensorAdmission;
+    SensorSequenceFilter _sensorSequenceFilter;
+    SensorLinkStats _sensorLinkStats;
+    SensorEventCoalescer _sensorEventCoalescer;
+    std::atomic<uint32_t> _invalidFrames;
+    std::atomic<uint32_t> _droppedBatchEvents;
+    size_t _maxEventsPerLoop;
+    unsigned long _maxEventTimeMsPerLoop;
+    uint32_t _eventsProcessed;
+    SemaphoreHandle_t _lock;
+    std::atomic<TaskHandle_t> _alarmTask;
+    std::atomic<bool> _tasksRunning;
+    std::atomic<int> _activeTasks;
 };
@@ -72,6 +72,38 @@ AlarmOperation operationFromString(const String& str)
     return AlarmOperation::Invalid;
 }
 
+void addLoopStats(JsonObject loopObj, const AlarmSystem::LoopStats& stats)
+{
+    loopObj["idlePermille"] = stats.idlePermille;
+    auto jobsArray = loopObj.createNestedArray("jobs");
+    for (const auto& job : stats.jobs)
+    {
+        auto jobObj = jobsArray.createNestedObject();
+        jobObj["name"] = job.name;
+        jobObj["runs"] = job.runs;
+        jobObj["totalRunUs"] = job.totalRunUs;
+        jobObj["maxRunUs"] = job.maxRunUs;
+    }
+}
+
+void addLatencyStats(JsonObject latencyObj, const std::vector<AlarmSystem::LatencyStats>& stats)
+{
+    for (const auto& entry : stats)
+    {
+        const auto& latency = entry.latency;
+        auto entryObj = latencyObj.createNestedObject(entry.name);
+        entryObj["count"] = latency.count;
+        entryObj["maxUs"] = latency.maxUs;
+        entryObj["p50Us"] = latency.percentileUs(0.5);
+        entryObj["p99Us"] = latency.percentileUs(0.99);
+        auto bucketsArray = entryObj.createNestedArray("buckets");
+        for (auto bucket : latency.buckets)
+        {
+            bucketsArray.add(bucket);
+        }
+    }
+}
+
 }
 
 AlarmSystemWebServer::AlarmSystemWebServer(AlarmSystem& alarmSystem, ActivityLog& activityLog)
@@ -85,13 +117,18 @@ AlarmSystemWebServer::AlarmSystemWebServer(AlarmSystem& alarmSystem, ActivityLog
 void AlarmSystemWebServer::begin()
 {
     _server.on("/alarm_system/state", HTTP_GET, [this]() { handleGetState(); } );
-    // This has to be before the following handler or that handler overrides this one.
+    // These have to be before the following handler or that handler overrides them.
+    _server.on(UriBraces("/alarm_system/sensor/{}/stats"), HTTP_GET, [this]() { handleGetSensorStats(); } );
     _server.on(UriBraces("/alarm_system/sensor/{}"), HTTP_GET, [this]() { handleGetSensor(); } );
     _server.on(UriBraces("/alarm_system/sensor/{}"), HTTP_PUT, [this]() { handleUpdateSensor(); } );
     _server.on("/alarm_system/sensor", HTTP_GET, [this]() { handleGetSensors(); } );
+    _server.on(UriBraces("/alarm_system/zone/{}"), HTTP_PUT, [this]() { handleUpdateZone(); } );
+    _server.on("/alarm_system/zone", HTTP_GET, [this]() { handleGetZones(); } );
     _server.on("/alarm_system/operation", HTTP_GET, [this]() { handleGetValidOperations(); } );
     _server.on("/alarm_system/operation", HTTP_POST, [this]() { handlePostOperation(); } );
     _server.on("/alarm_system/events", HTTP_GET, [this]() { handleGetEvents(); } );
+    _server.on("/alarm_system/metrics", HTTP_GET, [this]() { handleGetMetrics(); } );
+    _server.on("/alarm_system/policy_trace", HTTP_GET, [this]() { handleGetPolicyTrace(); } );
 
     // Handle these seperately, to make them immutable in the cache:
     _server.serveStatic("/axios.min.js", SPIFFS, "/html/axios.min.js", "public, max-age=604800, immutable");
@@ -126,18 +163,24 @@ void AlarmSystemWebServer::handlePostOperation()
         return;
     }
 
+    ZoneMask zones;
+    if (!zonesArg(zones))
+    {
+        return;
+    }
+
     String operationString = _server.arg("operation");
     auto operation = operationFromString(operationString);
     switch (operation)
     {
     case AlarmOperation::Arm:
-        if (!_alarmSystem.canArm())
+        if (!_alarmSystem.canArm(zones))
         {
             _server.send(405, "text/plain", "Alarm system cannot be armed. Sensors opened or faulted");
             return;
         }
 
-        if (!_alarmSystem.arm())
+        if (!_alarmSystem.arm(zones))
         {
             _server.send(500, "text/plain", "Failed to arm alarm system");
             return;
@@ -157,19 +200,23 @@ void AlarmSystemWebServer::handlePostOperation()
 
 void AlarmSystemWebServer::handleGetSensors() const
 {
-    DynamicJsonDocument doc(512);
-    auto arrayObject = doc.to<JsonArray>();
-    if (_alarmSystem.sensors().size() > 0)
+    String output;
     {
-        for (const auto& pair : _alarmSystem.sensors())
+        AlarmSystem::Lock lock(_alarmSystem);
+        DynamicJsonDocument doc(512);
+        auto arrayObject = doc.to<JsonArray>();
+        if (_alarmSystem.sensors().size() > 0)
         {
-            const auto& sensor = pair.second;
-            arrayObject.add(toString(sensor.id));
+            for (const auto& pair : _alarmSystem.sensors())
+            {
+                const auto& sensor = pair.second;
+                arrayObject.add(toString(sensor.id));
+            }
         }
+
+        serializeJson(doc, output);
     }
 
-    String output;
-    serializeJson(doc, output);
     _server.send(200, "application/json", output);
 }
 
@@ -183,21 +230,67 @@ void AlarmSystemWebServer::handleGetSensor() const
         return;
     }
 
-    const auto* sensor = _alarmSystem.getSensor(sensorId);
-    if (sensor == nullptr)
+    String output;
+    {
+        AlarmSystem::Lock lock(_alarmSystem);
+        const auto* sensor = _alarmSystem.getSensor(sensorId);
+        if (sensor != nullptr)
+        {
+            DynamicJsonDocument doc(192);
+            auto sensorObj = doc.to<JsonObject>();
+
+            sensorObj["id"] = toString(sensor->id);
+            sensorObj["state"] = toString(sensor->state);
+            sensorObj["lastUpdate"] = (millis() - sensor->lastUpdate) / 1000;
+            sensorObj["enabled"] = sensor->enabled ? "yes" : "no";
+            sensorObj["name"] = String(sensor->name);
+            sensorObj["zones"] = zonesToString(sensor->zones);
+
+            serializeJson(doc, output);
+        }
+    }
+
+    if (output.isEmpty())
     {
         _server.send(404, "text/plain", "Cannot find sensor " + sensorIdString);
         return;
     }
-    
-    DynamicJsonDocument doc(128);
-    auto sensorObj = doc.to<JsonObject>();
 
-    sensorObj["id"] = toString(sensor->id);
-    sensorObj["state"] = toString(sensor->state);
-    sensorObj["lastUpdate"] = (millis() - sensor->lastUpdate) / 1000;
-    sensorObj["enabled"] = sensor->enabled ? "yes" : "no";
-    sensorObj["name"] = String(sensor->name);
+    _server.send(200, "application/json", output);
+}
+
+void AlarmSystemWebServer::handleGetSensorStats() const
+{
+    auto sensorIdString = _server.pathArg(0);
+    uint64_t sensorId;
+    if (!fromString(sensorIdString, sensorId))
+    {
+        _server.send(400, "text/plain", "Invalid sensor ID: " + sensorIdString);
+        return;
+    }
+
+    SensorLinkStats::Stats stats;
+    if (!_alarmSystem.getSensorLinkStats(sensorId, stats))
+    {
+        _server.send(404, "text/plain", "No link statistics for sensor " + sensorIdString);
+        return;
+    }
+
+    DynamicJsonDocument doc(384);
+    auto statsObj = doc.to<JsonObject>();
+
+    statsObj["id"] = toString(sensorId);
+    statsObj["framesReceived"] = stats.framesReceived;
+    statsObj["framesRepeated"] = stats.framesRepeated;
+    statsObj["framesInvalid"] = stats.framesInvalid;
+    statsObj["framesLost"] = stats.framesLost;
+    auto framesSent = stats.framesReceived - stats.framesRepeated + stats.framesLost;
+    statsObj["lossPercent"] = framesSent > 0 ? 100.0 * stats.framesLost / framesSent : 0.0;
+    statsObj["lastFrame"] = (millis() - stats.lastFrameMs) / 1000;
+    statsObj["meanIntervalMs"] = stats.meanIntervalMs;
+    statsObj["intervalJitterMs"] = stats.intervalJitterMs;
+    statsObj["vcc"] = stats.lastVccMillivolts / 1000.0;
+    statsObj["minVcc"] = stats.minVccMillivolts / 1000.0;
 
     String output;
     serializeJson(doc, output);
@@ -221,12 +314,28 @@ void AlarmSystemWebServer::handleUpdateSensor()
         return;
     }
     
-    auto* sensor = _alarmSystem.getSensor(sensorId);
-    if (sensor == nullptr)
+    // Work on a copy so the lock isn't held while talking to the client. Only
+    // its configuration is handed back, its state may be outdated by then.
+    AlarmSensor sensorCopy;
+    {
+        AlarmSystem::Lock lock(_alarmSystem);
+        const auto* storedSensor = _alarmSystem.getSensor(sensorId);
+        if (storedSensor != nullptr)
+        {
+            sensorCopy = *storedSensor;
+        }
+        else
+        {
+            sensorCopy.id = 0;
+        }
+    }
+
+    if (sensorCopy.id == 0)
     {
         _server.send(404, "text/plain", "Cannot find sensor " + sensorIdString);
         return;
     }
+    auto* sensor = &sensorCopy;
 
     bool changed = false;
     for (auto i = 0; i < _server.args(); ++i)
@@ -237,6 +346,11 @@ void AlarmSystemWebServer::handleUpdateSensor()
         {
             auto name = _server.arg(i);
             log_i("name=%s", name.c_str());
+            if (name.length() > SensorDataBase::maxNameLength)
+            {
+                _server.send(400, "text/plain", "Sensor name is too long");
+                return;
+            }
             if (name != sensor->name)
             {
                 sensor->name = name;
@@ -268,6 +382,23 @@ void AlarmSystemWebServer::handleUpdateSensor()
                 changed = true;
             }
         }
+        else if (argName == "zones")
+        {
+            auto zonesString = _server.arg(i);
+            log_i("zones=%s", zonesString.c_str());
+            ZoneMask zones;
+            if (!zonesFromString(zonesString, zones) || (zones & ~_alarmSystem.definedZones()) != 0)
+            {
+                _server.send(400, "text/plain", "Invalid zones: " + zonesString + " must be a list of defined zone IDs");
+                return;
+            }
+
+            if (sensor->zones != zones)
+            {
+                sensor->zones = zones;
+                changed = true;
+            }
+        }
         else
         {
             _server.send(400, "text/plain", "Unsupported argument: " + argName);
@@ -278,7 +409,7 @@ void AlarmSystemWebServer::handleUpdateSensor()
     if (changed)
     {
         log_i("Updating sensor %016llX", sensor->id);
-        if (!_alarmSystem.updateSensor(*sensor))
+        if (!_alarmSystem.updateSensorConfig(sensor->id, sensor->name, sensor->enabled, sensor->zones))
         {
             _server.send(500, "text/plain", "Error updating sensor");
             return;
@@ -290,17 +421,71 @@ void AlarmSystemWebServer::handleUpdateSensor()
 }
 
 
+void AlarmSystemWebServer::handleGetZones() const
+{
+    String output;
+    bool fits;
+    {
+        AlarmSystem::Lock lock(_alarmSystem);
+        auto armed = _alarmSystem.state() != AlarmState::Disarmed;
+        ZoneMask armedZones = armed ? _alarmSystem.armedZones() : 0;
+        fits = zonesToJson(_alarmSystem.zones(), armedZones, _alarmSystem.readyZones(), output);
+    }
+
+    if (!fits)
+    {
+        _server.send(500, "text/plain", "Not enough memory for the zone list");
+        return;
+    }
+
+    _server.send(200, "application/json", output);
+}
+
+void AlarmSystemWebServer::handleUpdateZone()
+{
+    auto zoneIdString = _server.pathArg(0);
+    // A list of exactly one zone
+    ZoneMask zone;
+    if (!zonesFromString(zoneIdString, zone) || (zone & (zone - 1)) != 0)
+    {
+        _server.send(400, "text/plain", "Invalid zone ID: " + zoneIdString);
+        return;
+    }
+
+    if (!_server.hasArg("name"))
+    {
+        _server.send(400, "text/plain", "No zone name specified");
+        return;
+    }
+    if (_server.arg("name").length() > SensorDataBase::maxNameLength)
+    {
+        _server.send(400, "text/plain", "Zone name is too long");
+        return;
+    }
+
+    if (!_alarmSystem.updateZone({ static_cast<uint8_t>(__builtin_ctz(zone)), _server.arg("name") }))
+    {
+        _server.send(500, "text/plain", "Error updating zone");
+        return;
+    }
+
+    _server.send(200, "text/plain", "OK");
+}
+
 void AlarmSystemWebServer::handleGetValidOperations() const
 {
+    ZoneMask zones;
+    if (!zonesArg(zones))
+    {
+        return;
+    }
+
     DynamicJsonDocument doc(128);
     auto arrayObject = doc.to<JsonArray>();
 
-    if (_alarmSystem.validOperations().size() > 0)
+    for (const auto& operation : _alarmSystem.validOperations(zones))
     {
-        for (const auto& operation : _alarmSystem.validOperations())
-        {
-            arrayObject.add(toString(operation));
-        }
+        arrayObject.add(toString(operation));
     }
 
     String output;
@@ -356,23 +541,73 @@ String AlarmSystemWebServer::sensorDisplayName(uint64_t sensorId) const
     return sensor->name;
 }
 
+bool AlarmSystemWebServer::zonesArg(ZoneMask& zones) const
+{
+    zones = allZones;
+    if (_server.hasArg("zones") && !zonesFromString(_server.arg("zones"), zones))
+    {
+        _server.send(400, "text/plain", "Invalid zones: " + _server.arg("zones"));
+        return false;
+    }
+
+    return true;
+}
+
 void AlarmSystemWebServer::handleGetEvents() const
 {
     String response;
-    for (auto i = 0; i < _activityLog.numberOfEvents(); ++i)
     {
-        unsigned long id;
-        time_t eventTime;
-        ActivityLog::EventType eventType;
-        uint64_t sensorId;
-        if (!_activityLog.getEvent(i, id, eventTime, eventType, sensorId))
+        AlarmSystem::Lock lock(_alarmSystem);
+        for (auto i = 0; i < _activityLog.numberOfEvents(); ++i)
         {
-            log_e("Failed to get event from activity log");
-            continue;
-        }
+            unsigned long id;
+            time_t eventTime;
+            ActivityLog::EventType eventType;
+            uint64_t sensorId;
+            if (!_activityLog.getEvent(i, id, eventTime, eventType, sensorId))
+            {
+                log_e("Failed to get event from activity log");
+                continue;
+            }
 
-        response += String(id) + ":|:" + String(eventTime) + ":|:" + eventTypeToString(eventType, sensorId) + "\n";
+            response += String(id) + ":|:" + String(eventTime) + ":|:" + eventTypeToString(eventType, sensorId) + "\n";
+        }
     }
 
     _server.send(200, "text/plain", response);
-}
\ No newline at end of file
+}
+
+void AlarmSystemWebServer::handleGetMetrics() const
+{
+    // Both read lock free, so this doesn't hold up the alarm loop.
+    auto latencyStats = _alarmSystem.latencyStats();
+    auto frameLatencyStats = _alarmSystem.frameLatencyStats();
+
+    DynamicJsonDocument doc(10240);
+    auto metricsObj = doc.to<JsonObject>();
+
+    addLoopStats(metricsObj.createNestedObject("alarmLoop"), _alarmSystem.alarmLoopStats());
+    addLoopStats(metricsObj.createNestedObject("serviceLoop"), _alarmSystem.serviceLoopStats());
+
+    // The upper bound of each histogram bucket, the last one has none.
+    auto limitsArray = metricsObj.createNestedArray("bucketLimitsUs");
+    for (size_t i = 0; i < LatencyHistogram::bucketCount - 1; ++i)
+    {
+        limitsArray.add(LatencyHistogram::bucketLimitUs(i));
+    }
+
+    addLatencyStats(metricsObj.createNestedObject("latency"), latencyStats);
+    addLatencyStats(metricsObj.createNestedObject("frameLatency"), frameLatencyStats);
+
+    String output;
+    serializeJson(doc, output);
+
+    _server.send(200, "application/json", output);
+}
+
+void AlarmSystemWebServer::handleGetPolicyTrace() const
+{
+    // Copied under the lock, sent without holding it
+    auto trace = _alarmSystem.policyTrace();
+    _server.send_P(200, "application/octet-stream", reinterpret_cast<const char*>(trace.data()), trace.size());
+}
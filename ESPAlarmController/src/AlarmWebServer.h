@@ -4,6 +4,7 @@
 #include <WebServer.h>
 
 #include "ActivityLog.h"
+#include "AlarmZone.h"
 
 
 class AlarmSensor;
@@ -21,11 +22,19 @@ private:
     void handleGetSensors() const;
     void handleGetSensor() const;
     void handleUpdateSensor();
+    void handleGetSensorStats() const;
+    void handleGetZones() const;
+    void handleUpdateZone();
     void handleGetValidOperations() const;
     void handlePostOperation();
     void handleGetEvents() const;
+    void handleGetMetrics() const;
+    void handleGetPolicyTrace() const;
     String eventTypeToString(ActivityLog::EventType eventType, uint64_t sensorId) const;
     String sensorDisplayName(uint64_t sensorId) const;
+    // Reads the optional "zones" argument, all zones if there is none.
+    // Returns false after sending an error response if it is invalid.
+    bool zonesArg(ZoneMask& zones) const;
     AlarmSystem& _alarmSystem;
     ActivityLog& _activityLog;
     mutable WebServer _server;
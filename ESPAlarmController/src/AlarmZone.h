@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+// Zones are named groups of sensors that are armed together, e.g. only the
+// perimeter at night. Each sensor keeps the zones it is in as a bitmask, so
+// whether a set of zones is ready or armed is a couple of word wide bit
+// operations however many sensors there are.
+using ZoneMask = uint32_t;
+
+const size_t maxZones = 32;
+const ZoneMask allZones = 0xFFFFFFFF;
+// New sensors are in the first zone, which always exists
+const ZoneMask defaultZones = 1;
+
+struct AlarmZone
+{
+    uint8_t id;
+    String name;
+};
+
+using ZoneList = std::vector<AlarmZone>;
+
+
+inline ZoneMask zoneBit(size_t zoneId)
+{
+    return static_cast<ZoneMask>(1) << zoneId;
+}
+
+// Zone masks are written as comma separated zone IDs, e.g. "0,3"
+String zonesToString(ZoneMask zones);
+bool zonesFromString(const String& str, ZoneMask& zones);
+// The zones as a JSON array for the web UI, with whether each is armed and
+// ready. Returns false if the document did not fit in memory.
+bool zonesToJson(const ZoneList& zones, ZoneMask armedZones, ZoneMask readyZones, String& output);
@@ -0,0 +1,144 @@
+#include "PolicyTrace.h"
+
+#include <string.h>
+
+
+const size_t PolicyTrace::capacity;
+
+namespace
+{
+
+const uint32_t traceMagic = 0x43525450; // "PTRC"
+const uint16_t traceVersion = 1;
+
+const uint8_t inputMask = 0x01;
+const uint8_t enabledBit = 0x02;
+const unsigned alarmStateShift = 2;
+
+const uint8_t triggerAlarmBit = 0x01;
+const uint8_t cancelArmingBit = 0x02;
+const uint8_t playSoundBit = 0x04;
+
+}
+
+static_assert(sizeof(PolicyTrace::Record) == 24, "PolicyTrace::Record is part of the trace format");
+static_assert(sizeof(PolicyTrace::Header) == 12, "PolicyTrace::Header is part of the trace format");
+
+
+PolicyTrace::Input PolicyTrace::Record::inputType() const
+{
+    return static_cast<Input>(input & inputMask);
+}
+
+AlarmState PolicyTrace::Record::alarmState() const
+{
+    return static_cast<AlarmState>(input >> alarmStateShift);
+}
+
+SensorState::State PolicyTrace::Record::newState() const
+{
+    return static_cast<SensorState::State>(states >> 4);
+}
+
+AlarmSensor PolicyTrace::Record::sensor() const
+{
+    AlarmSensor sensor(sensorId, (input & enabledBit) != 0, "", static_cast<SensorState::State>(states & 0x0F));
+    sensor.lastUpdate = lastUpdate;
+    sensor.faultLastHandled = faultLastHandled;
+    return sensor;
+}
+
+AlarmPolicy::Actions PolicyTrace::Record::policyActions() const
+{
+    AlarmPolicy::Actions policyActions;
+    policyActions.triggerAlarm = (actions & triggerAlarmBit) != 0;
+    policyActions.cancelArming = (actions & cancelArmingBit) != 0;
+    policyActions.playSound = (actions & playSoundBit) != 0;
+    policyActions.sound = static_cast<SoundPlayer::Sound>(sound);
+    return policyActions;
+}
+
+
+PolicyTrace::PolicyTrace()
+    :
+    _next(0),
+    _size(0)
+{
+}
+
+PolicyTrace::Record PolicyTrace::capture(Input input, const AlarmSensor& sensor, SensorState::State newState, AlarmState alarmState, unsigned long now)
+{
+    Record record;
+    record.sensorId = sensor.id;
+    record.timeMs = now;
+    record.lastUpdate = sensor.lastUpdate;
+    record.faultLastHandled = sensor.faultLastHandled;
+    record.input = static_cast<uint8_t>(input) | (sensor.enabled ? enabledBit : 0) | (static_cast<uint8_t>(alarmState) << alarmStateShift);
+    // States off the air may be out of range, keep what fits
+    record.states = (static_cast<uint8_t>(sensor.state) & 0x0F) | ((input == Input::SensorState ? static_cast<uint8_t>(newState) & 0x0F : 0) << 4);
+    record.actions = 0;
+    record.sound = 0;
+    return record;
+}
+
+void PolicyTrace::add(Record record, const AlarmPolicy::Actions& actions)
+{
+    record.actions = (actions.triggerAlarm ? triggerAlarmBit : 0) | (actions.cancelArming ? cancelArmingBit : 0) | (actions.playSound ? playSoundBit : 0);
+    record.sound = static_cast<uint8_t>(actions.sound);
+
+    _records[_next] = record;
+    _next = (_next + 1) % capacity;
+    if (_size < capacity)
+    {
+        _size++;
+    }
+}
+
+size_t PolicyTrace::size() const
+{
+    return _size;
+}
+
+void PolicyTrace::clear()
+{
+    _next = 0;
+    _size = 0;
+}
+
+std::vector<uint8_t> PolicyTrace::serialize() const
+{
+    Header header = { traceMagic, traceVersion, sizeof(Record), static_cast<uint32_t>(_size) };
+    std::vector<uint8_t> data(sizeof(header) + _size * sizeof(Record));
+    memcpy(data.data(), &header, sizeof(header));
+
+    auto* out = data.data() + sizeof(header);
+    size_t first = (_next + capacity - _size) % capacity;
+    for (size_t i = 0; i < _size; ++i)
+    {
+        memcpy(out, &_records[(first + i) % capacity], sizeof(Record));
+        out += sizeof(Record);
+    }
+    return data;
+}
+
+bool PolicyTrace::parse(const uint8_t* data, size_t size, std::vector<Record>& records)
+{
+    Header header;
+    if (size < sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != traceMagic || header.version != traceVersion || header.recordSize != sizeof(Record) ||
+        size != sizeof(header) + static_cast<size_t>(header.recordCount) * sizeof(Record))
+    {
+        return false;
+    }
+
+    records.resize(header.recordCount);
+    if (header.recordCount > 0)
+    {
+        memcpy(records.data(), data + sizeof(header), header.recordCount * sizeof(Record));
+    }
+    return true;
+}
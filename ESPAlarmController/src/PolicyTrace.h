@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "AlarmPolicy.h"
+#include "AlarmSensor.h"
+#include "AlarmState.h"
+#include "protocol.h"
+
+
+// The last inputs AlarmPolicy::handleSensorState() and checkSensor() saw,
+// and the actions they took, so a field incident can be replayed on the
+// host with test/benchmarks/PolicyTrace_replay.
+//
+// A fixed RAM ring of 24 byte records. Recording is O(1) and never
+// allocates; the oldest records are overwritten. Only used with the alarm
+// system lock held.
+//
+// serialize() writes a Header followed by the records, oldest first, in the
+// device's byte order. The ESP32 and x86 hosts are both little endian.
+class PolicyTrace
+{
+public:
+    enum class Input : uint8_t
+    {
+        SensorState,
+        SensorCheck
+    };
+
+    struct Record
+    {
+        uint64_t sensorId;
+        // millis() when the policy ran
+        uint32_t timeMs;
+        uint32_t lastUpdate;
+        uint32_t faultLastHandled;
+        // Input, enabled flag and alarm state
+        uint8_t input;
+        // Old state in the low nibble, new state in the high one
+        uint8_t states;
+        // Action flags
+        uint8_t actions;
+        uint8_t sound;
+
+        Input inputType() const;
+        AlarmState alarmState() const;
+        SensorState::State newState() const;
+        // The sensor as the policy got it
+        AlarmSensor sensor() const;
+        AlarmPolicy::Actions policyActions() const;
+    };
+
+    struct Header
+    {
+        // "PTRC"
+        uint32_t magic;
+        uint16_t version;
+        uint16_t recordSize;
+        uint32_t recordCount;
+    };
+
+    static const size_t capacity = 256;
+
+    PolicyTrace();
+    // Captures the policy's inputs, before it runs and changes the sensor.
+    // newState is ignored for checks.
+    static Record capture(Input input, const AlarmSensor& sensor, SensorState::State newState, AlarmState alarmState, unsigned long now);
+    // Stores the record with the actions the policy took
+    void add(Record record, const AlarmPolicy::Actions& actions);
+    size_t size() const;
+    void clear();
+    std::vector<uint8_t> serialize() const;
+    // Returns false if the data is not a trace this version understands
+    static bool parse(const uint8_t* data, size_t size, std::vector<Record>& records);
+private:
+    Record _records[capacity];
+    size_t _next;
+    size_t _size;
+};
@@ -0,0 +1,109 @@
+#include "SensorAdmission.h"
+
+#include <string.h>
+
+
+const uint32_t SensorAdmission::sensorBurst;
+const uint32_t SensorAdmission::sensorRefillMs;
+const uint32_t SensorAdmission::unknownBurst;
+const uint32_t SensorAdmission::unknownRefillMs;
+const size_t SensorAdmission::maxSensors;
+
+SensorAdmission::SensorAdmission()
+    :
+    _throttledKnown(0),
+    _throttledUnknown(0)
+{
+    memset(_entries, 0, sizeof(_entries));
+    _unknownBucket.creditMs = unknownBurst * unknownRefillMs;
+    _unknownBucket.lastRefillMs = 0;
+}
+
+bool SensorAdmission::admitUnknown(unsigned long now)
+{
+    if (!take(_unknownBucket, unknownBurst, unknownRefillMs, now))
+    {
+        count(_throttledUnknown);
+        return false;
+    }
+    return true;
+}
+
+bool SensorAdmission::admit(uint64_t sensorId, SensorIdSet::Membership membership, const SensorFrame& frame, bool armed, unsigned long now)
+{
+    auto& entry = findOrEvict(sensorId, now);
+    bool alarmFrame = armed && membership == SensorIdSet::Membership::Enabled &&
+                      (frame.state != entry.lastState ||
+                       frame.state == SensorState::Open ||
+                       frame.state == SensorState::Fault ||
+                       frame.edgeCount > 1);
+    // Alarm frames don't draw from the bucket, so a burst of them can't get
+    // the sensor's next frames throttled, e.g. the close after a disarm.
+    if (!alarmFrame && !take(entry.bucket, sensorBurst, sensorRefillMs, now))
+    {
+        count(_throttledKnown);
+        return false;
+    }
+
+    entry.lastState = frame.state;
+    return true;
+}
+
+SensorAdmission::Stats SensorAdmission::stats() const
+{
+    return {
+        _throttledKnown.load(std::memory_order_relaxed),
+        _throttledUnknown.load(std::memory_order_relaxed)
+    };
+}
+
+bool SensorAdmission::take(Bucket& bucket, uint32_t burst, uint32_t refillMs, unsigned long now)
+{
+    uint32_t elapsed = now - bucket.lastRefillMs;
+    bucket.lastRefillMs = now;
+    auto capacity = burst * refillMs;
+    bucket.creditMs = capacity - bucket.creditMs > elapsed ? bucket.creditMs + elapsed : capacity;
+
+    if (bucket.creditMs < refillMs)
+    {
+        return false;
+    }
+
+    bucket.creditMs -= refillMs;
+    return true;
+}
+
+SensorAdmission::Entry& SensorAdmission::findOrEvict(uint64_t sensorId, unsigned long now)
+{
+    Entry* oldest = &_entries[0];
+    for (auto& entry : _entries)
+    {
+        if (entry.sensorId == sensorId)
+        {
+            return entry;
+        }
+
+        if (entry.sensorId == 0)
+        {
+            oldest = &entry;
+            break;
+        }
+
+        if (static_cast<uint32_t>(now - entry.bucket.lastRefillMs) > static_cast<uint32_t>(now - oldest->bucket.lastRefillMs))
+        {
+            oldest = &entry;
+        }
+    }
+
+    oldest->sensorId = sensorId;
+    oldest->bucket.creditMs = sensorBurst * sensorRefillMs;
+    oldest->bucket.lastRefillMs = now;
+    oldest->lastState = SensorState::Unknown;
+    return *oldest;
+}
+
+void SensorAdmission::count(std::atomic<uint32_t>& counter)
+{
+    // Only the producer writes the counters.
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#include "protocol.h"
+#include "SensorIdSet.h"
+
+
+// Token bucket admission control in front of the sensor event queue, so a
+// chatty or malfunctioning transmitter can't fill the queue and starve the
+// other sensors, and spoofed MAC addresses can't force a flash write each
+// by registering as new sensors.
+//
+// Registered sensors get their own bucket from a small fixed table. When
+// the table is full the least recently seen sensor loses its bucket and
+// starts over with a full one. Unlike the other receive tables it is a
+// cache, not sized for maxSensors: losing a bucket only ever lets a sensor
+// through more. Unknown senders all share one slower bucket, the discovery
+// allowance for new sensors, which is checked before the frame is even
+// decoded.
+//
+// While the system is armed, frames from enabled sensors that report a
+// change of state, an open or a fault are always admitted: those are the
+// frames that sound the alarm.
+//
+// Only the producer side (the ESP-NOW receive callback) may call admit()
+// and admitUnknown().
+// The counters may be read from anywhere.
+class SensorAdmission
+{
+public:
+    struct Stats
+    {
+        uint32_t throttledKnown;
+        uint32_t throttledUnknown;
+    };
+
+    SensorAdmission();
+    // For frames from senders not in the SensorIdSet.
+    bool admitUnknown(unsigned long now);
+    // For frames from registered sensors, membership must not be Unknown.
+    bool admit(uint64_t sensorId, SensorIdSet::Membership membership, const SensorFrame& frame, bool armed, unsigned long now);
+    Stats stats() const;
+
+    // A sensor sends a heartbeat every 30 seconds plus its state changes,
+    // so this leaves plenty of room for a door opened and closed repeatedly.
+    static const uint32_t sensorBurst = 8;
+    static const uint32_t sensorRefillMs = 1000;
+    // Every new sensor costs a sensor database write.
+    static const uint32_t unknownBurst = 4;
+    static const uint32_t unknownRefillMs = 5000;
+    static const size_t maxSensors = 32;
+private:
+    struct Bucket
+    {
+        // Credit in ms of refill time. A frame costs one refill interval.
+        uint32_t creditMs;
+        uint32_t lastRefillMs;
+    };
+    struct Entry
+    {
+        uint64_t sensorId;
+        Bucket bucket;
+        SensorState::State lastState;
+    };
+    static bool take(Bucket& bucket, uint32_t burst, uint32_t refillMs, unsigned long now);
+    Entry& findOrEvict(uint64_t sensorId, unsigned long now);
+    void count(std::atomic<uint32_t>& counter);
+    Entry _entries[maxSensors];
+    Bucket _unknownBucket;
+    std::atomic<uint32_t> _throttledKnown;
+    std::atomic<uint32_t> _throttledUnknown;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "AlarmSensor.h"
+#include "AlarmZone.h"
+
+
+// Running totals over the sensors that arming depends on, so
+// AlarmPolicy::canArm() doesn't have to walk every sensor on each call.
+// Counted per zone, and summed up as zone masks: the zones with any enabled
+// sensors, and the zones with any enabled sensors that aren't closed.
+// Whether a set of zones can be armed is then two bit tests.
+//
+// Whoever owns the sensors keeps these up to date: remove() a sensor before
+// changing its enabled flag, state or zones, and add() it back afterwards.
+struct SensorCounts
+{
+    SensorCounts()
+        :
+        populatedZones(0),
+        notReadyZones(0)
+    {
+        memset(zoneEnabled, 0, sizeof(zoneEnabled));
+        memset(zoneNotClosed, 0, sizeof(zoneNotClosed));
+    }
+
+    // Counts the sensors from scratch
+    explicit SensorCounts(const SensorMap& sensors)
+        :
+        SensorCounts()
+    {
+        for (const auto& pair : sensors)
+        {
+            add(pair.second);
+        }
+    }
+
+    void add(const AlarmSensor& sensor)
+    {
+        if (!sensor.enabled)
+        {
+            return;
+        }
+
+        bool notClosed = sensor.state != SensorState::Closed;
+        for (auto zones = sensor.zones; zones != 0; zones &= zones - 1)
+        {
+            auto zoneId = __builtin_ctz(zones);
+            zoneEnabled[zoneId]++;
+            zoneNotClosed[zoneId] += notClosed ? 1 : 0;
+        }
+        populatedZones |= sensor.zones;
+        notReadyZones |= notClosed ? sensor.zones : 0;
+    }
+
+    void remove(const AlarmSensor& sensor)
+    {
+        if (!sensor.enabled)
+        {
+            return;
+        }
+
+        bool notClosed = sensor.state != SensorState::Closed;
+        for (auto zones = sensor.zones; zones != 0; zones &= zones - 1)
+        {
+            auto zoneId = __builtin_ctz(zones);
+            assert(zoneEnabled[zoneId] > 0);
+            if (--zoneEnabled[zoneId] == 0)
+            {
+                populatedZones &= ~zoneBit(zoneId);
+            }
+            if (notClosed && --zoneNotClosed[zoneId] == 0)
+            {
+                notReadyZones &= ~zoneBit(zoneId);
+            }
+        }
+    }
+
+    bool operator==(const SensorCounts& other) const
+    {
+        return populatedZones == other.populatedZones && notReadyZones == other.notReadyZones
+            && memcmp(zoneEnabled, other.zoneEnabled, sizeof(zoneEnabled)) == 0
+            && memcmp(zoneNotClosed, other.zoneNotClosed, sizeof(zoneNotClosed)) == 0;
+    }
+
+    ZoneMask populatedZones;
+    ZoneMask notReadyZones;
+    uint16_t zoneEnabled[maxZones];
+    uint16_t zoneNotClosed[maxZones];
+};
@@ -4,19 +4,132 @@
 #include <AutoFile.h>
 #include <Logging.h>
 #include <SPIFFS.h>
+#include <algorithm>
+#include <string.h>
+
+
+const size_t SensorDataBase::maxNameLength;
+
+
+struct SensorDataBase::Record
+{
+    enum class Type : uint8_t
+    {
+        Sensor = 1,
+        Zone = 2
+    };
+
+    // Sensor ID or zone ID
+    uint64_t id;
+    ZoneMask zones;
+    Type type;
+    uint8_t enabled;
+    // NUL padded
+    char name[maxNameLength + 1];
+    // CRC-16/CCITT-FALSE of the bytes before it
+    uint16_t crc;
+};
 
 
 namespace
 {
 
-const String sensorDbFileName = "/sensors.db";
+const String sensorDbFileName = "/sensors.bin";
+// Compaction writes here, then replaces the database file with it
+const String compactDbFileName = "/sensors.tmp";
+// JSON database from earlier versions
+const String legacyDbFileName = "/sensors.db";
+const char* defaultZoneName = "Default";
+
+struct Header
+{
+    // "SNDB"
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+};
+
+const uint32_t dbMagic = 0x42444E53;
+const uint16_t dbVersion = 1;
+
+// Replaced records allowed in the file on top of one per live record before
+// it is compacted
+const size_t compactionSlack = 32;
+
+using Record = SensorDataBase::Record;
+
+static_assert(sizeof(Record) == 48, "SensorDataBase::Record is part of the file format");
+static_assert(sizeof(Header) == 8, "Header is part of the file format");
+
+uint16_t recordCrc(const Record& record)
+{
+    return SensorFrame::crc16(reinterpret_cast<const uint8_t*>(&record), offsetof(Record, crc));
+}
+
+Record makeRecord(Record::Type type, uint64_t id, const String& name)
+{
+    Record record;
+    memset(&record, 0, sizeof(record));
+    record.type = type;
+    record.id = id;
+    strncpy(record.name, name.c_str(), SensorDataBase::maxNameLength);
+    return record;
+}
+
+Record sensorRecord(const AlarmSensor& sensor)
+{
+    auto record = makeRecord(Record::Type::Sensor, sensor.id, sensor.name);
+    record.enabled = sensor.enabled ? 1 : 0;
+    record.zones = sensor.zones;
+    record.crc = recordCrc(record);
+    return record;
+}
+
+Record zoneRecord(const AlarmZone& zone)
+{
+    auto record = makeRecord(Record::Type::Zone, zone.id, zone.name);
+    record.crc = recordCrc(record);
+    return record;
+}
+
+AlarmSensor recordSensor(const Record& record)
+{
+    AlarmSensor sensor(record.id, record.enabled != 0, record.name, SensorState::Unknown);
+    sensor.zones = record.zones;
+    return sensor;
+}
+
+bool readHeader(fs::File& file)
+{
+    Header header;
+    return file.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) == sizeof(header) &&
+        header.magic == dbMagic && header.version == dbVersion && header.recordSize == sizeof(Record);
+}
+
+bool writeHeader(fs::File& file)
+{
+    Header header = { dbMagic, dbVersion, sizeof(Record) };
+    return file.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header)) == sizeof(header);
+}
+
+bool readRecord(fs::File& file, Record& record)
+{
+    return file.read(reinterpret_cast<uint8_t*>(&record), sizeof(record)) == sizeof(record);
+}
+
+bool writeRecord(fs::File& file, const Record& record)
+{
+    return file.write(reinterpret_cast<const uint8_t*>(&record), sizeof(record)) == sizeof(record);
+}
 
 }
 
 
 SensorDataBase::SensorDataBase()
     :
-    _listLoaded(false)
+    _listLoaded(false),
+    _fileRecords(0),
+    _needsCompaction(false)
 {
 }
 
@@ -28,181 +141,574 @@ bool SensorDataBase::begin()
         return false;
     }
 
-    // Create a DB file if one does not yet exist
-    if (!SPIFFS.exists(sensorDbFileName))
+    // Compaction was interrupted between removing the old file and renaming
+    // the new one
+    if (!SPIFFS.exists(sensorDbFileName) && SPIFFS.exists(compactDbFileName))
+    {
+        log_a("Completing sensor database compaction");
+        SPIFFS.rename(compactDbFileName, sensorDbFileName);
+    }
+
+    if (SPIFFS.exists(sensorDbFileName))
     {
-        log_a("Creating initial sensor datbase file");
-        if (!writeDbFile({}))
+        if (!loadDbFile())
         {
-            log_e("Failed to create initial sensor datbase file");
             return false;
         }
-        _listLoaded = true;
+        if (_needsCompaction && !compact())
+        {
+            log_e("Failed to repair sensor database file");
+        }
+        return true;
     }
-    else
+
+    if (SPIFFS.exists(legacyDbFileName))
     {
-        SensorList sensors;
-        if (!getAlarmSensors(sensors))
+        log_a("Converting JSON sensor database file");
+        if (!loadLegacyDbFile())
         {
+            log_e("Failed to convert JSON sensor database file");
             return false;
         }
+        SPIFFS.remove(legacyDbFileName);
+        return true;
     }
 
+    // Create a DB file if one does not yet exist
+    log_a("Creating initial sensor datbase file");
+    _zones = { { 0, defaultZoneName } };
+    if (!writeDbFile({}))
+    {
+        log_e("Failed to create initial sensor datbase file");
+        return false;
+    }
+    _listLoaded = true;
+
     return true;
 }
 
-bool SensorDataBase::getAlarmSensors(SensorList& sensors) const
+size_t SensorDataBase::sensorCount() const
 {
-    if (!_listLoaded)
+    return _sensorRecords.size();
+}
+
+bool SensorDataBase::forEachSensor(const SensorVisitor& visit) const
+{
+    if (!loadDbFile())
     {
-        auto dbFile = AutoFile(SPIFFS.open(sensorDbFileName, FILE_READ));
-        if (!dbFile)
+        return false;
+    }
+
+    auto dbFile = AutoFile(SPIFFS.open(sensorDbFileName, FILE_READ));
+    if (!dbFile || !readHeader(*dbFile))
+    {
+        log_e("Failed to open sensor database file");
+        return false;
+    }
+
+    // Only up to where the file was found to be valid
+    Record record;
+    for (uint32_t recordNumber = 0; recordNumber < _fileRecords; ++recordNumber)
+    {
+        if (!readRecord(*dbFile, record))
         {
-            log_e("Failed to open sensor database file");
+            log_e("Failed to read sensor database file");
             return false;
         }
 
-        StaticJsonDocument<1024> doc;
-        auto error = deserializeJson(doc, *dbFile);
-        if (error)
+        if (record.type != Record::Type::Sensor)
+        {
+            continue;
+        }
+        auto it = _sensorRecords.find(record.id);
+        if (it != _sensorRecords.end() && it->second == recordNumber)
+        {
+            visit(recordSensor(record));
+        }
+    }
+
+    return true;
+}
+
+bool SensorDataBase::getAlarmSensors(SensorList& sensors) const
+{
+    sensors.clear();
+    sensors.reserve(_sensorRecords.size());
+    if (!forEachSensor([&sensors](AlarmSensor&& sensor) { sensors.push_back(std::move(sensor)); }))
+    {
+        return false;
+    }
+
+    std::sort(sensors.begin(), sensors.end(), [](const AlarmSensor& a, const AlarmSensor& b) { return a.id < b.id; });
+    return true;
+}
+
+bool SensorDataBase::getZones(ZoneList& zones) const
+{
+    if (!loadDbFile())
+    {
+        return false;
+    }
+
+    zones = _zones;
+    return true;
+}
+
+bool SensorDataBase::loadDbFile() const
+{
+    if (_listLoaded)
+    {
+        return true;
+    }
+
+    auto dbFile = AutoFile(SPIFFS.open(sensorDbFileName, FILE_READ));
+    if (!dbFile)
+    {
+        log_e("Failed to open sensor database file");
+        return false;
+    }
+
+    if (!readHeader(*dbFile))
+    {
+        log_e("Sensor database file has an invalid header");
+        return false;
+    }
+
+    _sensorRecords.clear();
+    _zones.clear();
+    _fileRecords = 0;
+    _needsCompaction = false;
+
+    Record record;
+    size_t readSize;
+    while ((readSize = dbFile->read(reinterpret_cast<uint8_t*>(&record), sizeof(record))) == sizeof(record))
+    {
+        if (record.crc != recordCrc(record) || !applyRecord(record, _fileRecords))
+        {
+            // Whatever comes after it can't be trusted either
+            log_e("Sensor database file has an invalid record at %u, ignoring the rest", static_cast<unsigned>(_fileRecords));
+            _needsCompaction = true;
+            break;
+        }
+        _fileRecords++;
+    }
+    if (readSize != 0 && !_needsCompaction)
+    {
+        log_e("Sensor database file ends in a partial record");
+        _needsCompaction = true;
+    }
+
+    if (_zones.empty() || _zones.front().id != 0)
+    {
+        _zones.insert(_zones.begin(), { 0, defaultZoneName });
+    }
+
+    _listLoaded = true;
+    return true;
+}
+
+bool SensorDataBase::applyRecord(const Record& record, uint32_t recordNumber) const
+{
+    if (record.name[maxNameLength] != '\0')
+    {
+        return false;
+    }
+
+    switch (record.type)
+    {
+    case Record::Type::Sensor:
+        if (record.zones == 0)
         {
-            log_e("Failed to parse sensor DB file");
             return false;
         }
+        _sensorRecords[record.id] = recordNumber;
+        return true;
+    case Record::Type::Zone:
+    {
+        if (record.id >= maxZones)
+        {
+            return false;
+        }
+
+        // Kept sorted by ID
+        auto it = _zones.begin();
+        while (it != _zones.end() && it->id < record.id)
+        {
+            ++it;
+        }
+        if (it != _zones.end() && it->id == record.id)
+        {
+            it->name = record.name;
+        }
+        else
+        {
+            _zones.insert(it, { static_cast<uint8_t>(record.id), record.name });
+        }
+        return true;
+    }
+    }
+
+    return false;
+}
+
+bool SensorDataBase::loadLegacyDbFile()
+{
+    auto dbFile = AutoFile(SPIFFS.open(legacyDbFileName, FILE_READ));
+    if (!dbFile)
+    {
+        log_e("Failed to open sensor database file");
+        return false;
+    }
+
+    StaticJsonDocument<1536> doc;
+    auto error = deserializeJson(doc, *dbFile);
+    if (error)
+    {
+        log_e("Failed to parse sensor DB file");
+        return false;
+    }
 
-        // load the list
-        if (!doc.containsKey("sensors"))
+    // load the list
+    if (!doc.containsKey("sensors"))
+    {
+        log_e("Sensor database file has no \"sensors\" key");
+        return false;
+    }
+    SensorList sensors;
+    auto sensorList = doc["sensors"].as<JsonArray>();
+    for (const auto& sensor : sensorList)
+    {
+        if (!sensor.containsKey("id"))
         {
-            log_e("Sensor database file has no \"sensors\" key");
+            log_e("Sensor database file sensor object has no \"id\" key");
             return false;
         }
-        auto sensorList = doc["sensors"].as<JsonArray>();
-        for (const auto& sensor : sensorList)
+        String idString = sensor["id"].as<String>();
+        uint64_t id;
+        if (!fromString(idString, id))
+        {
+            log_e("Failed to parse sensor ID: \"%s\" is not a hexidecimal string", idString.c_str());
+            return false;
+        }
+
+        bool enabled = false;
+        if (sensor.containsKey("enabled"))
         {
-            if (!sensor.containsKey("id"))
+            String enabledString = sensor["enabled"].as<String>();
+            if (enabledString == "true")
             {
-                log_e("Sensor database file sensor object has no \"id\" key");
-                return false;
+                enabled = true;
             }
-            String idString = sensor["id"].as<String>();
-            uint64_t id;
-            if (!fromString(idString, id))
+            else if (enabledString != "false")
             {
-                log_e("Failed to parse sensor ID: \"%s\" is not a hexidecimal string", idString.c_str());
+                log_e("Loaded invalid value for sensor %016llX \"enabled\" field: %s", id, enabledString.c_str());
                 return false;
             }
+        }
 
-            bool enabled = false;
-            if (sensor.containsKey("enabled"))
-            {
-                String enabledString = sensor["enabled"].as<String>();
-                if (enabledString == "true")
-                {
-                    enabled = true;
-                }
-                else if (enabledString != "false")
-                {
-                    log_e("Loaded invalid value for sensor %016llX \"enabled\" field: %s", id, enabledString.c_str());
-                    return false;
-                }
-            }
+        String name;
+        if (sensor.containsKey("name"))
+        {
+            name = sensor["name"].as<String>();
+        }
 
-            String name;
-            if (sensor.containsKey("name"))
+        AlarmSensor alarmSensor(id, enabled, name, SensorState::Unknown);
+        if (sensor.containsKey("zones"))
+        {
+            alarmSensor.zones = sensor["zones"].as<ZoneMask>();
+            if (alarmSensor.zones == 0)
             {
-                name = sensor["name"].as<String>();
+                log_e("Sensor %016llX is in no zones", id);
+                return false;
             }
+        }
 
-            _sensors.push_back(AlarmSensor(id, enabled, name, SensorState::Unknown));
+        sensors.push_back(alarmSensor);
+    }
+
+    // Files written before zones existed have none, which leaves only
+    // the default zone.
+    _zones.clear();
+    auto zoneList = doc["zones"].as<JsonArray>();
+    for (const auto& zone : zoneList)
+    {
+        auto zoneId = zone["id"].as<unsigned>();
+        if (!zone.containsKey("id") || zoneId >= maxZones)
+        {
+            log_e("Sensor database file has an invalid zone ID");
+            return false;
         }
+        _zones.push_back({ static_cast<uint8_t>(zoneId), zone["name"].as<String>() });
+    }
+    if (_zones.empty() || _zones.front().id != 0)
+    {
+        _zones.insert(_zones.begin(), { 0, defaultZoneName });
+    }
 
-        _listLoaded = true;
+    // Names the records have no room for are cut short
+    for (auto& sensor : sensors)
+    {
+        if (sensor.name.length() > maxNameLength)
+        {
+            log_w("Shortening the name of sensor %016llX", sensor.id);
+            sensor.name = sensor.name.substring(0, maxNameLength);
+        }
+    }
+    for (auto& zone : _zones)
+    {
+        if (zone.name.length() > maxNameLength)
+        {
+            log_w("Shortening the name of zone %u", zone.id);
+            zone.name = zone.name.substring(0, maxNameLength);
+        }
+    }
+
+    if (!writeDbFile(sensors))
+    {
+        return false;
     }
 
-    sensors = _sensors;
+    _listLoaded = true;
     return true;
 }
 
 bool SensorDataBase::storeSensor(const AlarmSensor& sensor)
 {
-    _tempSensorList = _sensors;
-    for (const auto& sensorInList : _tempSensorList)
+    if (!loadDbFile())
     {
-        if (sensorInList.id == sensor.id)
-        {
-            // Already stored
-            return true;
-        }
+        return false;
     }
 
-    _tempSensorList.push_back(sensor);
+    if (_sensorRecords.count(sensor.id) != 0)
+    {
+        // Already stored
+        return true;
+    }
 
-    if (!writeDbFile(_tempSensorList))
+    if (sensor.name.length() > maxNameLength)
     {
-        log_e("Failed to write sensor list to file");
+        log_e("Sensor %016llX name is too long", sensor.id);
         return false;
     }
 
-    // Add the sensor to the list once it has been written to the file.
-    _sensors = _tempSensorList;
-    _listLoaded = true;
+    if (!appendRecord(sensorRecord(sensor)))
+    {
+        log_e("Failed to write sensor to file");
+        return false;
+    }
+
+    // Add the sensor once it has been written to the file.
+    _sensorRecords.insert(sensor.id, _fileRecords - 1);
+    compactIfNeeded();
     return true;
 }
 
 bool SensorDataBase::updateSensor(const AlarmSensor& sensor)
 {
     log_a("Upating sensor %016llX", sensor.id);
+    if (!loadDbFile())
+    {
+        return false;
+    }
 
-    _tempSensorList = _sensors;
-    bool found = false;
-    for (auto& sensorInList : _tempSensorList)
+    if (sensor.name.length() > maxNameLength)
     {
-        if (sensorInList.id == sensor.id)
-        {
-            sensorInList = sensor;
-            found = true;
-            break;
-        }
+        log_e("Sensor %016llX name is too long", sensor.id);
+        return false;
     }
-    if (!found)
+
+    if (_sensorRecords.count(sensor.id) == 0)
     {
         return false;
     }
 
-    if (!writeDbFile(_tempSensorList))
+    if (!appendRecord(sensorRecord(sensor)))
     {
-        log_e("Failed to write sensor list to file");
+        log_e("Failed to write sensor to file");
         return false;
     }
 
-    // Add the sensor to the list once it has been written to the file.
-    _sensors = _tempSensorList;
+    // Looked up again, compacting before the append renumbers the records
+    _sensorRecords[sensor.id] = _fileRecords - 1;
+    compactIfNeeded();
     return true;
 }
 
 
-bool SensorDataBase::writeDbFile(const SensorList& sensors)
+bool SensorDataBase::updateZone(const AlarmZone& zone)
+{
+    log_a("Updating zone %u", zone.id);
+    if (zone.id >= maxZones || zone.name.length() > maxNameLength || !loadDbFile())
+    {
+        return false;
+    }
+
+    auto record = zoneRecord(zone);
+    if (!appendRecord(record))
+    {
+        log_e("Failed to write zone to file");
+        return false;
+    }
+
+    applyRecord(record, _fileRecords - 1);
+    compactIfNeeded();
+    return true;
+}
+
+
+bool SensorDataBase::appendRecord(const Record& record)
 {
-    auto dbFile = AutoFile(SPIFFS.open(sensorDbFileName, FILE_WRITE));
+    // Anything appended after a partial record would be lost on loading
+    if (_needsCompaction && !compact())
+    {
+        return false;
+    }
+
+    auto dbFile = AutoFile(SPIFFS.open(sensorDbFileName, FILE_APPEND));
     if (!dbFile)
     {
-        log_e("Failed to create sensor database file");
+        log_e("Failed to open sensor database file");
         return false;
     }
 
-    StaticJsonDocument<512> doc;
-    JsonArray arrayData = doc.createNestedArray("sensors");
-    for (const auto& sensor : sensors)
+    if (!writeRecord(*dbFile, record))
+    {
+        log_e("Failed to append to sensor database file");
+        _needsCompaction = true;
+        return false;
+    }
+
+    _fileRecords++;
+    return true;
+}
+
+void SensorDataBase::compactIfNeeded()
+{
+    auto liveRecords = _sensorRecords.size() + _zones.size();
+    if (_fileRecords > 2 * liveRecords + compactionSlack)
     {
-        auto sensorObj = arrayData.createNestedObject();
+        // The appended records are still there if this fails
+        compact();
+    }
+}
+
+bool SensorDataBase::compact()
+{
+    // Where each sensor's record ends up, in _sensorRecords' order. Only
+    // applied once the new file has replaced the old one.
+    std::vector<uint32_t> newRecords(_sensorRecords.size());
+    uint32_t newRecordCount = 0;
+    {
+        auto oldFile = AutoFile(SPIFFS.open(sensorDbFileName, FILE_READ));
+        if (!oldFile || !readHeader(*oldFile))
+        {
+            log_e("Failed to open sensor database file");
+            _needsCompaction = true;
+            return false;
+        }
+
+        auto newFile = AutoFile(SPIFFS.open(compactDbFileName, FILE_WRITE));
+        if (!newFile)
+        {
+            log_e("Failed to create sensor database file");
+            _needsCompaction = true;
+            return false;
+        }
+
+        bool written = writeHeader(*newFile);
+        for (auto it = _zones.begin(); written && it != _zones.end(); ++it)
+        {
+            written = writeRecord(*newFile, zoneRecord(*it));
+            newRecordCount++;
+        }
 
-        sensorObj["id"] = toString(sensor.id);
-        sensorObj["enabled"] = sensor.enabled ? "true" : "false";
-        sensorObj["name"] = sensor.name;
+        Record record;
+        for (uint32_t recordNumber = 0; written && recordNumber < _fileRecords; ++recordNumber)
+        {
+            written = readRecord(*oldFile, record);
+            if (!written || record.type != Record::Type::Sensor)
+            {
+                continue;
+            }
+            auto it = _sensorRecords.find(record.id);
+            if (it != _sensorRecords.end() && it->second == recordNumber)
+            {
+                written = writeRecord(*newFile, record);
+                newRecords[it - _sensorRecords.begin()] = newRecordCount++;
+            }
+        }
+
+        if (!written)
+        {
+            log_e("Failed to write sensor database file");
+            _needsCompaction = true;
+            return false;
+        }
     }
 
-    // TODO: Check for and handle file write errors.
-    serializeJson(doc, *dbFile);
+    if (!replaceDbFile())
+    {
+        return false;
+    }
+
+    for (auto it = _sensorRecords.begin(); it != _sensorRecords.end(); ++it)
+    {
+        it->second = newRecords[it - _sensorRecords.begin()];
+    }
+    _fileRecords = newRecordCount;
+    return true;
+}
+
+bool SensorDataBase::writeDbFile(const SensorList& sensors)
+{
+    {
+        auto dbFile = AutoFile(SPIFFS.open(compactDbFileName, FILE_WRITE));
+        if (!dbFile)
+        {
+            log_e("Failed to create sensor database file");
+            return false;
+        }
+
+        bool written = writeHeader(*dbFile);
+        for (auto it = _zones.begin(); written && it != _zones.end(); ++it)
+        {
+            written = writeRecord(*dbFile, zoneRecord(*it));
+        }
+        for (auto it = sensors.begin(); written && it != sensors.end(); ++it)
+        {
+            written = writeRecord(*dbFile, sensorRecord(*it));
+        }
+        if (!written)
+        {
+            log_e("Failed to write sensor database file");
+            return false;
+        }
+    }
+
+    if (!replaceDbFile())
+    {
+        return false;
+    }
+
+    _sensorRecords.clear();
+    _fileRecords = _zones.size();
+    for (const auto& sensor : sensors)
+    {
+        _sensorRecords[sensor.id] = _fileRecords++;
+    }
+    return true;
+}
+
+bool SensorDataBase::replaceDbFile()
+{
+    if ((SPIFFS.exists(sensorDbFileName) && !SPIFFS.remove(sensorDbFileName)) ||
+        !SPIFFS.rename(compactDbFileName, sensorDbFileName))
+    {
+        log_e("Failed to replace sensor database file");
+        _needsCompaction = true;
+        return false;
+    }
 
+    _needsCompaction = false;
     return true;
 }
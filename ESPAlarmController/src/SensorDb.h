@@ -1,23 +1,69 @@
 #pragma once
 
 #include <AlarmSensor.h>
+#include <AlarmZone.h>
 
+#include <functional>
 #include <vector>
 
 
 using SensorList = std::vector<AlarmSensor>;
+using SensorVisitor = std::function<void(AlarmSensor&&)>;
 
+// Sensors and zones are stored as fixed size binary records with a CRC. A
+// change appends the one record it touches to the file, later records
+// replacing earlier ones with the same ID. Once the file has grown to well
+// over the number of sensors and zones it is compacted: rewritten with one
+// record each, to a new file that then replaces it.
+//
+// Only the zones and where each sensor's latest record is are kept in
+// memory. Sensors are read from the file when they are asked for.
+//
+// A JSON database from earlier versions is converted on begin().
 class SensorDataBase
 {
 public:
+    // Longer sensor and zone names are rejected
+    static const size_t maxNameLength = 31;
+    // A record of the database file
+    struct Record;
+
     SensorDataBase();
     bool begin();
+    size_t sensorCount() const;
+    // Reads the sensors one record at a time and hands each to visit, to
+    // move wherever it is kept. visit must not change the database.
+    // Returns false if the file could not be read.
+    bool forEachSensor(const SensorVisitor& visit) const;
+    // Sorted by ID
     bool getAlarmSensors(SensorList& sensors) const;
     bool storeSensor(const AlarmSensor& sensor);
     bool updateSensor(const AlarmSensor& sensor);
+    // Zones are stored in the same file as the sensors. There is always a
+    // zone 0, all sensors start out in it.
+    bool getZones(ZoneList& zones) const;
+    // Adds the zone, or renames it if it already exists
+    bool updateZone(const AlarmZone& zone);
 private:
+    bool loadDbFile() const;
+    bool loadLegacyDbFile();
+    // Adds a record read from the file to _sensorRecords or _zones
+    bool applyRecord(const Record& record, uint32_t recordNumber) const;
+    bool appendRecord(const Record& record);
+    void compactIfNeeded();
+    // Rewrites the file with only the latest record of each sensor
+    bool compact();
+    // Writes a new file with the zones and the sensors
     bool writeDbFile(const SensorList& sensors);
+    // Replaces the file with the one compaction wrote
+    bool replaceDbFile();
     mutable bool _listLoaded;
-    mutable SensorList _sensors;
-    mutable SensorList _tempSensorList;
+    // Each sensor's latest record
+    mutable SensorTable<uint32_t> _sensorRecords;
+    mutable ZoneList _zones;
+    // Records in the file, live or replaced
+    mutable size_t _fileRecords;
+    // Set when the file may end in a partial or corrupt record, which would
+    // hide anything appended after it
+    mutable bool _needsCompaction;
 };
@@ -0,0 +1,149 @@
+#include "SensorDeadlines.h"
+
+
+const size_t SensorDeadlines::notQueued;
+
+
+void SensorDeadlines::set(uint64_t sensorId, unsigned long deadline)
+{
+    Entry entry{static_cast<uint32_t>(deadline), sensorId};
+    auto& position = _positions.insert(sensorId, notQueued).first->second;
+    if (position == notQueued)
+    {
+        _heap.push_back(entry);
+        position = _heap.size() - 1;
+        moveUp(_heap.size() - 1);
+        return;
+    }
+
+    bool sooner = earlier(entry, _heap[position]);
+    _heap[position] = entry;
+    if (sooner)
+    {
+        moveUp(position);
+    }
+    else
+    {
+        moveDown(position);
+    }
+}
+
+void SensorDeadlines::remove(uint64_t sensorId)
+{
+    auto it = _positions.find(sensorId);
+    if (it == _positions.end() || it->second == notQueued)
+    {
+        return;
+    }
+
+    removeAt(it->second);
+}
+
+void SensorDeadlines::popExpired(unsigned long now, std::vector<uint64_t>& expired)
+{
+    Entry nowEntry{static_cast<uint32_t>(now), 0};
+    while (!_heap.empty() && !earlier(nowEntry, _heap.front()))
+    {
+        expired.push_back(_heap.front().sensorId);
+        removeAt(0);
+    }
+}
+
+bool SensorDeadlines::nextDeadline(unsigned long& deadline) const
+{
+    if (_heap.empty())
+    {
+        return false;
+    }
+
+    deadline = _heap.front().deadline;
+    return true;
+}
+
+size_t SensorDeadlines::size() const
+{
+    return _heap.size();
+}
+
+void SensorDeadlines::clear()
+{
+    for (const auto& entry : _heap)
+    {
+        _positions.find(entry.sensorId)->second = notQueued;
+    }
+    _heap.clear();
+}
+
+bool SensorDeadlines::earlier(const Entry& a, const Entry& b)
+{
+    return static_cast<int32_t>(a.deadline - b.deadline) < 0;
+}
+
+void SensorDeadlines::moveUp(size_t position)
+{
+    auto entry = _heap[position];
+    while (position > 0)
+    {
+        size_t parent = (position - 1) / 2;
+        if (!earlier(entry, _heap[parent]))
+        {
+            break;
+        }
+        place(position, _heap[parent]);
+        position = parent;
+    }
+    place(position, entry);
+}
+
+void SensorDeadlines::moveDown(size_t position)
+{
+    auto entry = _heap[position];
+    while (true)
+    {
+        size_t child = 2 * position + 1;
+        if (child >= _heap.size())
+        {
+            break;
+        }
+        if (child + 1 < _heap.size() && earlier(_heap[child + 1], _heap[child]))
+        {
+            child++;
+        }
+        if (!earlier(_heap[child], entry))
+        {
+            break;
+        }
+        place(position, _heap[child]);
+        position = child;
+    }
+    place(position, entry);
+}
+
+void SensorDeadlines::place(size_t position, const Entry& entry)
+{
+    _heap[position] = entry;
+    _positions.find(entry.sensorId)->second = position;
+}
+
+void SensorDeadlines::removeAt(size_t position)
+{
+    _positions.find(_heap[position].sensorId)->second = notQueued;
+    auto last = _heap.back();
+    _heap.pop_back();
+    if (position == _heap.size())
+    {
+        return;
+    }
+
+    // Put the last entry in the hole and restore the heap order around it.
+    bool sooner = earlier(last, _heap[position]);
+    place(position, last);
+    if (sooner)
+    {
+        moveUp(position);
+    }
+    else
+    {
+        moveDown(position);
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "SensorTable.h"
+
+
+// The time each sensor next needs checking, e.g. for a missed heartbeat,
+// kept in a binary min-heap with each sensor's position in it indexed by
+// sensor ID. Setting or removing a deadline is O(log n), and finding the
+// sensors due is O(1) plus O(log n) for each one due, so a tick costs the
+// same however many sensors there are.
+//
+// Deadlines are millis() values and may wrap, so they are compared relative
+// to each other. All deadlines must be within 2^31 ms of each other.
+class SensorDeadlines
+{
+public:
+    // Sets the sensor's deadline, moving it if it already has one.
+    void set(uint64_t sensorId, unsigned long deadline);
+    void remove(uint64_t sensorId);
+    // Removes the sensors due at or before now and appends them to expired,
+    // earliest first.
+    void popExpired(unsigned long now, std::vector<uint64_t>& expired);
+    // Returns false if no sensor has a deadline.
+    bool nextDeadline(unsigned long& deadline) const;
+    size_t size() const;
+    void clear();
+private:
+    struct Entry
+    {
+        uint32_t deadline;
+        uint64_t sensorId;
+    };
+    static bool earlier(const Entry& a, const Entry& b);
+    void moveUp(size_t position);
+    void moveDown(size_t position);
+    void place(size_t position, const Entry& entry);
+    void removeAt(size_t position);
+    static const size_t notQueued = ~static_cast<size_t>(0);
+    std::vector<Entry> _heap;
+    // Sensors are never removed from the table, only marked notQueued.
+    SensorTable<size_t> _positions;
+};
@@ -0,0 +1,100 @@
+#include "SensorEventCoalescer.h"
+
+#include <string.h>
+
+
+namespace
+{
+
+size_t hashSensorId(uint64_t sensorId)
+{
+    // Fibonacci hashing. Sensor IDs are MAC addresses, so the low bits alone
+    // are not well distributed between sensors from the same vendor.
+    return static_cast<size_t>((sensorId * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+}
+
+
+SensorEventCoalescer::SensorEventCoalescer()
+    :
+    _mergedEvents(0)
+{
+    memset(_entries, 0, sizeof(_entries));
+}
+
+bool SensorEventCoalescer::merge(uint64_t sensorId, SensorState::State state, uint32_t nextPopSequence, uint32_t nextPushSequence)
+{
+    auto* entry = find(sensorId, false);
+    if (entry == nullptr || !entry->mergeable || entry->state != state)
+    {
+        return false;
+    }
+
+    // Unsigned math handles sequence number wrapping.
+    if (entry->sequence - nextPopSequence >= nextPushSequence - nextPopSequence)
+    {
+        // The last event queued for this sensor has already been handled.
+        return false;
+    }
+
+    _mergedEvents.store(_mergedEvents.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return true;
+}
+
+void SensorEventCoalescer::queued(uint64_t sensorId, SensorState::State state, uint32_t sequence)
+{
+    auto* entry = find(sensorId, true);
+    if (entry == nullptr)
+    {
+        return;
+    }
+
+    entry->state = state;
+    entry->sequence = sequence;
+    entry->mergeable = true;
+}
+
+void SensorEventCoalescer::forget(uint64_t sensorId)
+{
+    // The entry stays in use, removing it would break the probe chains of
+    // the entries after it.
+    auto* entry = find(sensorId, false);
+    if (entry != nullptr)
+    {
+        entry->mergeable = false;
+    }
+}
+
+uint32_t SensorEventCoalescer::mergedEvents() const
+{
+    return _mergedEvents.load(std::memory_order_relaxed);
+}
+
+SensorEventCoalescer::Entry* SensorEventCoalescer::find(uint64_t sensorId, bool insert)
+{
+    auto start = hashSensorId(sensorId);
+    for (size_t i = 0; i < maxSensors; ++i)
+    {
+        auto& entry = _entries[(start + i) % maxSensors];
+        if (!entry.used)
+        {
+            if (!insert)
+            {
+                return nullptr;
+            }
+
+            entry.used = true;
+            entry.sensorId = sensorId;
+            return &entry;
+        }
+
+        if (entry.sensorId == sensorId)
+        {
+            return &entry;
+        }
+    }
+
+    // Table full
+    return nullptr;
+}
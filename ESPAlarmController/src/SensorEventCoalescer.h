@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#include "protocol.h"
+#include "SensorLimits.h"
+
+
+// Collapses redundant sensor reports on their way into the sensor event
+// queue. A report is redundant when an event for the same sensor with the
+// same state is still waiting in the queue: the queued event already carries
+// everything the alarm loop needs from it. State changes are never merged,
+// so Open/Closed/Fault transitions are all delivered in order.
+//
+// Only the producer side (the ESP-NOW receive callback) may call merge() and
+// queued(). mergedEvents() may be called from anywhere.
+class SensorEventCoalescer
+{
+public:
+    SensorEventCoalescer();
+    // Returns true if the report can be dropped because an event for the same
+    // sensor and state is queued at a sequence number in
+    // [nextPopSequence, nextPushSequence).
+    bool merge(uint64_t sensorId, SensorState::State state, uint32_t nextPopSequence, uint32_t nextPushSequence);
+    // Records that an event for the sensor was queued with the given sequence number.
+    void queued(uint64_t sensorId, SensorState::State state, uint32_t sequence);
+    // Stops merging reports from the sensor into the event queued last, for
+    // when one of its events went around the queue. Reports after that one
+    // must be handled after it too.
+    void forget(uint64_t sensorId);
+    uint32_t mergedEvents() const;
+
+    // Sensors past this count are simply not coalesced.
+    static const size_t maxSensors = ::maxSensors;
+private:
+    struct Entry
+    {
+        uint64_t sensorId;
+        uint32_t sequence;
+        SensorState::State state;
+        bool used;
+        // False once forgotten, until the next event is queued.
+        bool mergeable;
+    };
+    Entry* find(uint64_t sensorId, bool insert);
+    Entry _entries[maxSensors];
+    std::atomic<uint32_t> _mergedEvents;
+};
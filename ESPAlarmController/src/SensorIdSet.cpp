@@ -0,0 +1,117 @@
+#include "SensorIdSet.h"
+
+#include <initializer_list>
+
+
+namespace
+{
+
+size_t hashSensorId(uint64_t sensorId)
+{
+    // Same Fibonacci hashing as SensorSequenceFilter
+    return static_cast<size_t>((sensorId * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+uint64_t filterHash(uint64_t sensorId)
+{
+    // Different multiplier from hashSensorId(), so filter false positives
+    // and table collisions don't go together.
+    return sensorId * 0xC2B2AE3D27D4EB4Full;
+}
+
+}
+
+
+SensorIdSet::SensorIdSet()
+    :
+    _size(0)
+{
+    for (auto& entry : _entries)
+    {
+        entry.store(0, std::memory_order_relaxed);
+    }
+    for (auto& word : _filter)
+    {
+        word.store(0, std::memory_order_relaxed);
+    }
+}
+
+bool SensorIdSet::set(uint64_t sensorId, bool enabled)
+{
+    auto value = enabled ? sensorId | enabledBit : sensorId;
+    auto start = hashSensorId(sensorId);
+    for (size_t i = 0; i < maxSensors; ++i)
+    {
+        auto& entry = _entries[(start + i) % maxSensors];
+        auto entryValue = entry.load(std::memory_order_relaxed);
+        if (entryValue == 0)
+        {
+            _size.store(_size.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            addToFilter(sensorId);
+        }
+        else if ((entryValue & ~enabledBit) != sensorId)
+        {
+            continue;
+        }
+
+        entry.store(value, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Set full
+    return false;
+}
+
+SensorIdSet::Membership SensorIdSet::find(uint64_t sensorId) const
+{
+    if (!mayContain(sensorId))
+    {
+        return Membership::Unknown;
+    }
+
+    auto start = hashSensorId(sensorId);
+    for (size_t i = 0; i < maxSensors; ++i)
+    {
+        auto entryValue = _entries[(start + i) % maxSensors].load(std::memory_order_relaxed);
+        if (entryValue == 0)
+        {
+            return Membership::Unknown;
+        }
+
+        if ((entryValue & ~enabledBit) == sensorId)
+        {
+            return (entryValue & enabledBit) != 0 ? Membership::Enabled : Membership::Disabled;
+        }
+    }
+
+    return Membership::Unknown;
+}
+
+size_t SensorIdSet::size() const
+{
+    return _size.load(std::memory_order_relaxed);
+}
+
+void SensorIdSet::addToFilter(uint64_t sensorId)
+{
+    // Only the writer sets bits, and never clears them.
+    auto hash = filterHash(sensorId);
+    for (auto bit : { (hash >> 32) % filterBits, (hash >> 48) % filterBits })
+    {
+        auto& word = _filter[bit / 32];
+        word.store(word.load(std::memory_order_relaxed) | (1u << (bit % 32)), std::memory_order_relaxed);
+    }
+}
+
+bool SensorIdSet::mayContain(uint64_t sensorId) const
+{
+    auto hash = filterHash(sensorId);
+    for (auto bit : { (hash >> 32) % filterBits, (hash >> 48) % filterBits })
+    {
+        if ((_filter[bit / 32].load(std::memory_order_relaxed) & (1u << (bit % 32))) == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
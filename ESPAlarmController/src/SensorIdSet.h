@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "SensorLimits.h"
+
+
+// The registered sensors and whether each is enabled, for the ESP-NOW
+// receive callback, which runs on the WiFi task and can't take the alarm
+// system lock.
+//
+// Updated by the alarm system under its lock whenever a sensor is added or
+// changed, and read lock free from any task. Sensors are never removed.
+// Each entry is a single atomic word, so a reader never sees half an update.
+//
+// Most frames the callback sees come from other devices nearby, so a small
+// Bloom filter in front of the table answers most misses with two bit tests
+// instead of probing it, which gets slow as the table fills up.
+class SensorIdSet
+{
+public:
+    enum class Membership
+    {
+        Unknown,
+        Disabled,
+        Enabled
+    };
+
+    SensorIdSet();
+    // Returns false if the set is full.
+    bool set(uint64_t sensorId, bool enabled);
+    Membership find(uint64_t sensorId) const;
+    size_t size() const;
+
+    static const size_t maxSensors = ::maxSensors;
+private:
+    // Sensor IDs are 48 bit MAC addresses, so the top bit is free for the
+    // enabled flag. 0 marks an unused entry.
+    static const uint64_t enabledBit = 1ull << 63;
+    // 8 bits and 2 hashes per sensor, about 5% false positives when full.
+    static const size_t filterBits = maxSensors * 8;
+    static const size_t filterWords = filterBits / 32;
+    void addToFilter(uint64_t sensorId);
+    bool mayContain(uint64_t sensorId) const;
+    std::atomic<uint64_t> _entries[maxSensors];
+    std::atomic<uint32_t> _filter[filterWords];
+    std::atomic<uint32_t> _size;
+};
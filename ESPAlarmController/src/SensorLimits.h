@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stddef.h>
+
+
+// How many sensors the alarm system can enroll. The tables the ESP-NOW
+// receive callback uses are fixed arrays sized from this, so every enrolled
+// sensor is tracked by all of them. New sensors beyond it are rejected, with
+// an error logged, rather than enrolled and then not heard.
+//
+// Those tables take about 120 bytes of RAM per sensor.
+const size_t maxSensors = 512;
@@ -0,0 +1,204 @@
+#include "SensorLinkStats.h"
+
+#include <string.h>
+
+
+namespace
+{
+
+size_t hashSensorId(uint64_t sensorId)
+{
+    // Same Fibonacci hashing as SensorSequenceFilter
+    return static_cast<size_t>((sensorId * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+}
+
+
+SensorLinkStats::SensorLinkStats()
+{
+    for (auto& entry : _entries)
+    {
+        entry.sensorId.store(0, std::memory_order_relaxed);
+        entry.version.store(0, std::memory_order_relaxed);
+        for (auto& word : entry.published)
+        {
+            word.store(0, std::memory_order_relaxed);
+        }
+        entry.meanIntervalX8 = 0;
+        entry.jitterX16 = 0;
+        entry.lastSequence = 0;
+        entry.hasSequence = false;
+    }
+}
+
+void SensorLinkStats::recordFrame(uint64_t sensorId, const SensorFrame& frame, unsigned long now)
+{
+    auto* entry = findOrAdd(sensorId);
+    if (entry == nullptr)
+    {
+        return;
+    }
+
+    Stats stats;
+    load(*entry, stats);
+    stats.framesReceived++;
+
+    // Version 1 frames have no sequence number, so every frame is new.
+    if (frame.version >= sensorFrameVersion)
+    {
+        if (entry->hasSequence && !frame.sequenceReset)
+        {
+            // Unsigned math handles sequence number wrapping.
+            uint16_t ahead = frame.sequence - entry->lastSequence;
+            if (ahead == 0 || ahead >= 0x8000)
+            {
+                stats.framesRepeated++;
+                publish(*entry, stats);
+                return;
+            }
+            stats.framesLost += ahead - 1;
+        }
+        entry->lastSequence = frame.sequence;
+        entry->hasSequence = true;
+    }
+
+    if (stats.framesReceived - stats.framesRepeated > 1)
+    {
+        // Exponential moving averages in fixed point, like RFC 3550 jitter:
+        // the mean follows 1/8 and the deviation 1/16 of each new interval.
+        uint32_t interval = now - stats.lastFrameMs;
+        if (entry->meanIntervalX8 == 0)
+        {
+            entry->meanIntervalX8 = interval * 8;
+        }
+        else
+        {
+            entry->meanIntervalX8 += interval - entry->meanIntervalX8 / 8;
+        }
+        uint32_t mean = entry->meanIntervalX8 / 8;
+        uint32_t deviation = interval > mean ? interval - mean : mean - interval;
+        entry->jitterX16 += deviation - entry->jitterX16 / 16;
+        stats.meanIntervalMs = mean;
+        stats.intervalJitterMs = entry->jitterX16 / 16;
+    }
+    stats.lastFrameMs = now;
+
+    if (frame.vccMillivolts != 0)
+    {
+        stats.lastVccMillivolts = frame.vccMillivolts;
+        if (stats.minVccMillivolts == 0 || frame.vccMillivolts < stats.minVccMillivolts)
+        {
+            stats.minVccMillivolts = frame.vccMillivolts;
+        }
+    }
+
+    publish(*entry, stats);
+}
+
+void SensorLinkStats::recordInvalidFrame(uint64_t sensorId)
+{
+    auto* entry = const_cast<Entry*>(find(sensorId));
+    if (entry == nullptr)
+    {
+        return;
+    }
+
+    Stats stats;
+    load(*entry, stats);
+    stats.framesInvalid++;
+    publish(*entry, stats);
+}
+
+bool SensorLinkStats::get(uint64_t sensorId, Stats& stats) const
+{
+    const auto* entry = find(sensorId);
+    if (entry == nullptr)
+    {
+        return false;
+    }
+
+    uint32_t words[statsWords];
+    uint32_t version;
+    do
+    {
+        version = entry->version.load(std::memory_order_acquire);
+        for (size_t i = 0; i < statsWords; ++i)
+        {
+            words[i] = entry->published[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((version & 1) != 0 || entry->version.load(std::memory_order_relaxed) != version);
+
+    memcpy(&stats, words, sizeof(stats));
+    return true;
+}
+
+const SensorLinkStats::Entry* SensorLinkStats::find(uint64_t sensorId) const
+{
+    auto start = hashSensorId(sensorId);
+    for (size_t i = 0; i < maxSensors; ++i)
+    {
+        const auto& entry = _entries[(start + i) % maxSensors];
+        auto entryId = entry.sensorId.load(std::memory_order_acquire);
+        if (entryId == sensorId)
+        {
+            return &entry;
+        }
+        if (entryId == 0)
+        {
+            return nullptr;
+        }
+    }
+
+    return nullptr;
+}
+
+SensorLinkStats::Entry* SensorLinkStats::findOrAdd(uint64_t sensorId)
+{
+    auto start = hashSensorId(sensorId);
+    for (size_t i = 0; i < maxSensors; ++i)
+    {
+        auto& entry = _entries[(start + i) % maxSensors];
+        auto entryId = entry.sensorId.load(std::memory_order_relaxed);
+        if (entryId == sensorId)
+        {
+            return &entry;
+        }
+        if (entryId == 0)
+        {
+            // The stats are all zero until published, so readers can see
+            // the entry right away.
+            entry.sensorId.store(sensorId, std::memory_order_release);
+            return &entry;
+        }
+    }
+
+    // Table full
+    return nullptr;
+}
+
+void SensorLinkStats::load(const Entry& entry, Stats& stats)
+{
+    uint32_t words[statsWords];
+    for (size_t i = 0; i < statsWords; ++i)
+    {
+        words[i] = entry.published[i].load(std::memory_order_relaxed);
+    }
+    memcpy(&stats, words, sizeof(stats));
+}
+
+void SensorLinkStats::publish(Entry& entry, const Stats& stats)
+{
+    uint32_t words[statsWords];
+    memcpy(words, &stats, sizeof(words));
+
+    auto version = entry.version.load(std::memory_order_relaxed);
+    entry.version.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < statsWords; ++i)
+    {
+        entry.published[i].store(words[i], std::memory_order_relaxed);
+    }
+    entry.version.store(version + 2, std::memory_order_release);
+}
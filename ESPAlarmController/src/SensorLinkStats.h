@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#include "protocol.h"
+#include "SensorLimits.h"
+
+
+// Per-sensor radio link statistics, updated for every frame received, so
+// weak links and dying batteries show up before the sensor times out.
+//
+// Like SensorSequenceFilter this is a fixed table that never allocates, with
+// room for every enrolled sensor. Recording a frame is O(1).
+//
+// Only the producer side (the ESP-NOW receive callback) may record frames.
+// get() may be called from any task: each entry is published with a
+// sequence lock, so readers never block the receive callback and retry
+// instead if they raced with an update.
+class SensorLinkStats
+{
+public:
+    struct Stats
+    {
+        // Valid frames, including repeats
+        uint32_t framesReceived;
+        // Retries and other frames with a sequence number already seen
+        uint32_t framesRepeated;
+        // Frames from this sensor that failed to decode
+        uint32_t framesInvalid;
+        // Estimated from gaps in the sequence numbers
+        uint32_t framesLost;
+        // millis() when the last valid frame arrived
+        uint32_t lastFrameMs;
+        // Moving average and mean deviation of the time between new frames
+        uint32_t meanIntervalMs;
+        uint32_t intervalJitterMs;
+        uint32_t lastVccMillivolts;
+        uint32_t minVccMillivolts;
+    };
+
+    SensorLinkStats();
+    void recordFrame(uint64_t sensorId, const SensorFrame& frame, unsigned long now);
+    // Only counted for sensors that already sent a valid frame, so noise
+    // can't fill the table.
+    void recordInvalidFrame(uint64_t sensorId);
+    // Returns false if the sensor is not tracked.
+    bool get(uint64_t sensorId, Stats& stats) const;
+
+    static const size_t maxSensors = ::maxSensors;
+private:
+    static const size_t statsWords = sizeof(Stats) / sizeof(uint32_t);
+    struct Entry
+    {
+        // 0 while the entry is unused. Sensor IDs are MAC addresses, never 0.
+        std::atomic<uint64_t> sensorId;
+        // Odd while the writer is updating the published stats
+        std::atomic<uint32_t> version;
+        std::atomic<uint32_t> published[statsWords];
+        // Only touched by the writer
+        uint32_t meanIntervalX8;
+        uint32_t jitterX16;
+        uint16_t lastSequence;
+        bool hasSequence;
+    };
+    const Entry* find(uint64_t sensorId) const;
+    Entry* findOrAdd(uint64_t sensorId);
+    // Writer side. Only the writer changes the stats, so it can read the
+    // published copy without the sequence lock.
+    static void load(const Entry& entry, Stats& stats);
+    static void publish(Entry& entry, const Stats& stats);
+    Entry _entries[maxSensors];
+};
@@ -0,0 +1,122 @@
+#include "SensorSequenceFilter.h"
+
+#include <string.h>
+
+
+namespace
+{
+
+size_t hashSensorId(uint64_t sensorId)
+{
+    // Fibonacci hashing. Sensor IDs are MAC addresses, so the low bits alone
+    // are not well distributed between sensors from the same vendor.
+    return static_cast<size_t>((sensorId * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+}
+
+
+SensorSequenceFilter::SensorSequenceFilter()
+    :
+    _duplicates(0),
+    _outOfOrder(0),
+    _stale(0),
+    _untracked(0)
+{
+    memset(_entries, 0, sizeof(_entries));
+}
+
+SensorSequenceFilter::Result SensorSequenceFilter::accept(uint64_t sensorId, uint16_t sequence, bool sequenceReset)
+{
+    auto* entry = find(sensorId);
+    if (entry == nullptr)
+    {
+        count(_untracked);
+        return Result::Accepted;
+    }
+
+    if (!entry->used || sequenceReset)
+    {
+        entry->used = true;
+        entry->sensorId = sensorId;
+        entry->lastSequence = sequence;
+        entry->seen = 1;
+        return Result::Accepted;
+    }
+
+    // Unsigned math handles sequence number wrapping.
+    uint16_t ahead = sequence - entry->lastSequence;
+    if (ahead != 0 && ahead < 0x8000)
+    {
+        entry->seen = ahead < sequenceWindowSize ? (entry->seen << ahead) | 1 : 1;
+        entry->lastSequence = sequence;
+        return Result::Accepted;
+    }
+
+    uint16_t behind = entry->lastSequence - sequence;
+    if (behind >= sequenceWindowSize)
+    {
+        count(_stale);
+        return Result::Stale;
+    }
+
+    uint32_t bit = 1u << behind;
+    if ((entry->seen & bit) != 0)
+    {
+        count(_duplicates);
+        return Result::Duplicate;
+    }
+
+    entry->seen |= bit;
+    if (behind == 0)
+    {
+        // Retry of a frame that was forgotten
+        return Result::Accepted;
+    }
+
+    count(_outOfOrder);
+    return Result::OutOfOrder;
+}
+
+void SensorSequenceFilter::forget(uint64_t sensorId, uint16_t sequence)
+{
+    auto* entry = find(sensorId);
+    if (entry == nullptr || !entry->used || entry->lastSequence != sequence)
+    {
+        return;
+    }
+
+    entry->seen &= ~1u;
+}
+
+SensorSequenceFilter::Stats SensorSequenceFilter::stats() const
+{
+    return {
+        _duplicates.load(std::memory_order_relaxed),
+        _outOfOrder.load(std::memory_order_relaxed),
+        _stale.load(std::memory_order_relaxed),
+        _untracked.load(std::memory_order_relaxed)
+    };
+}
+
+SensorSequenceFilter::Entry* SensorSequenceFilter::find(uint64_t sensorId)
+{
+    auto start = hashSensorId(sensorId);
+    for (size_t i = 0; i < maxSensors; ++i)
+    {
+        auto& entry = _entries[(start + i) % maxSensors];
+        if (!entry.used || entry.sensorId == sensorId)
+        {
+            return &entry;
+        }
+    }
+
+    // Table full
+    return nullptr;
+}
+
+void SensorSequenceFilter::count(std::atomic<uint32_t>& counter)
+{
+    // Only the producer writes the counters.
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "SensorLimits.h"
+
+
+// Drops duplicate and out-of-order sensor frames before they are queued.
+// Each sensor has a window over its last sequenceWindowSize sequence
+// numbers. A frame is accepted only if its sequence number is newer than
+// anything seen from the sensor. Older frames are dropped: a frame seen
+// before is a duplicate (e.g. an ESP-NOW retransmission), an unseen frame
+// inside the window arrived out of order and carries a stale state, and
+// anything older than the window is treated as a replay.
+//
+// The window table is a fixed array with room for every enrolled sensor, so
+// tracking a new sensor never allocates. Should it still be full, frames
+// from untracked sensors are accepted rather than risk dropping a real alarm.
+//
+// Only the producer side (the ESP-NOW receive callback) may call accept().
+// The counters may be read from anywhere.
+class SensorSequenceFilter
+{
+public:
+    enum class Result
+    {
+        Accepted,
+        Duplicate,
+        OutOfOrder,
+        Stale
+    };
+
+    struct Stats
+    {
+        uint32_t duplicates;
+        uint32_t outOfOrder;
+        uint32_t stale;
+        uint32_t untracked;
+    };
+
+    SensorSequenceFilter();
+    // sequenceReset is set on a sensor's first frame after it lost its
+    // sequence number, which restarts its window.
+    Result accept(uint64_t sensorId, uint16_t sequence, bool sequenceReset);
+    // Undoes accept() for the sensor's latest frame when it could not be
+    // queued, so the sensor's retry of it is accepted instead of dropped.
+    void forget(uint64_t sensorId, uint16_t sequence);
+    Stats stats() const;
+
+    static const size_t maxSensors = ::maxSensors;
+    static const uint16_t sequenceWindowSize = 32;
+private:
+    struct Entry
+    {
+        uint64_t sensorId;
+        // Bit n set means lastSequence - n has been seen.
+        uint32_t seen;
+        uint16_t lastSequence;
+        bool used;
+    };
+    Entry* find(uint64_t sensorId);
+    void count(std::atomic<uint32_t>& counter);
+    Entry _entries[maxSensors];
+    std::atomic<uint32_t> _duplicates;
+    std::atomic<uint32_t> _outOfOrder;
+    std::atomic<uint32_t> _stale;
+    std::atomic<uint32_t> _untracked;
+};
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cassert>
+#include <initializer_list>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+
+// Flat, contiguous replacement for std::map<uint64_t, Value> keyed by sensor
+// ID. Entries are kept sorted by ID in one vector, so iteration order is the
+// same as the map's and a full scan walks contiguous memory. A small open
+// addressing index of entry positions gives O(1) lookups.
+//
+// Sensors are only ever added, never removed. Adding a sensor invalidates
+// iterators, pointers and references into the table.
+template<typename Value>
+class SensorTable
+{
+public:
+    using value_type = std::pair<uint64_t, Value>;
+    using iterator = typename std::vector<value_type>::iterator;
+    using const_iterator = typename std::vector<value_type>::const_iterator;
+
+    SensorTable()
+        :
+        _indexBits(0)
+    {
+    }
+
+    SensorTable(std::initializer_list<value_type> entries)
+        :
+        SensorTable()
+    {
+        for (const auto& entry : entries)
+        {
+            insert(entry.first, entry.second);
+        }
+    }
+
+    iterator begin() { return _entries.begin(); }
+    iterator end() { return _entries.end(); }
+    const_iterator begin() const { return _entries.begin(); }
+    const_iterator end() const { return _entries.end(); }
+
+    size_t size() const
+    {
+        return _entries.size();
+    }
+
+    bool empty() const
+    {
+        return _entries.empty();
+    }
+
+    void reserve(size_t count)
+    {
+        _entries.reserve(count);
+        if (indexSizeFor(count) > _index.size())
+        {
+            rebuildIndex(indexSizeFor(count));
+        }
+    }
+
+    iterator find(uint64_t id)
+    {
+        auto slot = findSlot(id);
+        if (slot == notFound || _index[slot] == emptySlot)
+        {
+            return _entries.end();
+        }
+
+        return _entries.begin() + _index[slot];
+    }
+
+    const_iterator find(uint64_t id) const
+    {
+        return const_cast<SensorTable*>(this)->find(id);
+    }
+
+    size_t count(uint64_t id) const
+    {
+        return find(id) != end() ? 1 : 0;
+    }
+
+    // Like std::map::insert, returns the existing entry if the ID is already
+    // in the table. A value passed as an rvalue is moved in.
+    template<typename V>
+    std::pair<iterator, bool> insert(uint64_t id, V&& value)
+    {
+        auto it = find(id);
+        if (it != _entries.end())
+        {
+            return { it, false };
+        }
+
+        assert(_entries.size() < emptySlot);
+        if (indexSizeFor(_entries.size() + 1) > _index.size())
+        {
+            rebuildIndex(indexSizeFor(_entries.size() + 1));
+        }
+
+        // Keep the entries sorted. New sensors are rare, so shifting the
+        // entries after the new one is fine.
+        size_t position = lowerBound(id);
+        // Appending, as adding sensors in ID order does, moves no entries
+        if (position < _entries.size())
+        {
+            for (auto& slot : _index)
+            {
+                if (slot != emptySlot && slot >= position)
+                {
+                    slot++;
+                }
+            }
+        }
+        _entries.emplace(_entries.begin() + position, id, std::forward<V>(value));
+        _index[findSlot(id)] = static_cast<IndexEntry>(position);
+
+        return { _entries.begin() + position, true };
+    }
+
+    Value& operator[](uint64_t id)
+    {
+        auto it = find(id);
+        if (it != _entries.end())
+        {
+            return it->second;
+        }
+
+        return insert(id, Value()).first->second;
+    }
+
+    void clear()
+    {
+        _entries.clear();
+        _index.clear();
+        _indexBits = 0;
+    }
+
+private:
+    using IndexEntry = uint16_t;
+    static const IndexEntry emptySlot = 0xFFFF;
+    static const size_t notFound = ~static_cast<size_t>(0);
+
+    static size_t indexSizeFor(size_t count)
+    {
+        // Keep the load factor at or below 1/2 so probe sequences stay short.
+        size_t size = 8;
+        while (size < 2 * count)
+        {
+            size *= 2;
+        }
+        return size;
+    }
+
+    size_t hash(uint64_t id) const
+    {
+        // Fibonacci hashing. Sensor IDs are MAC addresses, so the low bits
+        // alone are not well distributed between sensors from the same vendor.
+        return static_cast<size_t>((id * 0x9E3779B97F4A7C15ull) >> (64 - _indexBits));
+    }
+
+    // Returns the slot holding the ID or the empty slot where it belongs.
+    size_t findSlot(uint64_t id) const
+    {
+        if (_index.empty())
+        {
+            return notFound;
+        }
+
+        size_t mask = _index.size() - 1;
+        for (size_t slot = hash(id); ; slot = (slot + 1) & mask)
+        {
+            if (_index[slot] == emptySlot || _entries[_index[slot]].first == id)
+            {
+                return slot;
+            }
+        }
+    }
+
+    size_t lowerBound(uint64_t id) const
+    {
+        size_t low = 0;
+        size_t high = _entries.size();
+        while (low < high)
+        {
+            size_t middle = low + (high - low) / 2;
+            if (_entries[middle].first < id)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        return low;
+    }
+
+    void rebuildIndex(size_t indexSize)
+    {
+        _indexBits = 0;
+        while ((static_cast<size_t>(1) << _indexBits) < indexSize)
+        {
+            _indexBits++;
+        }
+        _index.assign(indexSize, static_cast<IndexEntry>(emptySlot));
+        for (size_t i = 0; i < _entries.size(); ++i)
+        {
+            _index[findSlot(_entries[i].first)] = static_cast<IndexEntry>(i);
+        }
+    }
+
+    std::vector<value_type> _entries;
+    std::vector<IndexEntry> _index;
+    unsigned _indexBits;
+};
@@ -39,7 +39,8 @@ String SoundPlayer::toFileName(Sound sound)
 
 SoundPlayer::SoundPlayer(int bclkPin, int wclkPin, int doutPin)
     :
-    _wavFilePlayer(bclkPin, wclkPin, doutPin)
+    _wavFilePlayer(bclkPin, wclkPin, doutPin),
+    _sound(Sound::Silence)
 {
 }
 
@@ -69,6 +70,7 @@ bool SoundPlayer::playSound(Sound sound)
         return false;
     }
 
+    _sound = sound;
     return _wavFilePlayer.playWavFile(soundFileName);
 }
 
@@ -81,3 +83,14 @@ bool SoundPlayer::soundPlaying() const
 {
     return _wavFilePlayer.filePlaying();
 }
+
+bool SoundPlayer::takeFirstOutput(Sound& sound, uint32_t& outputUs)
+{
+    if (!_wavFilePlayer.takeFirstOutputTime(outputUs))
+    {
+        return false;
+    }
+
+    sound = _sound;
+    return true;
+}
@@ -25,8 +25,12 @@ public:
     bool playSound(Sound sound);
     void silence();
     bool soundPlaying() const;
+    // Returns true once for each sound played, after its first samples were
+    // output, with the sound and the micros() time that happened.
+    bool takeFirstOutput(Sound& sound, uint32_t& outputUs);
 protected:
     static String toFileName(Sound sound);
 private:
     WavFilePlayer _wavFilePlayer;
+    Sound _sound;
 };
\ No newline at end of file
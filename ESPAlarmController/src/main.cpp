@@ -41,6 +41,15 @@ void setup()
         ESP.restart();
     }
 
+#if ALARM_SYSTEM_USE_TASKS
+    if (!alarmSystem.startTasks())
+    {
+        log_e("Failed to start alarm system tasks. Restarting in 5 seconds...");
+        delay(5000);
+        ESP.restart();
+    }
+#endif
+
     // if (!alarmSystem.arm())
     // {
     //     log_e("Failed to arm alarm system");
@@ -49,5 +58,10 @@ void setup()
 
 void loop()
 {
-    alarmSystem.onLoop();
+#if ALARM_SYSTEM_USE_TASKS
+    // All work is done on the alarm system tasks.
+    vTaskDelete(nullptr);
+#else
+    alarmSystem.waitForWork(alarmSystem.onLoop());
+#endif
 }
\ No newline at end of file
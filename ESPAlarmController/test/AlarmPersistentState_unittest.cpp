@@ -50,4 +50,37 @@ SCENARIO( "Test AlarmPersistentState", "" )
             REQUIRE(persistState.get() == AlarmPersistentState::AlarmState::Error);
         }
     }
+
+    WHEN( "only some zones are armed" )
+    {
+        REQUIRE(persistState.set(AlarmPersistentState::AlarmState::Armed, zoneBit(1) | zoneBit(4)));
+
+        persistState = AlarmPersistentState();
+        REQUIRE(persistState.begin());
+
+        THEN( "the armed zones are restored" )
+        {
+            REQUIRE(persistState.get() == AlarmPersistentState::AlarmState::Armed);
+            REQUIRE(persistState.armedZones() == (zoneBit(1) | zoneBit(4)));
+        }
+    }
+
+    WHEN( "the state file was written before zones existed" )
+    {
+        {
+            auto stateFile = SPIFFS.open("/alarm_state.dat", FILE_WRITE);
+            auto state = AlarmPersistentState::AlarmState::Armed;
+            REQUIRE(stateFile.write(reinterpret_cast<const uint8_t*>(&state), sizeof(state)) == sizeof(state));
+            stateFile.close();
+        }
+
+        persistState = AlarmPersistentState();
+        REQUIRE(persistState.begin());
+
+        THEN( "all zones are armed" )
+        {
+            REQUIRE(persistState.get() == AlarmPersistentState::AlarmState::Armed);
+            REQUIRE(persistState.armedZones() == allZones);
+        }
+    }
 }
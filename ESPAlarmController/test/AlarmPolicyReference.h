@@ -0,0 +1,119 @@
+#pragma once
+
+#include <Logging.h>
+
+#include "ActivityLog.h"
+#include "alarm_config.h"
+#include "AlarmPolicy.h"
+#include "AlarmSensor.h"
+#include "AlarmState.h"
+
+#include <vector>
+
+
+// AlarmPolicy::handleSensorState() and checkSensor() as they were written
+// before they became table driven, with the activity log events collected in
+// a vector. Kept to check the tables against, and to benchmark them against.
+namespace AlarmPolicyReference
+{
+
+inline void handleSensorState(AlarmPolicy::Actions& actions, AlarmSensor& sensor, SensorState::State newState, AlarmState alarmState,
+                              std::vector<ActivityLog::EventType>& events)
+{
+    if (!sensor.enabled)
+    {
+        return;
+    }
+
+    if (alarmState == AlarmState::Disarmed)
+    {
+        if (sensor.state != SensorState::Open && newState == SensorState::Open && sensor.lastUpdate > 0)
+        {
+            actions.requestPlaySound(SoundPlayer::Sound::SensorChimeOpened);
+            events.push_back(ActivityLog::EventType::SensorOpened);
+        }
+        else if (sensor.state != SensorState::Closed && newState == SensorState::Closed && sensor.lastUpdate > 0)
+        {
+            actions.requestPlaySound(SoundPlayer::Sound::SensorChimeClosed);
+            events.push_back(ActivityLog::EventType::SensorClosed);
+        }
+        else if (newState == SensorState::Fault)
+        {
+            if (millis() - sensor.faultLastHandled >= SENSOR_FAULT_CHIME_INTERVAL_MS)
+            {
+                actions.requestPlaySound(SoundPlayer::Sound::SensorFault);
+                sensor.faultLastHandled = millis();
+            }
+
+            events.push_back(ActivityLog::EventType::SensorFault);
+        }
+    }
+    else if (alarmState == AlarmState::Armed)
+    {
+        switch (newState)
+        {
+        case SensorState::Fault:
+            log_a("ALARM: sensor %016llX fault! Handling as opened!", sensor.id);
+            // Fall through and sound the alarm
+        case SensorState::Open:
+            log_a("ALARM: sensor %016llX has been opened!", sensor.id);
+            actions.triggerAlarm = true;
+            events.push_back(ActivityLog::EventType::AlarmTriggered);
+        default:
+            break;
+        }
+    }
+}
+
+inline void checkSensor(AlarmPolicy::Actions& actions, AlarmSensor& sensor, AlarmState alarmState,
+                        std::vector<ActivityLog::EventType>& events)
+{
+    if (!sensor.enabled)
+    {
+        return;
+    }
+
+    auto timeSinceLastUpdate = millis() - sensor.lastUpdate;
+    unsigned long timeout = alarmState == AlarmState::Armed ? MAX_SENSOR_UPDATE_TIMEOUT_ARMED_MS : MAX_SENSOR_UPDATE_TIMEOUT_DISARMED_MS;
+    if (timeSinceLastUpdate >= timeout)
+    {
+        log_a("FAULT: Sensor %016llX has not updated in over %lu seconds", sensor.id, timeSinceLastUpdate / 1000);
+
+        switch (alarmState)
+        {
+        case AlarmState::Arming:
+            log_a("FAULT: Alarm currently arming. Cancelling arming");
+            actions.cancelArming = true;
+            events.push_back(ActivityLog::EventType::AlarmArmingFailed);
+            /* Fall through */
+        case AlarmState::Disarmed:
+            if (millis() - sensor.faultLastHandled >= SENSOR_FAULT_CHIME_INTERVAL_MS)
+            {
+                actions.requestPlaySound(SoundPlayer::Sound::SensorFault);
+                sensor.faultLastHandled = millis();
+            }
+            break;
+        case AlarmState::Armed:
+            log_a("ALARM: Sounding alarm on sensor fault");
+            actions.triggerAlarm = true;
+            events.push_back(ActivityLog::EventType::AlarmTriggered);
+            break;
+        case AlarmState::AlarmTriggered:
+            break;
+        }
+    }
+    else
+    {
+        if (sensor.state == SensorState::Fault && alarmState == AlarmState::Disarmed)
+        {
+            log_a("FAULT: Sensor %016llX fault", sensor.id);
+            if (millis() - sensor.faultLastHandled >= SENSOR_FAULT_CHIME_INTERVAL_MS)
+            {
+                actions.requestPlaySound(SoundPlayer::Sound::SensorFault);
+                sensor.faultLastHandled = millis();
+            }
+        }
+    }
+}
+
+}
@@ -4,7 +4,9 @@
 #include "alarm_config.h"
 #include "AlarmPolicy.h"
 #include "AlarmState.h"
+#include "AlarmPolicyReference.h"
 #include "mockControl.h"
+#include "TestActivityLog.h"
 
 #include <algorithm>
 
@@ -627,6 +629,305 @@ SCENARIO( "Test AlarmPolicy::checkSensor", "" )
     }
 }
 
+SCENARIO( "Test AlarmPolicy::nextSensorCheck", "" )
+{
+    ActivityLog log;
+    AlarmPolicy policy(log);
+    const unsigned long start = 10 * MAX_SENSOR_UPDATE_TIMEOUT_DISARMED_MS;
+    setUptimeMillis(start);
+
+    GIVEN( "a sensor that just reported" )
+    {
+        AlarmSensor sensor(1, true, "Front Door", SensorState::Closed);
+        sensor.lastUpdate = start;
+        unsigned long checkTime = 0;
+
+        THEN( "it is next checked when it times out for the alarm state" )
+        {
+            REQUIRE(policy.nextSensorCheck(sensor, AlarmState::Disarmed, checkTime));
+            REQUIRE(checkTime == start + MAX_SENSOR_UPDATE_TIMEOUT_DISARMED_MS);
+            REQUIRE(policy.nextSensorCheck(sensor, AlarmState::Armed, checkTime));
+            REQUIRE(checkTime == start + MAX_SENSOR_UPDATE_TIMEOUT_ARMED_MS);
+        }
+
+        THEN( "a disabled sensor is never checked" )
+        {
+            sensor.enabled = false;
+            REQUIRE_FALSE(policy.nextSensorCheck(sensor, AlarmState::Armed, checkTime));
+        }
+
+        THEN( "a sensor in fault is checked when it is time to chime again" )
+        {
+            sensor.state = SensorState::Fault;
+            sensor.faultLastHandled = start - 1000;
+            REQUIRE(policy.nextSensorCheck(sensor, AlarmState::Disarmed, checkTime));
+            REQUIRE(checkTime == sensor.faultLastHandled + SENSOR_FAULT_CHIME_INTERVAL_MS);
+        }
+
+        THEN( "a timed out sensor is checked right away while armed" )
+        {
+            setUptimeMillis(start + MAX_SENSOR_UPDATE_TIMEOUT_ARMED_MS);
+            REQUIRE(policy.nextSensorCheck(sensor, AlarmState::Armed, checkTime));
+            REQUIRE(checkTime == start + MAX_SENSOR_UPDATE_TIMEOUT_ARMED_MS);
+        }
+
+        THEN( "a timed out sensor is not checked once the alarm is triggered" )
+        {
+            setUptimeMillis(start + MAX_SENSOR_UPDATE_TIMEOUT_DISARMED_MS);
+            REQUIRE_FALSE(policy.nextSensorCheck(sensor, AlarmState::AlarmTriggered, checkTime));
+        }
+    }
+
+    GIVEN( "sensors in every state" )
+    {
+        THEN( "checkSensor() does nothing before the next check time" )
+        {
+            const SensorState::State sensorStates[] = { SensorState::Unknown, SensorState::Closed, SensorState::Open, SensorState::Fault };
+            const AlarmState alarmStates[] = { AlarmState::Disarmed, AlarmState::Arming, AlarmState::Armed, AlarmState::AlarmTriggered };
+            const unsigned long ages[] = { 0, 1000, MAX_SENSOR_UPDATE_TIMEOUT_ARMED_MS - 1, MAX_SENSOR_UPDATE_TIMEOUT_ARMED_MS, MAX_SENSOR_UPDATE_TIMEOUT_DISARMED_MS + 5 };
+            for (auto sensorState : sensorStates)
+            {
+                for (auto alarmState : alarmStates)
+                {
+                    for (auto age : ages)
+                    {
+                        for (auto faultAge : ages)
+                        {
+                            setUptimeMillis(start);
+                            AlarmSensor sensor(1, true, "Front Door", sensorState);
+                            sensor.lastUpdate = start - age;
+                            sensor.faultLastHandled = start - faultAge;
+
+                            unsigned long checkTime = 0;
+                            bool scheduled = policy.nextSensorCheck(sensor, alarmState, checkTime);
+                            auto quietUntil = scheduled ? checkTime : start + 2 * MAX_SENSOR_UPDATE_TIMEOUT_DISARMED_MS;
+                            for (auto now = start; now < quietUntil; now += 250)
+                            {
+                                setUptimeMillis(now);
+                                AlarmPolicy::Actions actions;
+                                policy.checkSensor(actions, sensor, alarmState);
+                                INFO("sensor state " << sensorState << ", alarm state " << static_cast<int>(alarmState) << ", age " << age << ", fault age " << faultAge << ", at " << now - start);
+                                REQUIRE_FALSE(actions.triggerAlarm);
+                                REQUIRE_FALSE(actions.cancelArming);
+                                REQUIRE_FALSE(actions.playSound);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+SCENARIO( "Test AlarmPolicy::canTriggerAlarm", "" )
+{
+    ActivityLog log;
+    AlarmPolicy policy(log);
+
+    GIVEN( "every sensor report in every alarm state" )
+    {
+        THEN( "handleSensorState() only triggers the alarm on reports canTriggerAlarm() picks out" )
+        {
+            const SensorState::State states[] = { SensorState::Unknown, SensorState::Closed, SensorState::Open, SensorState::Fault };
+            const AlarmState alarmStates[] = { AlarmState::Disarmed, AlarmState::Arming, AlarmState::Armed, AlarmState::AlarmTriggered };
+            for (auto enabled : { false, true })
+            {
+                for (auto oldState : states)
+                {
+                    for (auto newState : states)
+                    {
+                        for (auto alarmState : alarmStates)
+                        {
+                            setUptimeMillis(100000);
+                            AlarmSensor sensor(1, enabled, "Front Door", oldState);
+                            sensor.lastUpdate = 1000;
+                            AlarmPolicy::Actions actions;
+                            policy.handleSensorState(actions, sensor, newState, alarmState);
+                            INFO("enabled " << enabled << ", " << oldState << " -> " << newState << ", alarm state " << static_cast<int>(alarmState));
+                            if (actions.triggerAlarm)
+                            {
+                                REQUIRE(AlarmPolicy::canTriggerAlarm(enabled, newState, alarmState != AlarmState::Disarmed));
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        THEN( "heartbeats and disabled sensors are never picked out" )
+        {
+            REQUIRE_FALSE(AlarmPolicy::canTriggerAlarm(true, SensorState::Closed, true));
+            REQUIRE_FALSE(AlarmPolicy::canTriggerAlarm(false, SensorState::Open, true));
+            REQUIRE_FALSE(AlarmPolicy::canTriggerAlarm(true, SensorState::Open, false));
+            REQUIRE(AlarmPolicy::canTriggerAlarm(true, SensorState::Open, true));
+            REQUIRE(AlarmPolicy::canTriggerAlarm(true, SensorState::Fault, true));
+        }
+    }
+}
+
+SCENARIO( "Test AlarmPolicy zones", "" )
+{
+    ActivityLog log;
+    AlarmPolicy policy(log);
+    const ZoneMask perimeter = zoneBit(1);
+    const ZoneMask interior = zoneBit(2);
+
+    GIVEN( "a closed perimeter sensor, an open interior sensor and a disabled open sensor in both" )
+    {
+        AlarmSensor frontDoor(1, true, "Front Door", SensorState::Closed);
+        frontDoor.zones = perimeter;
+        AlarmSensor hallway(2, true, "Hallway", SensorState::Open);
+        hallway.zones = interior;
+        AlarmSensor garage(3, false, "Garage", SensorState::Open);
+        garage.zones = perimeter | interior;
+
+        SensorCounts counts;
+        counts.add(frontDoor);
+        counts.add(hallway);
+        counts.add(garage);
+
+        THEN( "only the perimeter can be armed" )
+        {
+            REQUIRE(policy.canArm(counts, perimeter));
+            REQUIRE_FALSE(policy.canArm(counts, interior));
+            REQUIRE_FALSE(policy.canArm(counts, perimeter | interior));
+            REQUIRE_FALSE(policy.canArm(counts));
+            REQUIRE(policy.validOperations(counts, AlarmState::Disarmed, perimeter) == std::vector<AlarmOperation>{ AlarmOperation::Arm });
+            REQUIRE(policy.validOperations(counts, AlarmState::Disarmed, interior).empty());
+        }
+
+        THEN( "zones without enabled sensors cannot be armed" )
+        {
+            REQUIRE_FALSE(policy.canArm(counts, zoneBit(5)));
+        }
+
+        WHEN( "the interior sensor is closed" )
+        {
+            counts.remove(hallway);
+            hallway.state = SensorState::Closed;
+            counts.add(hallway);
+
+            THEN( "every zone can be armed" )
+            {
+                REQUIRE(policy.canArm(counts, interior));
+                REQUIRE(policy.canArm(counts));
+                REQUIRE(counts == SensorCounts(SensorMap{ { 1, frontDoor }, { 2, hallway }, { 3, garage } }));
+            }
+        }
+
+        WHEN( "the disabled sensor is enabled" )
+        {
+            counts.remove(garage);
+            garage.enabled = true;
+            counts.add(garage);
+
+            THEN( "neither zone can be armed" )
+            {
+                REQUIRE_FALSE(policy.canArm(counts, perimeter));
+                REQUIRE_FALSE(policy.canArm(counts, interior));
+                REQUIRE(counts == SensorCounts(SensorMap{ { 1, frontDoor }, { 2, hallway }, { 3, garage } }));
+            }
+        }
+    }
+
+    GIVEN( "only the perimeter armed" )
+    {
+        THEN( "sensors outside it are handled as if disarmed" )
+        {
+            REQUIRE(AlarmPolicy::sensorAlarmState(AlarmState::Armed, perimeter, perimeter) == AlarmState::Armed);
+            REQUIRE(AlarmPolicy::sensorAlarmState(AlarmState::Armed, perimeter | interior, perimeter) == AlarmState::Armed);
+            REQUIRE(AlarmPolicy::sensorAlarmState(AlarmState::Armed, interior, perimeter) == AlarmState::Disarmed);
+            REQUIRE(AlarmPolicy::sensorAlarmState(AlarmState::Arming, interior, perimeter) == AlarmState::Disarmed);
+        }
+
+        THEN( "a triggered alarm applies to every sensor" )
+        {
+            REQUIRE(AlarmPolicy::sensorAlarmState(AlarmState::AlarmTriggered, interior, perimeter) == AlarmState::AlarmTriggered);
+        }
+    }
+}
+
+SCENARIO( "Test AlarmPolicy rule tables against the original implementation", "" )
+{
+    ActivityLog log;
+    AlarmPolicy policy(log);
+    recordLoggedEvents(true);
+
+    GIVEN( "every combination of sensor, alarm state and timing" )
+    {
+        // Includes a state that is out of range, as a corrupt report would be
+        const SensorState::State states[] = { SensorState::Open, SensorState::Closed, SensorState::Fault, SensorState::Unknown, static_cast<SensorState::State>(7) };
+        const AlarmState alarmStates[] = { AlarmState::Disarmed, AlarmState::Arming, AlarmState::Armed, AlarmState::AlarmTriggered };
+        const unsigned long now = 10 * MAX_SENSOR_UPDATE_TIMEOUT_DISARMED_MS;
+        // now means never
+        const unsigned long updateAges[] = { now, 0, 1, MAX_SENSOR_UPDATE_TIMEOUT_ARMED_MS - 1, MAX_SENSOR_UPDATE_TIMEOUT_ARMED_MS,
+                                             MAX_SENSOR_UPDATE_TIMEOUT_DISARMED_MS - 1, MAX_SENSOR_UPDATE_TIMEOUT_DISARMED_MS };
+        const unsigned long faultAges[] = { now, 0, SENSOR_FAULT_CHIME_INTERVAL_MS - 1, SENSOR_FAULT_CHIME_INTERVAL_MS };
+        setUptimeMillis(now);
+
+        auto requireSameOutcome = [](const AlarmPolicy::Actions& actions, const AlarmSensor& sensor,
+                                     const AlarmPolicy::Actions& expectedActions, const AlarmSensor& expectedSensor,
+                                     const std::vector<ActivityLog::EventType>& expectedEvents)
+        {
+            REQUIRE(actions.triggerAlarm == expectedActions.triggerAlarm);
+            REQUIRE(actions.cancelArming == expectedActions.cancelArming);
+            REQUIRE(actions.playSound == expectedActions.playSound);
+            REQUIRE(actions.sound == expectedActions.sound);
+            REQUIRE(sensor.faultLastHandled == expectedSensor.faultLastHandled);
+            REQUIRE(takeLoggedEvents() == expectedEvents);
+        };
+
+        THEN( "handleSensorState() and checkSensor() act exactly as before" )
+        {
+            for (auto enabled : { false, true })
+            {
+                for (auto alarmState : alarmStates)
+                {
+                    for (auto oldState : states)
+                    {
+                        for (auto updateAge : updateAges)
+                        {
+                            for (auto faultAge : faultAges)
+                            {
+                                AlarmSensor sensor(1, enabled, "Front Door", oldState);
+                                sensor.lastUpdate = now - updateAge;
+                                sensor.faultLastHandled = now - faultAge;
+                                INFO("enabled " << enabled << ", alarm state " << static_cast<int>(alarmState) << ", old state " << oldState
+                                     << ", update age " << updateAge << ", fault age " << faultAge);
+
+                                for (auto newState : states)
+                                {
+                                    INFO("new state " << newState);
+                                    auto expectedSensor = sensor;
+                                    AlarmPolicy::Actions expectedActions;
+                                    std::vector<ActivityLog::EventType> expectedEvents;
+                                    AlarmPolicyReference::handleSensorState(expectedActions, expectedSensor, newState, alarmState, expectedEvents);
+
+                                    auto tableSensor = sensor;
+                                    AlarmPolicy::Actions actions;
+                                    policy.handleSensorState(actions, tableSensor, newState, alarmState);
+                                    requireSameOutcome(actions, tableSensor, expectedActions, expectedSensor, expectedEvents);
+                                }
+
+                                auto expectedSensor = sensor;
+                                AlarmPolicy::Actions expectedActions;
+                                std::vector<ActivityLog::EventType> expectedEvents;
+                                AlarmPolicyReference::checkSensor(expectedActions, expectedSensor, alarmState, expectedEvents);
+
+                                AlarmPolicy::Actions actions;
+                                policy.checkSensor(actions, sensor, alarmState);
+                                requireSameOutcome(actions, sensor, expectedActions, expectedSensor, expectedEvents);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    recordLoggedEvents(false);
+}
+
 /*
         {
             "name": "(gdb) Launch AlarmPolicy_uinttest",
@@ -1,6 +1,8 @@
 #include <catch.hpp>
 
 #include "AlarmSensor.h"
+#include "AlarmZone.h"
+#include "SensorDb.h"
 
 
 SCENARIO( "Test AlarmSensor", "" )
@@ -74,4 +76,74 @@ SCENARIO( "Test toString for sensor ID's", "" )
         uint64_t num = 0x235FC4678DD84DLL;
         REQUIRE(toString(num) == "235fc4678dd84d"); // Will be lower case
     }
-}
\ No newline at end of file
+}
+SCENARIO( "Test zone masks to and from strings", "" )
+{
+    GIVEN( "a zone mask" )
+    {
+        ZoneMask zones = zoneBit(0) | zoneBit(3) | zoneBit(31);
+
+        THEN( "it is written as a list of zone IDs" )
+        {
+            REQUIRE(zonesToString(zones) == "0,3,31");
+        }
+
+        THEN( "it reads back the same" )
+        {
+            ZoneMask readZones;
+            REQUIRE(zonesFromString(zonesToString(zones), readZones));
+            REQUIRE(readZones == zones);
+        }
+    }
+
+    GIVEN( "a single zone" )
+    {
+        ZoneMask zones = 0;
+        REQUIRE(zonesFromString("7", zones));
+        REQUIRE(zones == zoneBit(7));
+    }
+
+    GIVEN( "invalid zone lists" )
+    {
+        const char* invalid[] = { "", ",", "1,", ",1", "1,,2", "32", "100", "a", "1;2", "-1" };
+        for (auto str : invalid)
+        {
+            INFO(str);
+            ZoneMask zones = 5;
+            REQUIRE_FALSE(zonesFromString(str, zones));
+            REQUIRE(zones == 5);
+        }
+    }
+}
+
+SCENARIO( "Test zones to JSON", "" )
+{
+    GIVEN( "all 32 zones with names of the longest length allowed" )
+    {
+        ZoneList zones;
+        for (uint8_t id = 0; id < maxZones; ++id)
+        {
+            String name;
+            while (name.length() < SensorDataBase::maxNameLength)
+            {
+                name += static_cast<char>('A' + id % 26);
+            }
+            zones.push_back({ id, name });
+        }
+
+        String output;
+        REQUIRE(zonesToJson(zones, zoneBit(0) | zoneBit(31), allZones, output));
+
+        THEN( "every zone is in the list" )
+        {
+            size_t count = 0;
+            for (int i = output.indexOf("\"id\""); i >= 0; i = output.indexOf("\"id\"", i + 1))
+            {
+                count++;
+            }
+            REQUIRE(count == maxZones);
+            REQUIRE(output.indexOf(zones.back().name) >= 0);
+            REQUIRE(output.indexOf("{\"id\":31,\"name\":\"" + zones.back().name + "\",\"armed\":\"yes\"") >= 0);
+        }
+    }
+}
@@ -0,0 +1,161 @@
+#include <catch.hpp>
+
+
+#include "AlarmSystem.h"
+
+#include <SPIFFS.h>
+#include <mockControl.h>
+
+#include "protocol.h"
+#include "TestAlarmWebServer.h"
+#include "TestESPNowServer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+
+namespace
+{
+
+const uint8_t sensor1MacAddress[6] = { 0x30, 0xAE, 0xA4, 0x05, 0xCE, 0x1C };
+const uint64_t sensor1Id = 0x30AEA405CE1C;
+
+const auto slowWebRequestTime = std::chrono::milliseconds(50);
+const auto maxTriggerLatency = std::chrono::milliseconds(25);
+// Well below the alarm loop's 1 s periodic check interval
+const auto maxDrainTime = std::chrono::milliseconds(100);
+
+void sendSensorState(SensorState::State sensorState)
+{
+    SensorState state{ESP_SLEEP_WAKEUP_UNDEFINED, sensorState, 3.3};
+    TestESPNowServer::instance().send(sensor1MacAddress, reinterpret_cast<const uint8_t*>(&state), sizeof(state));
+}
+
+}
+
+SCENARIO( "Test AlarmSystem tasks", "[]" )
+{
+    // Build with -DENABLE_TSAN=ON to run this under ThreadSanitizer.
+    GIVEN ( "an alarm system with an enabled sensor running on its tasks" )
+    {
+        REQUIRE(SPIFFS.format());
+        auto alarm = std::make_unique<AlarmSystem>("", "", 0, 0, 0);
+        alarm->begin();
+
+        sendSensorState(SensorState::State::Closed);
+        alarm->onLoop();
+        auto sensor = *alarm->getSensor(sensor1Id);
+        sensor.enabled = true;
+        REQUIRE(alarm->updateSensor(sensor));
+
+        // Simulate a slow web client: each request briefly reads alarm
+        // state and then spends a long time sending the response.
+        std::atomic<uint32_t> webRequests(0);
+        setWebServerLoopHook([&]() {
+            {
+                AlarmSystem::Lock lock(*alarm);
+                alarm->sensors().size();
+            }
+            webRequests++;
+            std::this_thread::sleep_for(slowWebRequestTime);
+        });
+
+        // The tasks' periodic jobs need the clock to move on by itself.
+        setRealTimeMillis(true);
+        REQUIRE(alarm->startTasks());
+
+        WHEN( "the armed sensor is opened repeatedly while the web server is busy" )
+        {
+            std::chrono::steady_clock::duration maxLatency(0);
+            for (auto i = 0; i < 5; ++i)
+            {
+                REQUIRE(alarm->arm());
+                REQUIRE(alarm->state() == AlarmState::Armed);
+
+                // Land the frame at different points of the web request.
+                std::this_thread::sleep_for(std::chrono::milliseconds(7 * i));
+
+                auto sent = std::chrono::steady_clock::now();
+                sendSensorState(SensorState::State::Open);
+                while (alarm->state() != AlarmState::AlarmTriggered)
+                {
+                    REQUIRE(std::chrono::steady_clock::now() - sent < std::chrono::seconds(1));
+                    std::this_thread::yield();
+                }
+                maxLatency = std::max(maxLatency, std::chrono::steady_clock::now() - sent);
+
+                alarm->disarm();
+                sendSensorState(SensorState::State::Closed);
+                while (!alarm->canArm())
+                {
+                    std::this_thread::yield();
+                }
+            }
+
+            THEN( "the alarm triggers without waiting for the web server" )
+            {
+                INFO("Max trigger latency " << std::chrono::duration_cast<std::chrono::microseconds>(maxLatency).count() << " us");
+                REQUIRE(webRequests > 0);
+                REQUIRE(maxLatency < maxTriggerLatency);
+            }
+
+            THEN( "the periodic jobs are reported" )
+            {
+                auto alarmStats = alarm->alarmLoopStats();
+                REQUIRE(alarmStats.jobs.size() == 1);
+                REQUIRE(std::string(alarmStats.jobs[0].name) == "check_sensors");
+                REQUIRE(alarmStats.jobs[0].runs > 0);
+
+                auto serviceStats = alarm->serviceLoopStats();
+                REQUIRE(serviceStats.jobs.size() == 3);
+                REQUIRE(std::string(serviceStats.jobs[0].name) == "web_server");
+                REQUIRE(serviceStats.jobs[0].runs > 0);
+                REQUIRE(serviceStats.jobs[0].maxRunUs >= std::chrono::microseconds(slowWebRequestTime).count());
+            }
+
+            THEN( "the time spent in each subsystem is recorded" )
+            {
+                auto latencyStats = alarm->latencyStats();
+                REQUIRE(latencyStats.size() == 6);
+                REQUIRE(std::string(latencyStats[0].name) == "sensor_events");
+                REQUIRE(latencyStats[0].latency.count > 0);
+                REQUIRE(std::string(latencyStats[3].name) == "web_server");
+                REQUIRE(latencyStats[3].latency.count > 0);
+                REQUIRE(latencyStats[3].latency.maxUs >= std::chrono::microseconds(slowWebRequestTime).count());
+                REQUIRE(latencyStats[3].latency.percentileUs(1.0) == latencyStats[3].latency.maxUs);
+            }
+        }
+
+        WHEN( "more sensor events arrive than the alarm loop handles per pass" )
+        {
+            alarm->setSensorEventBudget(1, 0);
+            const uint32_t events = 6;
+            auto processedBefore = alarm->ingestStats().eventsProcessed;
+            auto sent = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < events; ++i)
+            {
+                sendSensorState(i % 2 == 0 ? SensorState::State::Open : SensorState::State::Closed);
+            }
+            while (alarm->ingestStats().eventsProcessed < processedBefore + events)
+            {
+                REQUIRE(std::chrono::steady_clock::now() - sent < std::chrono::seconds(5));
+                std::this_thread::yield();
+            }
+            auto drainTime = std::chrono::steady_clock::now() - sent;
+
+            THEN( "they are all handled without waiting for the periodic jobs" )
+            {
+                INFO("Drained in " << std::chrono::duration_cast<std::chrono::microseconds>(drainTime).count() << " us");
+                REQUIRE(drainTime < maxDrainTime);
+            }
+        }
+
+        alarm->stopTasks();
+        setRealTimeMillis(false);
+        setWebServerLoopHook(nullptr);
+    }
+}
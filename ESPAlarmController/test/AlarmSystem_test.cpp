@@ -9,7 +9,9 @@
 #include "TestESPNowServer.h"
 #include "TestWavFilePlayer.h"
 
+#include <algorithm>
 #include <memory>
+#include <string.h>
 
 
 const uint8_t sensor1MacAddress[6] = { 0x30, 0xAE, 0xA4, 0x05, 0xCE, 0x1C };
@@ -18,6 +20,36 @@ const uint64_t sensor1Id = 0x30AEA405CE1C;
 const uint8_t sensor2MacAddress[6] = { 0x30, 0xAE, 0xA4, 0x05, 0xCE, 0xAB };
 const uint64_t sensor2Id = 0x30AEA405CEAB;
 
+// From the receive callback to the siren's first samples. The host has no
+// radio, flash or I2S delays, so this catches slow code on the way.
+const uint32_t frameToSirenBudgetUs = 10000;
+
+// AlarmSystem::sensorEventQueueLength
+const size_t sensorEventQueueLength = 16;
+
+
+namespace
+{
+
+// Reports count sensors, starting at firstMacAddress, one admission refill
+// apart, so none of them are throttled as unknown senders. Later bursts from
+// them then only draw from their own buckets.
+void registerSensors(AlarmSystem& alarm, const uint8_t firstMacAddress[6], size_t count)
+{
+    SensorState state{ESP_SLEEP_WAKEUP_UNDEFINED, SensorState::State::Closed, 3.3};
+    uint8_t macAddress[6];
+    memcpy(macAddress, firstMacAddress, sizeof(macAddress));
+    for (size_t i = 0; i < count; ++i)
+    {
+        macAddress[5] = firstMacAddress[5] + i;
+        REQUIRE(TestESPNowServer::instance().send(macAddress, reinterpret_cast<const uint8_t*>(&state), sizeof(state)));
+        alarm.onLoop();
+        delay(SensorAdmission::unknownRefillMs);
+    }
+}
+
+}
+
 
 SCENARIO( "Test AlarmSystem", "[]" )
 {
@@ -294,6 +326,37 @@ SCENARIO( "Test AlarmSystem", "[]" )
                 alarm->onLoop();
             }
 
+            THEN( "the siren is heard within the latency budget" )
+            {
+                auto stages = alarm->frameLatencyStats();
+                REQUIRE(stages.size() == 5);
+                REQUIRE(std::string(stages.back().name) == "frame_to_siren");
+                const auto& frameToSiren = stages.back().latency;
+                REQUIRE(frameToSiren.count == 1);
+                INFO("Frame to siren " << frameToSiren.maxUs << " us");
+                REQUIRE(frameToSiren.maxUs < frameToSirenBudgetUs);
+
+                // The event went through every stage on the way.
+                REQUIRE(stages[0].latency.count >= 1);
+                REQUIRE(stages[1].latency.count >= 1);
+                REQUIRE(stages[2].latency.count == 1);
+                REQUIRE(stages[3].latency.count == 1);
+                REQUIRE(stages[2].latency.maxUs + stages[3].latency.maxUs <= frameToSiren.maxUs);
+            }
+
+            THEN( "the report that triggered the alarm is in the policy trace" )
+            {
+                auto data = alarm->policyTrace();
+                std::vector<PolicyTrace::Record> records;
+                REQUIRE(PolicyTrace::parse(data.data(), data.size(), records));
+                REQUIRE_FALSE(records.empty());
+                const auto& last = records.back();
+                REQUIRE(last.inputType() == PolicyTrace::Input::SensorState);
+                REQUIRE(last.newState() == SensorState::Open);
+                REQUIRE(last.alarmState() == AlarmState::Armed);
+                REQUIRE(last.policyActions().triggerAlarm);
+            }
+
             WHEN( "The alarm system is reset" )
             {
                 alarm.reset();
@@ -336,4 +399,907 @@ SCENARIO( "Test AlarmSystem", "[]" )
             }
         }
    }
-}
\ No newline at end of file
+}
+
+SCENARIO( "Test AlarmSystem sensor counts", "[]" )
+{
+    GIVEN( "an alarm system with two enabled sensors" )
+    {
+        REQUIRE(SPIFFS.format());
+        auto alarm = std::make_unique<AlarmSystem>("", "", 0, 0, 0);
+        alarm->begin();
+
+        auto report = [&](const uint8_t macAddress[6], SensorState::State sensorState) {
+            SensorState state{ESP_SLEEP_WAKEUP_UNDEFINED, sensorState, 3.3};
+            REQUIRE(TestESPNowServer::instance().send(macAddress, reinterpret_cast<const uint8_t*>(&state), sizeof(state)));
+            alarm->onLoop();
+            delay(SensorAdmission::unknownRefillMs);
+        };
+        auto enable = [&](uint64_t sensorId, bool enabled) {
+            auto sensor = *alarm->getSensor(sensorId);
+            sensor.enabled = enabled;
+            REQUIRE(alarm->updateSensor(sensor));
+        };
+
+        report(sensor1MacAddress, SensorState::Closed);
+        report(sensor2MacAddress, SensorState::Closed);
+        enable(sensor1Id, true);
+        enable(sensor2Id, true);
+        REQUIRE(alarm->sensorCountsConsistent());
+        REQUIRE(alarm->canArm());
+
+        WHEN( "one of them is opened" )
+        {
+            report(sensor2MacAddress, SensorState::Open);
+
+            THEN( "the alarm cannot be armed" )
+            {
+                REQUIRE(alarm->sensorCountsConsistent());
+                REQUIRE_FALSE(alarm->canArm());
+                REQUIRE(alarm->validOperations().empty());
+            }
+
+            WHEN( "it is closed again" )
+            {
+                report(sensor2MacAddress, SensorState::Closed);
+
+                THEN( "the alarm can be armed" )
+                {
+                    REQUIRE(alarm->sensorCountsConsistent());
+                    REQUIRE(alarm->canArm());
+                }
+            }
+
+            WHEN( "it is disabled" )
+            {
+                enable(sensor2Id, false);
+
+                THEN( "the alarm can be armed" )
+                {
+                    REQUIRE(alarm->sensorCountsConsistent());
+                    REQUIRE(alarm->canArm());
+                }
+
+                WHEN( "it is enabled while still open" )
+                {
+                    enable(sensor2Id, true);
+
+                    THEN( "the alarm cannot be armed" )
+                    {
+                        REQUIRE(alarm->sensorCountsConsistent());
+                        REQUIRE_FALSE(alarm->canArm());
+                    }
+                }
+            }
+        }
+
+        WHEN( "it is opened while a copy of it is being renamed" )
+        {
+            auto sensor = *alarm->getSensor(sensor2Id);
+            report(sensor2MacAddress, SensorState::Open);
+            sensor.name = "Back Door";
+            REQUIRE(alarm->updateSensor(sensor));
+
+            THEN( "the new name is kept without undoing the open state" )
+            {
+                REQUIRE(alarm->getSensor(sensor2Id)->name == "Back Door");
+                REQUIRE(alarm->getSensor(sensor2Id)->state == SensorState::Open);
+                REQUIRE(alarm->sensorCountsConsistent());
+                REQUIRE_FALSE(alarm->canArm());
+            }
+        }
+
+        WHEN( "both are disabled" )
+        {
+            enable(sensor1Id, false);
+            enable(sensor2Id, false);
+
+            THEN( "the alarm cannot be armed" )
+            {
+                REQUIRE(alarm->sensorCountsConsistent());
+                REQUIRE_FALSE(alarm->canArm());
+            }
+        }
+
+        WHEN( "the alarm system restarts" )
+        {
+            alarm.reset();
+            alarm = std::make_unique<AlarmSystem>("", "", 0, 0, 0);
+            alarm->begin();
+
+            THEN( "the loaded sensors are counted in an unknown state until they report" )
+            {
+                REQUIRE(alarm->sensorCountsConsistent());
+                REQUIRE_FALSE(alarm->canArm());
+
+                report(sensor1MacAddress, SensorState::Closed);
+                report(sensor2MacAddress, SensorState::Closed);
+                REQUIRE(alarm->sensorCountsConsistent());
+                REQUIRE(alarm->canArm());
+            }
+        }
+    }
+}
+
+SCENARIO( "Test AlarmSystem zones", "[]" )
+{
+    GIVEN( "an alarm system with a perimeter and an interior sensor" )
+    {
+        REQUIRE(SPIFFS.format());
+        auto alarm = std::make_unique<AlarmSystem>("", "", 0, 0, 0);
+        alarm->begin();
+        const ZoneMask perimeter = zoneBit(1);
+        const ZoneMask interior = zoneBit(2);
+
+        auto report = [&](const uint8_t macAddress[6], SensorState::State sensorState) {
+            SensorState state{ESP_SLEEP_WAKEUP_UNDEFINED, sensorState, 3.3};
+            REQUIRE(TestESPNowServer::instance().send(macAddress, reinterpret_cast<const uint8_t*>(&state), sizeof(state)));
+            alarm->onLoop();
+            delay(SensorAdmission::unknownRefillMs);
+        };
+        auto setZones = [&](uint64_t sensorId, ZoneMask zones) {
+            auto sensor = *alarm->getSensor(sensorId);
+            sensor.enabled = true;
+            sensor.zones = zones;
+            return alarm->updateSensor(sensor);
+        };
+
+        report(sensor1MacAddress, SensorState::Closed);
+        report(sensor2MacAddress, SensorState::Closed);
+
+        THEN( "sensors cannot be put in zones that are not defined" )
+        {
+            REQUIRE_FALSE(setZones(sensor1Id, perimeter));
+            REQUIRE_FALSE(setZones(sensor1Id, 0));
+        }
+
+        REQUIRE(alarm->updateZone({ 1, "Perimeter" }));
+        REQUIRE(alarm->updateZone({ 2, "Interior" }));
+        REQUIRE(alarm->definedZones() == (zoneBit(0) | perimeter | interior));
+        REQUIRE(setZones(sensor1Id, perimeter));
+        REQUIRE(setZones(sensor2Id, interior));
+
+        WHEN( "the interior sensor is open" )
+        {
+            report(sensor2MacAddress, SensorState::Open);
+
+            THEN( "only the perimeter is ready" )
+            {
+                REQUIRE(alarm->readyZones() == perimeter);
+                REQUIRE_FALSE(alarm->canArm());
+                REQUIRE(alarm->validOperations().empty());
+                REQUIRE(alarm->validOperations(perimeter) == std::vector<AlarmOperation>{ {AlarmOperation::Arm} });
+            }
+
+            WHEN( "the perimeter is armed" )
+            {
+                REQUIRE(alarm->arm(perimeter));
+                REQUIRE(alarm->state() == AlarmState::Armed);
+                REQUIRE(alarm->armedZones() == perimeter);
+
+                THEN( "arming other zones needs a disarm first" )
+                {
+                    REQUIRE_FALSE(alarm->arm());
+                    REQUIRE(alarm->arm(perimeter));
+                }
+
+                THEN( "the interior sensor does not trigger the alarm" )
+                {
+                    report(sensor2MacAddress, SensorState::Closed);
+                    report(sensor2MacAddress, SensorState::Open);
+                    REQUIRE(alarm->state() == AlarmState::Armed);
+                }
+
+                WHEN( "the perimeter sensor is opened" )
+                {
+                    report(sensor1MacAddress, SensorState::Open);
+
+                    THEN( "it triggers the alarm in the armed zones only" )
+                    {
+                        REQUIRE(alarm->state() == AlarmState::AlarmTriggered);
+                        REQUIRE(alarm->armedZones() == perimeter);
+                    }
+
+                    THEN( "the armed zones are still the same after a restart" )
+                    {
+                        alarm.reset();
+                        alarm = std::make_unique<AlarmSystem>("", "", 0, 0, 0);
+                        alarm->begin();
+                        REQUIRE(alarm->state() == AlarmState::AlarmTriggered);
+                        REQUIRE(alarm->armedZones() == perimeter);
+                    }
+                }
+
+                WHEN( "the alarm system restarts" )
+                {
+                    alarm.reset();
+                    alarm = std::make_unique<AlarmSystem>("", "", 0, 0, 0);
+                    alarm->begin();
+
+                    THEN( "only the perimeter is still armed" )
+                    {
+                        REQUIRE(alarm->state() == AlarmState::Armed);
+                        REQUIRE(alarm->armedZones() == perimeter);
+                        REQUIRE(alarm->getSensor(sensor1Id)->zones == perimeter);
+                        REQUIRE(alarm->zones().size() == 3);
+                        REQUIRE(alarm->zones()[1].name == "Perimeter");
+                    }
+                }
+            }
+        }
+    }
+}
+
+SCENARIO( "Test AlarmSystem sensor limit", "[]" )
+{
+    GIVEN( "an alarm system with as many sensors as it can track" )
+    {
+        REQUIRE(SPIFFS.format());
+        auto alarm = std::make_unique<AlarmSystem>("", "", 0, 0, 0);
+        alarm->begin();
+
+        SensorState state{ESP_SLEEP_WAKEUP_UNDEFINED, SensorState::State::Closed, 3.3};
+        uint8_t macAddress[6] = { 0x30, 0xAE, 0xA4, 0x00, 0x00, 0x00 };
+        auto report = [&](size_t sensor) {
+            macAddress[4] = static_cast<uint8_t>(sensor >> 8);
+            macAddress[5] = static_cast<uint8_t>(sensor);
+            REQUIRE(TestESPNowServer::instance().send(macAddress, reinterpret_cast<const uint8_t*>(&state), sizeof(state)));
+            alarm->onLoop();
+            delay(SensorAdmission::unknownRefillMs);
+        };
+        for (size_t i = 0; i < maxSensors; ++i)
+        {
+            report(i);
+        }
+        REQUIRE(alarm->sensors().size() == maxSensors);
+
+        WHEN( "another sensor reports" )
+        {
+            report(maxSensors);
+
+            THEN( "it is not added" )
+            {
+                REQUIRE(alarm->sensors().size() == maxSensors);
+                REQUIRE(alarm->getSensor(0x30AEA4000000ull + maxSensors) == nullptr);
+            }
+        }
+
+        WHEN( "the alarm system restarts" )
+        {
+            alarm.reset();
+            alarm = std::make_unique<AlarmSystem>("", "", 0, 0, 0);
+            alarm->begin();
+
+            THEN( "all the sensors are loaded and still heard" )
+            {
+                REQUIRE(alarm->sensors().size() == maxSensors);
+                state.state = SensorState::State::Open;
+                report(maxSensors - 1);
+                REQUIRE(alarm->getSensor(0x30AEA4000000ull + maxSensors - 1)->state == SensorState::State::Open);
+            }
+        }
+    }
+}
+
+SCENARIO( "Test AlarmSystem sensor event bursts", "[]" )
+{
+    GIVEN ( "an alarm system" )
+    {
+        REQUIRE(SPIFFS.format());
+        auto alarm = std::make_unique<AlarmSystem>("", "", 0, 0, 0);
+        alarm->begin();
+
+        // Each pass, every sensor sends a heartbeat and a state change, as
+        // ContactSensorApp::reportState() can.
+        const size_t burstSensors = 8;
+        const size_t framesPerSensor = 2;
+        const size_t passes = 50;
+
+        const uint8_t firstMacAddress[6] = { 0x30, 0xAE, 0xA4, 0x05, 0x00, 0x00 };
+        registerSensors(*alarm, firstMacAddress, burstSensors);
+        const auto registered = alarm->ingestStats();
+
+        auto sendBurst = [&](size_t sensorCount, size_t framesPerSensor) {
+            for (size_t i = 0; i < sensorCount; ++i)
+            {
+                uint8_t macAddress[6] = { 0x30, 0xAE, 0xA4, 0x05, 0x00, static_cast<uint8_t>(i) };
+                for (size_t j = 0; j < framesPerSensor; ++j)
+                {
+                    SensorState state{ESP_SLEEP_WAKEUP_UNDEFINED, j % 2 == 0 ? SensorState::State::Closed : SensorState::State::Open, 3.3};
+                    REQUIRE(TestESPNowServer::instance().send(macAddress, reinterpret_cast<const uint8_t*>(&state), sizeof(state)));
+                }
+            }
+        };
+
+        WHEN( "sensors report in bursts that fill the queue between loop passes" )
+        {
+            for (size_t pass = 0; pass < passes; ++pass)
+            {
+                sendBurst(burstSensors, framesPerSensor);
+                alarm->onLoop();
+                // Keep within each sensor's admission rate.
+                delay(framesPerSensor * SensorAdmission::sensorRefillMs);
+            }
+
+            THEN( "no sensor events are dropped" )
+            {
+                auto stats = alarm->ingestStats();
+                REQUIRE(stats.eventsDropped == 0);
+                REQUIRE(stats.framesThrottled == 0);
+                REQUIRE(stats.eventsProcessed - registered.eventsProcessed == burstSensors * framesPerSensor * passes);
+                REQUIRE(stats.queueHighWater == burstSensors * framesPerSensor);
+                REQUIRE(alarm->sensors().size() == burstSensors);
+            }
+        }
+
+        WHEN( "a burst overflows the queue" )
+        {
+            // The two sensors not registered yet fit in the unknown sender
+            // allowance.
+            sendBurst(10, framesPerSensor);
+            alarm->onLoop();
+
+            THEN( "the dropped events are counted" )
+            {
+                auto stats = alarm->ingestStats();
+                REQUIRE(stats.eventsDropped == 4);
+                REQUIRE(stats.framesThrottled == 0);
+                REQUIRE(stats.eventsProcessed - registered.eventsProcessed == 16);
+                REQUIRE(stats.queueHighWater == 16);
+            }
+        }
+
+        WHEN( "the sensor event budget is limited" )
+        {
+            alarm->setSensorEventBudget(4, 0);
+            sendBurst(burstSensors, 1);
+            alarm->onLoop();
+
+            THEN( "only the budgeted number of events are handled per pass" )
+            {
+                REQUIRE(alarm->ingestStats().eventsProcessed - registered.eventsProcessed == 4);
+
+                alarm->onLoop();
+                REQUIRE(alarm->ingestStats().eventsProcessed - registered.eventsProcessed == burstSensors);
+            }
+        }
+    }
+}
+
+
+SCENARIO( "Test AlarmSystem sensor event coalescing", "[]" )
+{
+    GIVEN ( "an alarm system with an enabled sensor" )
+    {
+        REQUIRE(SPIFFS.format());
+        auto alarm = std::make_unique<AlarmSystem>("", "", 0, 0, 0);
+        alarm->begin();
+
+        SensorState state{ESP_SLEEP_WAKEUP_UNDEFINED, SensorState::State::Closed, 3.3};
+        TestESPNowServer::instance().send(sensor1MacAddress, reinterpret_cast<const uint8_t*>(&state), sizeof(state));
+        alarm->onLoop();
+        auto sensor = *alarm->getSensor(sensor1Id);
+        sensor.enabled = true;
+        REQUIRE(alarm->updateSensor(sensor));
+        while (numberOfAudioFilesPlayed() > 0)
+        {
+            lastAudioFilePlayed();
+        }
+
+        WHEN( "the sensor sends several heartbeats before the loop runs" )
+        {
+            for (auto i = 0; i < 5; ++i)
+            {
+                TestESPNowServer::instance().send(sensor1MacAddress, reinterpret_cast<const uint8_t*>(&state), sizeof(state));
+            }
+            alarm->onLoop();
+
+            THEN( "they are handled as one event" )
+            {
+                auto stats = alarm->ingestStats();
+                REQUIRE(stats.eventsProcessed == 2);
+                REQUIRE(stats.eventsMerged == 4);
+                REQUIRE(stats.eventsDropped == 0);
+            }
+        }
+
+        WHEN( "the sensor sends state changes before the loop runs" )
+        {
+            const SensorState::State states[] = {
+                SensorState::State::Closed,
+                SensorState::State::Open,
+                SensorState::State::Open,
+                SensorState::State::Closed,
+                SensorState::State::Open
+            };
+            for (auto newState : states)
+            {
+                state.state = newState;
+                TestESPNowServer::instance().send(sensor1MacAddress, reinterpret_cast<const uint8_t*>(&state), sizeof(state));
+            }
+            alarm->onLoop();
+
+            THEN( "every transition is handled in order" )
+            {
+                auto stats = alarm->ingestStats();
+                // The first report matches the event handled at startup, which
+                // is no longer queued, so it is not merged.
+                REQUIRE(stats.eventsProcessed == 1 + 4);
+                REQUIRE(stats.eventsMerged == 1);
+                REQUIRE(alarm->getSensor(sensor1Id)->state == SensorState::State::Open);
+
+                // Open and close chimes
+                REQUIRE(numberOfAudioFilesPlayed() == 3);
+            }
+        }
+    }
+}
+
+SCENARIO( "Test AlarmSystem sensor frame filtering", "[]" )
+{
+    GIVEN ( "an alarm system with an enabled sensor sending version 2 frames" )
+    {
+        REQUIRE(SPIFFS.format());
+        auto alarm = std::make_unique<AlarmSystem>("", "", 0, 0, 0);
+        alarm->begin();
+
+        SensorFrame frame;
+        frame.state = SensorState::State::Closed;
+        frame.vccMillivolts = 3300;
+        frame.sequence = 100;
+        frame.sequenceReset = true;
+        uint8_t buffer[sensorFrameSize];
+        auto sendFrame = [&]() {
+            auto len = frame.encode(buffer, sizeof(buffer));
+            TestESPNowServer::instance().send(sensor1MacAddress, buffer, len);
+        };
+
+        sendFrame();
+        alarm->onLoop();
+        frame.sequenceReset = false;
+        REQUIRE(alarm->getSensor(sensor1Id) != nullptr);
+        REQUIRE(alarm->getSensor(sensor1Id)->state == SensorState::State::Closed);
+
+        WHEN( "a frame is retransmitted" )
+        {
+            frame.sequence = 101;
+            frame.state = SensorState::State::Open;
+            sendFrame();
+            alarm->onLoop();
+            sendFrame();
+            alarm->onLoop();
+
+            THEN( "the copy is dropped before it is queued" )
+            {
+                auto stats = alarm->ingestStats();
+                REQUIRE(stats.eventsProcessed == 2);
+                REQUIRE(stats.framesDuplicate == 1);
+                REQUIRE(alarm->getSensor(sensor1Id)->state == SensorState::State::Open);
+            }
+
+            THEN( "the sensor's link stats count the copy" )
+            {
+                SensorLinkStats::Stats linkStats;
+                REQUIRE(alarm->getSensorLinkStats(sensor1Id, linkStats));
+                REQUIRE(linkStats.framesReceived == 3);
+                REQUIRE(linkStats.framesRepeated == 1);
+                REQUIRE(linkStats.lastVccMillivolts == 3300);
+            }
+        }
+
+        WHEN( "an older frame arrives after a newer one" )
+        {
+            frame.sequence = 102;
+            frame.state = SensorState::State::Open;
+            sendFrame();
+            frame.sequence = 101;
+            frame.state = SensorState::State::Closed;
+            sendFrame();
+            alarm->onLoop();
+
+            THEN( "the stale state is not applied" )
+            {
+                auto stats = alarm->ingestStats();
+                REQUIRE(stats.framesOutOfOrder == 1);
+                REQUIRE(alarm->getSensor(sensor1Id)->state == SensorState::State::Open);
+            }
+        }
+
+        WHEN( "a corrupted frame arrives" )
+        {
+            frame.sequence = 101;
+            auto len = frame.encode(buffer, sizeof(buffer));
+            buffer[2] ^= 1;
+            TestESPNowServer::instance().send(sensor1MacAddress, buffer, len);
+            alarm->onLoop();
+
+            THEN( "it is counted as invalid" )
+            {
+                auto stats = alarm->ingestStats();
+                REQUIRE(stats.framesInvalid == 1);
+                REQUIRE(stats.eventsProcessed == 1);
+
+                SensorLinkStats::Stats linkStats;
+                REQUIRE(alarm->getSensorLinkStats(sensor1Id, linkStats));
+                REQUIRE(linkStats.framesInvalid == 1);
+            }
+        }
+    }
+}
+
+SCENARIO( "Test AlarmSystem sensor frame acks", "[]" )
+{
+    GIVEN ( "an alarm system" )
+    {
+        REQUIRE(SPIFFS.format());
+        auto alarm = std::make_unique<AlarmSystem>("", "", 0, 0, 0);
+        alarm->begin();
+        TestESPNowServer::instance().clearReplies();
+
+        SensorFrame frame;
+        frame.state = SensorState::State::Closed;
+        frame.sequence = 7;
+        uint8_t buffer[sensorFrameSize];
+        auto len = frame.encode(buffer, sizeof(buffer));
+
+        WHEN( "a version 2 frame is received" )
+        {
+            TestESPNowServer::instance().send(sensor1MacAddress, buffer, len);
+
+            THEN( "it is acked with its sequence number" )
+            {
+                const auto& replies = TestESPNowServer::instance().replies();
+                REQUIRE(replies.size() == 1);
+                SensorAck ack;
+                REQUIRE(ack.decode(replies[0].data(), replies[0].size()));
+                REQUIRE(ack.sequence == 7);
+            }
+
+            THEN( "a retry after a lost ack is acked again but not queued" )
+            {
+                TestESPNowServer::instance().send(sensor1MacAddress, buffer, len);
+                alarm->onLoop();
+                REQUIRE(TestESPNowServer::instance().replies().size() == 2);
+                REQUIRE(alarm->ingestStats().eventsProcessed == 1);
+            }
+        }
+
+        WHEN( "the sensor event queue is full" )
+        {
+            SensorState state{ESP_SLEEP_WAKEUP_UNDEFINED, SensorState::State::Closed, 3.3};
+            uint8_t mac[6] = { 0x30, 0xAE, 0xA4, 0x00, 0x00, 0x00 };
+            registerSensors(*alarm, mac, 16);
+            for (uint8_t i = 0; i < 16; ++i)
+            {
+                mac[5] = i;
+                TestESPNowServer::instance().send(mac, reinterpret_cast<const uint8_t*>(&state), sizeof(state));
+            }
+            TestESPNowServer::instance().send(sensor1MacAddress, buffer, len);
+
+            THEN( "the frame is not acked and its retry is accepted" )
+            {
+                REQUIRE(TestESPNowServer::instance().replies().empty());
+                alarm->onLoop();
+                TestESPNowServer::instance().send(sensor1MacAddress, buffer, len);
+                REQUIRE(TestESPNowServer::instance().replies().size() == 1);
+                alarm->onLoop();
+                REQUIRE(alarm->getSensor(sensor1Id) != nullptr);
+            }
+        }
+    }
+}
+
+SCENARIO( "Test AlarmSystem sensor batch frames", "[]" )
+{
+    GIVEN ( "an armed alarm system with a sensor sending version 2 frames" )
+    {
+        REQUIRE(SPIFFS.format());
+        auto alarm = std::make_unique<AlarmSystem>("", "", 0, 0, 0);
+        alarm->begin();
+        // The sensors that fill the queue below, registered before the
+        // enabled sensor so it doesn't time out meanwhile.
+        uint8_t mac[6] = { 0x30, 0xAE, 0xA4, 0x00, 0x00, 0x00 };
+        registerSensors(*alarm, mac, 14);
+        TestESPNowServer::instance().clearReplies();
+
+        SensorFrame frame;
+        frame.state = SensorState::State::Closed;
+        frame.sequence = 20;
+        frame.sequenceReset = true;
+        uint8_t buffer[sensorBatchFrameSize(SensorFrame::maxEdges)];
+        auto len = frame.encode(buffer, sizeof(buffer));
+        TestESPNowServer::instance().send(sensor1MacAddress, buffer, len);
+        alarm->onLoop();
+
+        auto sensor = *alarm->getSensor(sensor1Id);
+        sensor.enabled = true;
+        REQUIRE(alarm->updateSensor(sensor));
+        REQUIRE(alarm->arm());
+        while (numberOfAudioFilesPlayed() > 0)
+        {
+            lastAudioFilePlayed();
+        }
+        TestESPNowServer::instance().clearReplies();
+
+        frame.type = SensorFrame::Type::BatchReport;
+        frame.sequence = 21;
+        frame.sequenceReset = false;
+        frame.edgeCount = 3;
+        frame.edges[0] = { SensorState::State::Open, 900 };
+        frame.edges[1] = { SensorState::State::Closed, 400 };
+        frame.edges[2] = { SensorState::State::Open, 0 };
+        len = frame.encode(buffer, sizeof(buffer));
+        const auto processedBefore = alarm->ingestStats().eventsProcessed;
+
+        WHEN( "a batch of state changes is received" )
+        {
+            TestESPNowServer::instance().send(sensor1MacAddress, buffer, len);
+            alarm->onLoop();
+
+            THEN( "every change is handled in order and the alarm is triggered" )
+            {
+                REQUIRE(TestESPNowServer::instance().replies().size() == 1);
+                REQUIRE(alarm->ingestStats().eventsProcessed == processedBefore + 3);
+                REQUIRE(alarm->getSensor(sensor1Id)->state == SensorState::State::Open);
+                REQUIRE(alarm->state() == AlarmState::AlarmTriggered);
+                REQUIRE(lastAudioFilePlayed() == "/A_SOUND.WAV");
+            }
+        }
+
+        auto sendHeartbeats = [&]() {
+            SensorState state{ESP_SLEEP_WAKEUP_UNDEFINED, SensorState::State::Closed, 3.3};
+            for (uint8_t i = 0; i < 14; ++i)
+            {
+                mac[5] = i;
+                TestESPNowServer::instance().send(mac, reinterpret_cast<const uint8_t*>(&state), sizeof(state));
+            }
+        };
+
+        WHEN( "heartbeats leave no room in the sensor event queue for the whole batch" )
+        {
+            sendHeartbeats();
+            TestESPNowServer::instance().send(sensor1MacAddress, buffer, len);
+
+            THEN( "it is queued ahead of them in the priority lane" )
+            {
+                REQUIRE(TestESPNowServer::instance().replies().size() == 1);
+                REQUIRE(alarm->ingestStats().eventsDropped == 0);
+                alarm->setSensorEventBudget(1, 0);
+                alarm->onLoop();
+                REQUIRE(alarm->state() == AlarmState::AlarmTriggered);
+                REQUIRE(alarm->getSensor(sensor1Id)->state == SensorState::State::Open);
+                REQUIRE(alarm->ingestStats().priorityEvents == 3);
+                REQUIRE(alarm->ingestStats().eventsProcessed == processedBefore + 4);
+            }
+        }
+
+        WHEN( "the system is disarmed and the sensor event queue has no room for the whole batch" )
+        {
+            alarm->disarm();
+            sendHeartbeats();
+            TestESPNowServer::instance().send(sensor1MacAddress, buffer, len);
+
+            THEN( "none of it is queued or acked and its retry is accepted" )
+            {
+                REQUIRE(TestESPNowServer::instance().replies().empty());
+                REQUIRE(alarm->ingestStats().eventsDropped == 3);
+                while (alarm->ingestStats().eventsProcessed < processedBefore + 14)
+                {
+                    alarm->onLoop();
+                }
+                REQUIRE(alarm->getSensor(sensor1Id)->state == SensorState::State::Closed);
+
+                TestESPNowServer::instance().send(sensor1MacAddress, buffer, len);
+                REQUIRE(TestESPNowServer::instance().replies().size() == 1);
+                alarm->onLoop();
+                REQUIRE(alarm->getSensor(sensor1Id)->state == SensorState::State::Open);
+                REQUIRE(alarm->ingestStats().priorityEvents == 0);
+            }
+        }
+    }
+}
+
+SCENARIO( "Test AlarmSystem priority lane", "[]" )
+{
+    GIVEN ( "an armed alarm system saturated with heartbeats" )
+    {
+        REQUIRE(SPIFFS.format());
+        auto alarm = std::make_unique<AlarmSystem>("", "", 0, 0, 0);
+        alarm->begin();
+
+        const size_t heartbeatSensors = 15;
+        const size_t rounds = 20;
+        uint8_t mac[6] = { 0x30, 0xAE, 0xA4, 0x00, 0x00, 0x00 };
+        registerSensors(*alarm, mac, heartbeatSensors);
+
+        SensorState state{ESP_SLEEP_WAKEUP_UNDEFINED, SensorState::State::Closed, 3.3};
+        auto sendState = [&](const uint8_t* macAddress, SensorState::State sensorState) {
+            state.state = sensorState;
+            TestESPNowServer::instance().send(macAddress, reinterpret_cast<const uint8_t*>(&state), sizeof(state));
+        };
+        auto sendHeartbeats = [&]() {
+            for (uint8_t i = 0; i < heartbeatSensors; ++i)
+            {
+                mac[5] = i;
+                sendState(mac, SensorState::State::Closed);
+            }
+        };
+
+        sendState(sensor1MacAddress, SensorState::State::Closed);
+        alarm->onLoop();
+        auto sensor = *alarm->getSensor(sensor1Id);
+        sensor.enabled = true;
+        REQUIRE(alarm->updateSensor(sensor));
+        REQUIRE(alarm->arm());
+
+        // A loop that falls behind: it only gets through one heartbeat per
+        // pass, while every sensor sends one per pass.
+        alarm->setSensorEventBudget(1, 0);
+
+        WHEN( "a sensor is opened at different points of the load" )
+        {
+            size_t worstPasses = 0;
+            for (size_t round = 0; round < rounds; ++round)
+            {
+                sendHeartbeats();
+                alarm->onLoop();
+                // Keep within each sensor's admission rate.
+                delay(SensorAdmission::sensorRefillMs);
+                if (round % 4 != 3)
+                {
+                    continue;
+                }
+
+                sendHeartbeats();
+                sendState(sensor1MacAddress, SensorState::State::Open);
+                sendHeartbeats();
+                size_t passes = 0;
+                while (alarm->state() != AlarmState::AlarmTriggered)
+                {
+                    alarm->onLoop();
+                    passes++;
+                    REQUIRE(passes <= sensorEventQueueLength);
+                }
+                worstPasses = std::max(worstPasses, passes);
+
+                // Re-arm for the next try.
+                alarm->disarm();
+                alarm->setSensorEventBudget(0, 0);
+                sendState(sensor1MacAddress, SensorState::State::Closed);
+                alarm->onLoop();
+                REQUIRE(alarm->arm());
+                alarm->setSensorEventBudget(1, 0);
+                delay(SensorAdmission::sensorRefillMs);
+            }
+
+            THEN( "the alarm triggers on the next pass every time" )
+            {
+                auto stats = alarm->ingestStats();
+                // The heartbeats kept the queue full, merging with the ones
+                // still waiting.
+                REQUIRE(stats.queueHighWater >= heartbeatSensors);
+                REQUIRE(stats.eventsMerged > 0);
+                REQUIRE(stats.priorityEvents == rounds / 4);
+                REQUIRE(worstPasses == 1);
+
+                auto stages = alarm->frameLatencyStats();
+                const auto& frameToSiren = stages.back().latency;
+                REQUIRE(frameToSiren.count == rounds / 4);
+                INFO("Worst frame to siren " << frameToSiren.maxUs << " us");
+                REQUIRE(frameToSiren.maxUs < frameToSirenBudgetUs);
+            }
+        }
+
+        WHEN( "a sensor closes, opens and closes again before the loop runs" )
+        {
+            alarm->setSensorEventBudget(0, 0);
+            sendState(sensor1MacAddress, SensorState::State::Closed);
+            sendState(sensor1MacAddress, SensorState::State::Open);
+            sendState(sensor1MacAddress, SensorState::State::Closed);
+            alarm->onLoop();
+
+            THEN( "the alarm triggers and the sensor ends up closed" )
+            {
+                REQUIRE(alarm->state() == AlarmState::AlarmTriggered);
+                REQUIRE(alarm->getSensor(sensor1Id)->state == SensorState::State::Closed);
+                REQUIRE(alarm->ingestStats().priorityEvents == 1);
+            }
+        }
+    }
+}
+
+SCENARIO( "Test AlarmSystem admission control", "[]" )
+{
+    GIVEN ( "an armed alarm system with an enabled sensor" )
+    {
+        REQUIRE(SPIFFS.format());
+        auto alarm = std::make_unique<AlarmSystem>("", "", 0, 0, 0);
+        alarm->begin();
+
+        SensorState state{ESP_SLEEP_WAKEUP_UNDEFINED, SensorState::State::Closed, 3.3};
+        auto sendState = [&](const uint8_t* mac, SensorState::State sensorState) {
+            state.state = sensorState;
+            TestESPNowServer::instance().send(mac, reinterpret_cast<const uint8_t*>(&state), sizeof(state));
+        };
+        sendState(sensor1MacAddress, SensorState::State::Closed);
+        sendState(sensor2MacAddress, SensorState::State::Closed);
+        alarm->onLoop();
+        auto sensor = *alarm->getSensor(sensor1Id);
+        sensor.enabled = true;
+        REQUIRE(alarm->updateSensor(sensor));
+        REQUIRE(alarm->arm());
+        while (numberOfAudioFilesPlayed() > 0)
+        {
+            lastAudioFilePlayed();
+        }
+
+        WHEN( "a transmitter floods frames from spoofed MAC addresses" )
+        {
+            auto sensorsBefore = alarm->sensors().size();
+            uint8_t mac[6] = { 0x24, 0x6F, 0x28, 0x00, 0x00, 0x00 };
+            for (uint32_t i = 0; i < 1000; ++i)
+            {
+                mac[4] = i >> 8;
+                mac[5] = i;
+                sendState(mac, SensorState::State::Open);
+                alarm->onLoop();
+            }
+
+            THEN( "only a few are registered as new sensors" )
+            {
+                REQUIRE(alarm->sensors().size() - sensorsBefore <= SensorAdmission::unknownBurst);
+                REQUIRE(alarm->ingestStats().framesThrottled >= 1000 - SensorAdmission::unknownBurst);
+                REQUIRE(alarm->state() == AlarmState::Armed);
+            }
+
+            THEN( "the rejected senders are not tracked" )
+            {
+                SensorLinkStats::Stats linkStats;
+                REQUIRE_FALSE(alarm->getSensorLinkStats(0x246F280003E7, linkStats));
+                REQUIRE(alarm->getSensorLinkStats(sensor1Id, linkStats));
+            }
+
+            THEN( "the enabled sensor still triggers the alarm" )
+            {
+                sendState(sensor1MacAddress, SensorState::State::Open);
+                alarm->onLoop();
+                REQUIRE(alarm->state() == AlarmState::AlarmTriggered);
+            }
+        }
+
+        WHEN( "a registered sensor floods the queue" )
+        {
+            for (auto i = 0; i < 100; ++i)
+            {
+                sendState(sensor2MacAddress, SensorState::State::Open);
+            }
+
+            THEN( "it can't starve the enabled sensor" )
+            {
+                auto stats = alarm->ingestStats();
+                REQUIRE(stats.framesThrottled == 100 - SensorAdmission::sensorBurst);
+                REQUIRE(stats.eventsDropped == 0);
+                sendState(sensor1MacAddress, SensorState::State::Open);
+                alarm->onLoop();
+                REQUIRE(alarm->state() == AlarmState::AlarmTriggered);
+            }
+        }
+
+        WHEN( "the enabled sensor flaps quickly" )
+        {
+            alarm->onLoop();
+            for (auto i = 0; i < 20; ++i)
+            {
+                sendState(sensor1MacAddress, SensorState::State::Closed);
+                sendState(sensor1MacAddress, SensorState::State::Open);
+                alarm->onLoop();
+            }
+
+            THEN( "none of its state changes are throttled" )
+            {
+                REQUIRE(alarm->ingestStats().framesThrottled == 0);
+                REQUIRE(alarm->state() == AlarmState::AlarmTriggered);
+            }
+        }
+    }
+}
@@ -0,0 +1,141 @@
+#include <catch.hpp>
+
+#include <ESPNowDelivery.h>
+
+#include <deque>
+#include <vector>
+
+
+namespace
+{
+
+class ScriptedTransport
+{
+public:
+    enum class Outcome
+    {
+        LocalError,
+        NotDelivered,
+        NoAck,
+        Acked
+    };
+
+    std::deque<Outcome> outcomes;
+    std::vector<unsigned long> backoffs;
+    unsigned transmits = 0;
+    uint32_t nextRandom = 0xFFFFFFFF;
+
+    bool transmit(const uint8_t* /*data*/, size_t /*len*/)
+    {
+        transmits++;
+        _current = outcomes.empty() ? Outcome::NoAck : outcomes.front();
+        if (!outcomes.empty())
+        {
+            outcomes.pop_front();
+        }
+        return _current != Outcome::LocalError;
+    }
+
+    bool waitForSendDone(unsigned long /*timeoutMs*/)
+    {
+        return _current != Outcome::NotDelivered;
+    }
+
+    bool waitForAck(uint16_t /*sequence*/, unsigned long /*timeoutMs*/)
+    {
+        return _current == Outcome::Acked;
+    }
+
+    void backoff(unsigned long ms)
+    {
+        backoffs.push_back(ms);
+    }
+
+    uint32_t random()
+    {
+        return nextRandom;
+    }
+
+private:
+    Outcome _current = Outcome::NoAck;
+};
+
+const uint8_t frame[] = { 1, 2, 3 };
+
+}
+
+
+SCENARIO( "Test ESP-NOW acknowledged delivery", "" )
+{
+    ScriptedTransport transport;
+    DeliveryPolicy policy = { 5, 5, 10, 2, 8 };
+
+    GIVEN( "a controller that acks the first frame" )
+    {
+        transport.outcomes = { ScriptedTransport::Outcome::Acked };
+
+        THEN( "the frame is sent once without backing off" )
+        {
+            auto result = deliver(transport, policy, frame, sizeof(frame), 7);
+            REQUIRE(result.delivered);
+            REQUIRE(result.attempts == 1);
+            REQUIRE(transport.backoffs.empty());
+        }
+    }
+
+    GIVEN( "a radio that loses the first frames" )
+    {
+        transport.outcomes = {
+            ScriptedTransport::Outcome::NotDelivered,
+            ScriptedTransport::Outcome::LocalError,
+            ScriptedTransport::Outcome::NoAck,
+            ScriptedTransport::Outcome::Acked
+        };
+
+        THEN( "the frame is retried until acked" )
+        {
+            auto result = deliver(transport, policy, frame, sizeof(frame), 7);
+            REQUIRE(result.delivered);
+            REQUIRE(result.attempts == 4);
+            REQUIRE(transport.transmits == 4);
+        }
+
+        THEN( "the backoff window doubles up to the maximum" )
+        {
+            // 44 % (window + 1) == window for windows of 2, 4 and 8
+            transport.nextRandom = 44;
+            deliver(transport, policy, frame, sizeof(frame), 7);
+            REQUIRE(transport.backoffs == std::vector<unsigned long>({ 2, 4, 8 }));
+        }
+    }
+
+    GIVEN( "a controller that never acks" )
+    {
+        THEN( "delivery gives up after the maximum attempts" )
+        {
+            auto result = deliver(transport, policy, frame, sizeof(frame), 7);
+            REQUIRE_FALSE(result.delivered);
+            REQUIRE(result.attempts == policy.maxAttempts);
+            REQUIRE(transport.transmits == policy.maxAttempts);
+            for (auto backoff : transport.backoffs)
+            {
+                REQUIRE(backoff <= policy.maxBackoffMs);
+            }
+        }
+    }
+}
+
+SCENARIO( "Test ESP-NOW backoff window", "" )
+{
+    GIVEN( "an initial backoff and a maximum" )
+    {
+        THEN( "the window doubles with each retry up to the maximum" )
+        {
+            REQUIRE(backoffWindowMs(1000, 30000, 1) == 1000);
+            REQUIRE(backoffWindowMs(1000, 30000, 2) == 2000);
+            REQUIRE(backoffWindowMs(1000, 30000, 5) == 16000);
+            REQUIRE(backoffWindowMs(1000, 30000, 6) == 30000);
+            REQUIRE(backoffWindowMs(1000, 30000, 255) == 30000);
+        }
+    }
+}
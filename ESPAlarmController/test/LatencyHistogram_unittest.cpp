@@ -0,0 +1,98 @@
+#include <catch.hpp>
+
+#include <LatencyHistogram.h>
+
+#include <memory>
+
+
+SCENARIO( "Test LatencyHistogram", "" )
+{
+    auto histogram = std::make_unique<LatencyHistogram>();
+
+    GIVEN( "no samples" )
+    {
+        THEN( "everything is 0" )
+        {
+            auto snapshot = histogram->snapshot();
+            REQUIRE(snapshot.count == 0);
+            REQUIRE(snapshot.maxUs == 0);
+            REQUIRE(snapshot.percentileUs(0.5) == 0);
+        }
+    }
+
+    GIVEN( "samples at the bucket edges" )
+    {
+        histogram->record(0);
+        histogram->record(1);
+        histogram->record(2);
+        histogram->record(3);
+        histogram->record(4);
+        histogram->record(1023);
+        histogram->record(1024);
+
+        THEN( "each lands in the bucket of its highest bit" )
+        {
+            auto snapshot = histogram->snapshot();
+            REQUIRE(snapshot.count == 7);
+            REQUIRE(snapshot.maxUs == 1024);
+            REQUIRE(snapshot.buckets[0] == 1);
+            REQUIRE(snapshot.buckets[1] == 1);
+            REQUIRE(snapshot.buckets[2] == 2);
+            REQUIRE(snapshot.buckets[3] == 1);
+            REQUIRE(snapshot.buckets[10] == 1);
+            REQUIRE(snapshot.buckets[11] == 1);
+        }
+
+        THEN( "each bucket ends where the next starts" )
+        {
+            REQUIRE(LatencyHistogram::bucketLimitUs(0) == 1);
+            REQUIRE(LatencyHistogram::bucketLimitUs(2) == 4);
+            REQUIRE(LatencyHistogram::bucketLimitUs(10) == 1024);
+        }
+
+        THEN( "a reset clears them" )
+        {
+            histogram->reset();
+            auto snapshot = histogram->snapshot();
+            REQUIRE(snapshot.count == 0);
+            REQUIRE(snapshot.buckets[11] == 0);
+        }
+    }
+
+    GIVEN( "a long tail" )
+    {
+        for (auto i = 0; i < 98; ++i)
+        {
+            histogram->record(10);
+        }
+        histogram->record(3000);
+        histogram->record(3000000);
+
+        THEN( "percentiles report the bucket upper bound" )
+        {
+            auto snapshot = histogram->snapshot();
+            REQUIRE(snapshot.percentileUs(0.5) == 16);
+            REQUIRE(snapshot.percentileUs(0.98) == 4096);
+        }
+
+        THEN( "the last bucket takes everything longer, up to the worst sample" )
+        {
+            auto snapshot = histogram->snapshot();
+            REQUIRE(snapshot.buckets[LatencyHistogram::bucketCount - 1] == 1);
+            REQUIRE(snapshot.percentileUs(1.0) == 3000000);
+            REQUIRE(LatencyHistogram::bucketLimitUs(LatencyHistogram::bucketCount - 1) == 0xFFFFFFFF);
+        }
+    }
+
+    GIVEN( "a timed scope" )
+    {
+        {
+            LatencyHistogram::Timer timer(*histogram);
+        }
+
+        THEN( "one sample is recorded" )
+        {
+            REQUIRE(histogram->snapshot().count == 1);
+        }
+    }
+}
@@ -0,0 +1,153 @@
+#include <catch.hpp>
+
+#include "PolicyTrace.h"
+
+#include <memory>
+
+
+namespace
+{
+
+PolicyTrace::Record makeRecord(uint64_t sensorId, unsigned long now)
+{
+    AlarmSensor sensor(sensorId, true, "", SensorState::Closed);
+    return PolicyTrace::capture(PolicyTrace::Input::SensorState, sensor, SensorState::Open, AlarmState::Armed, now);
+}
+
+std::vector<PolicyTrace::Record> parse(const PolicyTrace& trace)
+{
+    std::vector<PolicyTrace::Record> records;
+    auto data = trace.serialize();
+    REQUIRE(PolicyTrace::parse(data.data(), data.size(), records));
+    return records;
+}
+
+}
+
+
+SCENARIO( "Test PolicyTrace", "" )
+{
+    auto trace = std::make_unique<PolicyTrace>();
+
+    GIVEN( "an empty trace" )
+    {
+        THEN( "it serializes to a header only" )
+        {
+            REQUIRE(trace->size() == 0);
+            REQUIRE(trace->serialize().size() == sizeof(PolicyTrace::Header));
+            REQUIRE(parse(*trace).empty());
+        }
+    }
+
+    GIVEN( "a recorded sensor report" )
+    {
+        AlarmSensor sensor(0x1122334455667788, true, "Door", SensorState::Closed);
+        sensor.zones = 0x6;
+        sensor.lastUpdate = 1000;
+        sensor.faultLastHandled = 500;
+        auto record = PolicyTrace::capture(PolicyTrace::Input::SensorState, sensor, SensorState::Fault, AlarmState::Arming, 2000);
+        AlarmPolicy::Actions actions;
+        actions.cancelArming = true;
+        actions.requestPlaySound(SoundPlayer::Sound::SensorFault);
+        trace->add(record, actions);
+
+        THEN( "the policy's inputs and actions read back" )
+        {
+            auto records = parse(*trace);
+            REQUIRE(records.size() == 1);
+            const auto& read = records[0];
+            REQUIRE(read.inputType() == PolicyTrace::Input::SensorState);
+            REQUIRE(read.timeMs == 2000);
+            REQUIRE(read.alarmState() == AlarmState::Arming);
+            REQUIRE(read.newState() == SensorState::Fault);
+
+            auto readSensor = read.sensor();
+            REQUIRE(readSensor.id == sensor.id);
+            REQUIRE(readSensor.enabled);
+            REQUIRE(readSensor.state == SensorState::Closed);
+            REQUIRE(readSensor.lastUpdate == 1000);
+            REQUIRE(readSensor.faultLastHandled == 500);
+
+            auto readActions = read.policyActions();
+            REQUIRE_FALSE(readActions.triggerAlarm);
+            REQUIRE(readActions.cancelArming);
+            REQUIRE(readActions.playSound);
+            REQUIRE(readActions.sound == SoundPlayer::Sound::SensorFault);
+        }
+    }
+
+    GIVEN( "a recorded sensor check" )
+    {
+        AlarmSensor sensor(1, false, "", SensorState::Unknown);
+        auto record = PolicyTrace::capture(PolicyTrace::Input::SensorCheck, sensor, SensorState::Open, AlarmState::AlarmTriggered, 3000);
+        AlarmPolicy::Actions actions;
+        actions.triggerAlarm = true;
+        trace->add(record, actions);
+
+        THEN( "it reads back as a check" )
+        {
+            auto records = parse(*trace);
+            REQUIRE(records.size() == 1);
+            REQUIRE(records[0].inputType() == PolicyTrace::Input::SensorCheck);
+            REQUIRE(records[0].alarmState() == AlarmState::AlarmTriggered);
+            REQUIRE_FALSE(records[0].sensor().enabled);
+            REQUIRE(records[0].sensor().state == SensorState::Unknown);
+            REQUIRE(records[0].policyActions().triggerAlarm);
+            REQUIRE_FALSE(records[0].policyActions().playSound);
+        }
+    }
+
+    GIVEN( "more records than fit" )
+    {
+        const size_t count = PolicyTrace::capacity + 10;
+        for (size_t i = 0; i < count; ++i)
+        {
+            trace->add(makeRecord(i, i), AlarmPolicy::Actions());
+        }
+
+        THEN( "the newest are kept, oldest first" )
+        {
+            REQUIRE(trace->size() == PolicyTrace::capacity);
+            auto records = parse(*trace);
+            REQUIRE(records.size() == PolicyTrace::capacity);
+            for (size_t i = 0; i < records.size(); ++i)
+            {
+                REQUIRE(records[i].sensorId == count - PolicyTrace::capacity + i);
+            }
+        }
+
+        WHEN( "it is cleared" )
+        {
+            trace->clear();
+            trace->add(makeRecord(1, 1), AlarmPolicy::Actions());
+
+            THEN( "only the new record is left" )
+            {
+                auto records = parse(*trace);
+                REQUIRE(records.size() == 1);
+                REQUIRE(records[0].sensorId == 1);
+            }
+        }
+    }
+
+    GIVEN( "serialized data that is not a valid trace" )
+    {
+        trace->add(makeRecord(1, 1), AlarmPolicy::Actions());
+        auto data = trace->serialize();
+        std::vector<PolicyTrace::Record> records;
+
+        THEN( "it is rejected" )
+        {
+            REQUIRE_FALSE(PolicyTrace::parse(data.data(), sizeof(PolicyTrace::Header) - 1, records));
+            REQUIRE_FALSE(PolicyTrace::parse(data.data(), data.size() - 1, records));
+
+            auto badMagic = data;
+            badMagic[0] ^= 0xFF;
+            REQUIRE_FALSE(PolicyTrace::parse(badMagic.data(), badMagic.size(), records));
+
+            auto badVersion = data;
+            badVersion[4]++;
+            REQUIRE_FALSE(PolicyTrace::parse(badVersion.data(), badVersion.size(), records));
+        }
+    }
+}
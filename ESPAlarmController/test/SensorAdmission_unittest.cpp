@@ -0,0 +1,125 @@
+#include <catch.hpp>
+
+#include "SensorAdmission.h"
+
+#include <memory>
+
+
+using Membership = SensorIdSet::Membership;
+
+
+namespace
+{
+
+SensorFrame makeFrame(SensorState::State state)
+{
+    SensorFrame frame;
+    frame.state = state;
+    return frame;
+}
+
+}
+
+
+SCENARIO( "Test SensorAdmission", "" )
+{
+    auto admission = std::make_unique<SensorAdmission>();
+    auto closed = makeFrame(SensorState::Closed);
+    unsigned long now = 1000;
+
+    GIVEN( "a registered sensor sending a burst of heartbeats" )
+    {
+        admission->admit(1, Membership::Enabled, closed, false, now);
+        uint32_t admitted = 1;
+        for (auto i = 0; i < 20; ++i)
+        {
+            admitted += admission->admit(1, Membership::Enabled, closed, false, now);
+        }
+
+        THEN( "only the burst allowance is admitted" )
+        {
+            REQUIRE(admitted == SensorAdmission::sensorBurst);
+            REQUIRE(admission->stats().throttledKnown == 21 - SensorAdmission::sensorBurst);
+        }
+
+        THEN( "other sensors are not affected" )
+        {
+            REQUIRE(admission->admit(2, Membership::Enabled, closed, false, now));
+        }
+
+        THEN( "the bucket refills over time" )
+        {
+            REQUIRE_FALSE(admission->admit(1, Membership::Enabled, closed, false, now + SensorAdmission::sensorRefillMs - 1));
+            REQUIRE(admission->admit(1, Membership::Enabled, closed, false, now + SensorAdmission::sensorRefillMs));
+            REQUIRE_FALSE(admission->admit(1, Membership::Enabled, closed, false, now + SensorAdmission::sensorRefillMs));
+        }
+
+        THEN( "a state change is throttled while disarmed" )
+        {
+            REQUIRE_FALSE(admission->admit(1, Membership::Enabled, makeFrame(SensorState::Open), false, now));
+        }
+
+        WHEN( "the system is armed" )
+        {
+            THEN( "state changes, opens and faults are still admitted" )
+            {
+                REQUIRE(admission->admit(1, Membership::Enabled, makeFrame(SensorState::Open), true, now));
+                REQUIRE(admission->admit(1, Membership::Enabled, makeFrame(SensorState::Open), true, now));
+                REQUIRE(admission->admit(1, Membership::Enabled, closed, true, now));
+                REQUIRE(admission->admit(1, Membership::Enabled, makeFrame(SensorState::Fault), true, now));
+            }
+
+            THEN( "repeated closed heartbeats are throttled" )
+            {
+                REQUIRE_FALSE(admission->admit(1, Membership::Enabled, closed, true, now));
+            }
+
+            THEN( "a disabled sensor is throttled" )
+            {
+                REQUIRE_FALSE(admission->admit(1, Membership::Disabled, makeFrame(SensorState::Open), true, now));
+            }
+        }
+    }
+
+    GIVEN( "unknown senders" )
+    {
+        uint32_t admitted = 0;
+        for (uint64_t id = 100; id < 200; ++id)
+        {
+            admitted += admission->admitUnknown(now);
+        }
+
+        THEN( "they share one bucket" )
+        {
+            REQUIRE(admitted == SensorAdmission::unknownBurst);
+            REQUIRE(admission->stats().throttledUnknown == 100 - SensorAdmission::unknownBurst);
+            REQUIRE(admission->admit(1, Membership::Enabled, closed, false, now));
+        }
+
+        THEN( "the allowance refills slowly" )
+        {
+            REQUIRE_FALSE(admission->admitUnknown(now + SensorAdmission::unknownRefillMs - 1));
+            REQUIRE(admission->admitUnknown(now + SensorAdmission::unknownRefillMs));
+            REQUIRE_FALSE(admission->admitUnknown(now + SensorAdmission::unknownRefillMs));
+        }
+    }
+
+    GIVEN( "more registered sensors than the table holds" )
+    {
+        for (uint64_t id = 1; id <= SensorAdmission::maxSensors; ++id)
+        {
+            for (uint32_t i = 0; i < SensorAdmission::sensorBurst; ++i)
+            {
+                admission->admit(id, Membership::Enabled, closed, false, now + id);
+            }
+        }
+
+        THEN( "the least recently seen sensor gives up its bucket" )
+        {
+            REQUIRE(admission->admit(SensorAdmission::maxSensors + 1, Membership::Enabled, closed, false, now + 100));
+            // Sensor 1 starts over with a full bucket, sensor 3 is still empty.
+            REQUIRE(admission->admit(1, Membership::Enabled, closed, false, now + 100));
+            REQUIRE_FALSE(admission->admit(3, Membership::Enabled, closed, false, now + 100));
+        }
+    }
+}
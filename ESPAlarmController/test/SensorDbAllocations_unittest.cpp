@@ -0,0 +1,109 @@
+#include <catch.hpp>
+
+#include "SensorDb.h"
+
+#include <mockControl.h>
+#include <SPIFFS.h>
+
+#include <atomic>
+#include <set>
+#include <stdlib.h>
+
+
+// Counts every heap allocation, through new as well as String's realloc(),
+// by putting these in front of glibc's allocator. Kept out of
+// SensorDb_unittest so no other test runs with them. What the mock file
+// system allocates to hold file contents is left out, on the device that
+// is flash.
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* p, size_t size);
+extern "C" void __libc_free(void* p);
+
+namespace
+{
+
+std::atomic<size_t> allocations(0);
+
+}
+
+extern "C" void* malloc(size_t size)
+{
+    allocations++;
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    allocations++;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* p, size_t size)
+{
+    allocations++;
+    return __libc_realloc(p, size);
+}
+
+extern "C" void free(void* p)
+{
+    __libc_free(p);
+}
+
+
+namespace
+{
+
+// Enough to compact the file at least once, however many sensors there are
+const size_t updates = 1200;
+
+// The distinct numbers of allocations sensor updates took
+std::set<size_t> updateAllocations(size_t sensorCount)
+{
+    REQUIRE(SPIFFS.format());
+    SensorDataBase db;
+    REQUIRE(db.begin());
+    for (size_t i = 0; i < sensorCount; ++i)
+    {
+        REQUIRE(db.storeSensor(AlarmSensor(i + 1, true, "Sensor", SensorState::Unknown)));
+    }
+
+    // Names long enough that String can't keep them inline
+    AlarmSensor sensors[2] = {
+        AlarmSensor(0, true, "Front Door Contact Sensor", SensorState::Unknown),
+        AlarmSensor(0, false, "Back Door Contact Sensor", SensorState::Unknown)
+    };
+    std::set<size_t> counts;
+    for (size_t i = 0; i < updates; ++i)
+    {
+        auto& sensor = sensors[i % 2];
+        sensor.id = i % sensorCount + 1;
+        size_t before = allocations - fileStorageAllocations();
+        auto updated = db.updateSensor(sensor);
+        counts.insert(allocations - fileStorageAllocations() - before);
+        REQUIRE(updated);
+    }
+    return counts;
+}
+
+}
+
+
+SCENARIO( "Test SensorDb allocations", "" )
+{
+    GIVEN( "databases with few and many sensors" )
+    {
+        auto few = updateAllocations(10);
+        auto many = updateAllocations(1000);
+
+        THEN( "an update takes as many allocations however many sensors there are" )
+        {
+            // One count for plain updates, one for those that also compact
+            INFO("few: " << Catch::Detail::stringify(few) << " many: " << Catch::Detail::stringify(many));
+            REQUIRE(few.size() == 2);
+            REQUIRE(few == many);
+            // No more than opening the file to append to takes
+            REQUIRE(*few.begin() <= 1);
+        }
+    }
+}
@@ -2,8 +2,45 @@
 
 #include "SensorDb.h"
 
+#include <mockControl.h>
 #include <SPIFFS.h>
 
+#include <vector>
+
+
+namespace
+{
+
+// The file's header and records, see SensorDb.cpp
+const size_t headerSize = 8;
+const size_t recordSize = 48;
+
+size_t fileSize(const char* path)
+{
+    auto file = SPIFFS.open(path, FILE_READ);
+    auto size = file.size();
+    file.close();
+    return size;
+}
+
+std::vector<uint8_t> readFile(const char* path)
+{
+    auto file = SPIFFS.open(path, FILE_READ);
+    std::vector<uint8_t> data(file.size());
+    file.read(data.data(), data.size());
+    file.close();
+    return data;
+}
+
+void writeFile(const char* path, const std::vector<uint8_t>& data)
+{
+    auto file = SPIFFS.open(path, FILE_WRITE);
+    file.write(data.data(), data.size());
+    file.close();
+}
+
+}
+
 
 SCENARIO( "Test SensorDb", "" )
 {
@@ -21,6 +58,56 @@ SCENARIO( "Test SensorDb", "" )
             REQUIRE(sensorList.empty());
         }
 
+        THEN( "there is only the default zone" )
+        {
+            ZoneList zones;
+            REQUIRE(db.getZones(zones));
+            REQUIRE(zones.size() == 1);
+            REQUIRE(zones[0].id == 0);
+        }
+
+        WHEN( "zones are added and a sensor is put in them" )
+        {
+            REQUIRE(db.updateZone({ 3, "Perimeter" }));
+            REQUIRE(db.updateZone({ 1, "Upstairs" }));
+            REQUIRE(db.updateZone({ 0, "House" }));
+            AlarmSensor sensor(1, true, "Front Door", SensorState::Unknown);
+            sensor.zones = zoneBit(0) | zoneBit(3);
+            REQUIRE(db.storeSensor(sensor));
+
+            THEN( "invalid zone IDs are rejected" )
+            {
+                REQUIRE_FALSE(db.updateZone({ static_cast<uint8_t>(maxZones), "Garage" }));
+            }
+
+            WHEN( "the database is reloaded" )
+            {
+                db = SensorDataBase();
+                REQUIRE(db.begin());
+
+                THEN( "the zones are kept in order with their names" )
+                {
+                    ZoneList zones;
+                    REQUIRE(db.getZones(zones));
+                    REQUIRE(zones.size() == 3);
+                    REQUIRE(zones[0].id == 0);
+                    REQUIRE(zones[0].name == "House");
+                    REQUIRE(zones[1].id == 1);
+                    REQUIRE(zones[1].name == "Upstairs");
+                    REQUIRE(zones[2].id == 3);
+                    REQUIRE(zones[2].name == "Perimeter");
+                }
+
+                THEN( "the sensor keeps its zones" )
+                {
+                    SensorList sensorList;
+                    REQUIRE(db.getAlarmSensors(sensorList));
+                    REQUIRE(sensorList.size() == 1);
+                    REQUIRE(sensorList[0].zones == (zoneBit(0) | zoneBit(3)));
+                }
+            }
+        }
+
         WHEN( "a sensor is added to the database" )
         {
             AlarmSensor sensor(1, true, "Front Door", SensorState::Unknown);
@@ -91,10 +178,214 @@ SCENARIO( "Test SensorDb", "" )
                             REQUIRE(sensorList[1].id == 1234);
                             REQUIRE(sensorList[1].enabled);
                             REQUIRE(sensorList[1].name == testSensorName);
+                            REQUIRE(sensorList[1].zones == defaultZones);
                         }
                     }
                 }
             }
         }
     }
-}
\ No newline at end of file
+}
+
+SCENARIO( "Test SensorDb files written before zones existed", "" )
+{
+    REQUIRE(SPIFFS.format());
+    {
+        auto dbFile = SPIFFS.open("/sensors.db", FILE_WRITE);
+        dbFile.print("{\"sensors\":[{\"id\":\"1\",\"enabled\":\"true\",\"name\":\"Front Door\"}]}");
+        dbFile.close();
+    }
+
+    SensorDataBase db;
+    REQUIRE(db.begin());
+
+    THEN( "the sensors are in the default zone" )
+    {
+        SensorList sensorList;
+        REQUIRE(db.getAlarmSensors(sensorList));
+        REQUIRE(sensorList.size() == 1);
+        REQUIRE(sensorList[0].zones == defaultZones);
+
+        ZoneList zones;
+        REQUIRE(db.getZones(zones));
+        REQUIRE(zones.size() == 1);
+        REQUIRE(zones[0].id == 0);
+    }
+
+    THEN( "the JSON file is replaced by a binary one" )
+    {
+        REQUIRE_FALSE(SPIFFS.exists("/sensors.db"));
+        REQUIRE(fileSize("/sensors.bin") == headerSize + 2 * recordSize);
+
+        db = SensorDataBase();
+        REQUIRE(db.begin());
+        SensorList sensorList;
+        REQUIRE(db.getAlarmSensors(sensorList));
+        REQUIRE(sensorList.size() == 1);
+        REQUIRE(sensorList[0].id == 1);
+        REQUIRE(sensorList[0].enabled);
+        REQUIRE(sensorList[0].name == "Front Door");
+    }
+}
+
+SCENARIO( "Test SensorDb journal", "" )
+{
+    REQUIRE(SPIFFS.format());
+    SensorDataBase db;
+    REQUIRE(db.begin());
+
+    GIVEN( "a database with a few sensors" )
+    {
+        for (uint64_t id = 1; id <= 4; ++id)
+        {
+            REQUIRE(db.storeSensor(AlarmSensor(id, true, "Sensor", SensorState::Unknown)));
+        }
+        auto sizeBefore = fileSize("/sensors.bin");
+
+        WHEN( "a sensor is renamed" )
+        {
+            resetFileBytesWritten();
+            REQUIRE(db.updateSensor(AlarmSensor(2, true, "Back Door", SensorState::Unknown)));
+
+            THEN( "only its record is written" )
+            {
+                REQUIRE(fileBytesWritten() == recordSize);
+                REQUIRE(fileSize("/sensors.bin") == sizeBefore + recordSize);
+            }
+
+            THEN( "each sensor is read once, with its latest record" )
+            {
+                std::vector<AlarmSensor> visited;
+                REQUIRE(db.forEachSensor([&visited](AlarmSensor&& sensor) { visited.push_back(std::move(sensor)); }));
+                REQUIRE(db.sensorCount() == 4);
+                REQUIRE(visited.size() == 4);
+                // The renamed sensor's record is now the last one
+                REQUIRE(visited.back().id == 2);
+                REQUIRE(visited.back().name == "Back Door");
+                for (size_t i = 0; i < 3; ++i)
+                {
+                    REQUIRE(visited[i].id != 2);
+                    REQUIRE(visited[i].name == "Sensor");
+                }
+            }
+        }
+
+        WHEN( "a name is too long for a record" )
+        {
+            THEN( "it is rejected" )
+            {
+                String longName(std::string(SensorDataBase::maxNameLength + 1, 'x').c_str());
+                REQUIRE_FALSE(db.updateSensor(AlarmSensor(2, true, longName, SensorState::Unknown)));
+                REQUIRE_FALSE(db.storeSensor(AlarmSensor(5, true, longName, SensorState::Unknown)));
+                REQUIRE_FALSE(db.updateZone({ 1, longName }));
+
+                String maxName(std::string(SensorDataBase::maxNameLength, 'x').c_str());
+                REQUIRE(db.updateSensor(AlarmSensor(2, true, maxName, SensorState::Unknown)));
+                db = SensorDataBase();
+                REQUIRE(db.begin());
+                SensorList sensorList;
+                REQUIRE(db.getAlarmSensors(sensorList));
+                REQUIRE(sensorList[1].name == maxName);
+            }
+        }
+
+        WHEN( "sensors are updated many times" )
+        {
+            for (int i = 0; i < 200; ++i)
+            {
+                REQUIRE(db.updateSensor(AlarmSensor(1 + i % 4, i % 2 == 0, String("Sensor ") + String(i), SensorState::Unknown)));
+            }
+
+            THEN( "the file is compacted" )
+            {
+                // 4 sensors and the default zone, plus the slack
+                REQUIRE(fileSize("/sensors.bin") <= headerSize + (2 * 5 + 32 + 1) * recordSize);
+                REQUIRE_FALSE(SPIFFS.exists("/sensors.tmp"));
+            }
+
+            THEN( "the last updates are loaded" )
+            {
+                db = SensorDataBase();
+                REQUIRE(db.begin());
+                SensorList sensorList;
+                REQUIRE(db.getAlarmSensors(sensorList));
+                REQUIRE(sensorList.size() == 4);
+                for (int i = 196; i < 200; ++i)
+                {
+                    const auto& sensor = sensorList[i % 4];
+                    REQUIRE(sensor.id == static_cast<uint64_t>(1 + i % 4));
+                    REQUIRE(sensor.enabled == (i % 2 == 0));
+                    REQUIRE(sensor.name == String("Sensor ") + String(i));
+                }
+            }
+        }
+
+        WHEN( "a write was cut short" )
+        {
+            REQUIRE(db.updateSensor(AlarmSensor(2, false, "Back Door", SensorState::Unknown)));
+            auto data = readFile("/sensors.bin");
+            data.resize(data.size() - recordSize / 2);
+            writeFile("/sensors.bin", data);
+
+            db = SensorDataBase();
+            REQUIRE(db.begin());
+
+            THEN( "the partial record is ignored" )
+            {
+                SensorList sensorList;
+                REQUIRE(db.getAlarmSensors(sensorList));
+                REQUIRE(sensorList.size() == 4);
+                REQUIRE(sensorList[1].enabled);
+                REQUIRE(sensorList[1].name == "Sensor");
+            }
+
+            THEN( "the file is repaired so later updates are kept" )
+            {
+                REQUIRE((fileSize("/sensors.bin") - headerSize) % recordSize == 0);
+                REQUIRE(db.updateSensor(AlarmSensor(3, false, "Window", SensorState::Unknown)));
+                db = SensorDataBase();
+                REQUIRE(db.begin());
+                SensorList sensorList;
+                REQUIRE(db.getAlarmSensors(sensorList));
+                REQUIRE(sensorList[2].name == "Window");
+            }
+        }
+
+        WHEN( "the last record is corrupt" )
+        {
+            REQUIRE(db.updateSensor(AlarmSensor(2, false, "Back Door", SensorState::Unknown)));
+            auto data = readFile("/sensors.bin");
+            data[data.size() - recordSize + 20] ^= 0x01;
+            writeFile("/sensors.bin", data);
+
+            db = SensorDataBase();
+            REQUIRE(db.begin());
+
+            THEN( "it fails its CRC and is ignored" )
+            {
+                SensorList sensorList;
+                REQUIRE(db.getAlarmSensors(sensorList));
+                REQUIRE(sensorList.size() == 4);
+                REQUIRE(sensorList[1].enabled);
+                REQUIRE(sensorList[1].name == "Sensor");
+            }
+        }
+
+        WHEN( "compaction was interrupted after removing the old file" )
+        {
+            REQUIRE(SPIFFS.rename("/sensors.bin", "/sensors.tmp"));
+
+            db = SensorDataBase();
+            REQUIRE(db.begin());
+
+            THEN( "the compacted file is used" )
+            {
+                REQUIRE(SPIFFS.exists("/sensors.bin"));
+                REQUIRE_FALSE(SPIFFS.exists("/sensors.tmp"));
+                SensorList sensorList;
+                REQUIRE(db.getAlarmSensors(sensorList));
+                REQUIRE(sensorList.size() == 4);
+            }
+        }
+    }
+}
@@ -0,0 +1,120 @@
+#include <catch.hpp>
+
+#include "SensorDeadlines.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+
+SCENARIO( "Test SensorDeadlines", "" )
+{
+    auto deadlines = std::make_unique<SensorDeadlines>();
+    std::vector<uint64_t> expired;
+    unsigned long deadline = 0;
+
+    GIVEN( "no sensors" )
+    {
+        THEN( "nothing is due" )
+        {
+            REQUIRE_FALSE(deadlines->nextDeadline(deadline));
+            deadlines->popExpired(1000000, expired);
+            REQUIRE(expired.empty());
+        }
+    }
+
+    GIVEN( "sensors with deadlines" )
+    {
+        deadlines->set(1, 3000);
+        deadlines->set(2, 1000);
+        deadlines->set(3, 2000);
+
+        THEN( "they expire earliest first" )
+        {
+            REQUIRE(deadlines->nextDeadline(deadline));
+            REQUIRE(deadline == 1000);
+            deadlines->popExpired(999, expired);
+            REQUIRE(expired.empty());
+            deadlines->popExpired(2000, expired);
+            REQUIRE(expired == std::vector<uint64_t>{ 2, 3 });
+            REQUIRE(deadlines->size() == 1);
+        }
+
+        THEN( "a deadline can be moved" )
+        {
+            deadlines->set(2, 4000);
+            deadlines->set(1, 500);
+            deadlines->popExpired(5000, expired);
+            REQUIRE(expired == std::vector<uint64_t>{ 1, 3, 2 });
+        }
+
+        THEN( "a sensor can be removed and added back" )
+        {
+            deadlines->remove(2);
+            deadlines->remove(2);
+            REQUIRE(deadlines->size() == 2);
+            deadlines->set(2, 2500);
+            deadlines->popExpired(5000, expired);
+            REQUIRE(expired == std::vector<uint64_t>{ 3, 2, 1 });
+        }
+
+        THEN( "clearing removes every deadline" )
+        {
+            deadlines->clear();
+            REQUIRE(deadlines->size() == 0);
+            deadlines->set(1, 100);
+            REQUIRE(deadlines->size() == 1);
+        }
+    }
+
+    GIVEN( "deadlines either side of the millis() rollover" )
+    {
+        deadlines->set(1, 500);
+        deadlines->set(2, 0xFFFFFFFF - 500);
+
+        THEN( "the one before the rollover is due first" )
+        {
+            deadlines->popExpired(0xFFFFFFFF, expired);
+            REQUIRE(expired == std::vector<uint64_t>{ 2 });
+            deadlines->popExpired(500, expired);
+            REQUIRE(expired == std::vector<uint64_t>{ 2, 1 });
+        }
+    }
+
+    GIVEN( "many sensors whose deadlines keep moving" )
+    {
+        std::mt19937 random(1234);
+        std::vector<uint32_t> expected(1000, 0);
+        for (uint64_t id = 0; id < expected.size(); ++id)
+        {
+            expected[id] = random() % 100000;
+            deadlines->set(id + 1, expected[id]);
+        }
+        for (auto i = 0; i < 5000; ++i)
+        {
+            auto id = random() % expected.size();
+            if (random() % 10 == 0)
+            {
+                deadlines->remove(id + 1);
+                expected[id] = 0xFFFFFFFF;
+            }
+            else
+            {
+                expected[id] = random() % 100000;
+                deadlines->set(id + 1, expected[id]);
+            }
+        }
+
+        THEN( "they still expire in deadline order" )
+        {
+            deadlines->popExpired(100000, expired);
+            auto remaining = std::count_if(expected.begin(), expected.end(), [](uint32_t d) { return d != 0xFFFFFFFF; });
+            REQUIRE(expired.size() == static_cast<size_t>(remaining));
+            for (size_t i = 1; i < expired.size(); ++i)
+            {
+                REQUIRE(expected[expired[i - 1] - 1] <= expected[expired[i] - 1]);
+            }
+        }
+    }
+}
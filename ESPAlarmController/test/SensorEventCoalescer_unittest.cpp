@@ -0,0 +1,91 @@
+#include <catch.hpp>
+
+#include "SensorEventCoalescer.h"
+
+
+SCENARIO( "Test SensorEventCoalescer", "" )
+{
+    SensorEventCoalescer coalescer;
+
+    GIVEN( "a sensor that has not reported" )
+    {
+        THEN( "its report is not merged" )
+        {
+            REQUIRE_FALSE(coalescer.merge(1, SensorState::Closed, 0, 0));
+            REQUIRE(coalescer.mergedEvents() == 0);
+        }
+    }
+
+    GIVEN( "a sensor with a closed event in the queue" )
+    {
+        coalescer.queued(1, SensorState::Closed, 5);
+
+        THEN( "another closed report is merged while the event is still queued" )
+        {
+            REQUIRE(coalescer.merge(1, SensorState::Closed, 5, 6));
+            REQUIRE(coalescer.merge(1, SensorState::Closed, 3, 8));
+            REQUIRE(coalescer.mergedEvents() == 2);
+        }
+
+        THEN( "a state change is not merged" )
+        {
+            REQUIRE_FALSE(coalescer.merge(1, SensorState::Open, 5, 6));
+            REQUIRE_FALSE(coalescer.merge(1, SensorState::Fault, 5, 6));
+        }
+
+        THEN( "another sensor's report is not merged" )
+        {
+            REQUIRE_FALSE(coalescer.merge(2, SensorState::Closed, 5, 6));
+        }
+
+        THEN( "a closed report is not merged once the event has been handled" )
+        {
+            REQUIRE_FALSE(coalescer.merge(1, SensorState::Closed, 6, 6));
+            REQUIRE_FALSE(coalescer.merge(1, SensorState::Closed, 6, 9));
+            REQUIRE(coalescer.mergedEvents() == 0);
+        }
+    }
+
+    GIVEN( "a queued event for a sensor that is forgotten" )
+    {
+        coalescer.queued(1, SensorState::Closed, 5);
+        coalescer.forget(1);
+
+        THEN( "reports are not merged with it" )
+        {
+            REQUIRE_FALSE(coalescer.merge(1, SensorState::Closed, 5, 6));
+        }
+
+        THEN( "reports are merged again with the next event queued" )
+        {
+            coalescer.queued(1, SensorState::Closed, 6);
+            REQUIRE(coalescer.merge(1, SensorState::Closed, 5, 7));
+        }
+    }
+
+    GIVEN( "an event queued just before the sequence numbers wrap" )
+    {
+        coalescer.queued(1, SensorState::Open, 0xFFFFFFFF);
+
+        THEN( "reports are merged until it has been handled" )
+        {
+            REQUIRE(coalescer.merge(1, SensorState::Open, 0xFFFFFFFE, 2));
+            REQUIRE_FALSE(coalescer.merge(1, SensorState::Open, 0, 2));
+        }
+    }
+
+    GIVEN( "more sensors than the coalescer tracks" )
+    {
+        const uint64_t sensors = SensorEventCoalescer::maxSensors + 10;
+        for (uint64_t id = 1; id <= sensors; ++id)
+        {
+            coalescer.queued(id, SensorState::Closed, static_cast<uint32_t>(id));
+        }
+
+        THEN( "tracked sensors are still merged and the rest pass through" )
+        {
+            REQUIRE(coalescer.merge(1, SensorState::Closed, 0, 2 * sensors));
+            REQUIRE_FALSE(coalescer.merge(sensors, SensorState::Closed, 0, 2 * sensors));
+        }
+    }
+}
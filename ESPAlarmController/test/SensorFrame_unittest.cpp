@@ -0,0 +1,234 @@
+#include <catch.hpp>
+
+#include "protocol.h"
+
+
+SCENARIO( "Test SensorFrame", "" )
+{
+    GIVEN( "the CRC check string" )
+    {
+        THEN( "the CRC matches CRC-16/CCITT-FALSE" )
+        {
+            REQUIRE(SensorFrame::crc16(reinterpret_cast<const uint8_t*>("123456789"), 9) == 0x29B1);
+        }
+    }
+
+    GIVEN( "a version 2 frame" )
+    {
+        SensorFrame frame;
+        frame.wakeupReason = ESP_SLEEP_WAKEUP_EXT0;
+        frame.state = SensorState::Open;
+        frame.vccMillivolts = 3291;
+        frame.sequence = 0xBEEF;
+        frame.sequenceReset = true;
+
+        uint8_t buffer[32];
+        auto len = frame.encode(buffer, sizeof(buffer));
+
+        THEN( "it encodes to the fixed layout" )
+        {
+            REQUIRE(len == sensorFrameSize);
+            REQUIRE(buffer[0] == sensorFrameVersion);
+            REQUIRE(buffer[1] == static_cast<uint8_t>(SensorFrame::Type::StateReport));
+            REQUIRE(buffer[2] == (SensorState::Open | SensorFrame::flagSequenceReset));
+            REQUIRE(buffer[3] == ESP_SLEEP_WAKEUP_EXT0);
+            REQUIRE(buffer[4] == (3291 & 0xFF));
+            REQUIRE(buffer[5] == (3291 >> 8));
+            REQUIRE(buffer[6] == 0xEF);
+            REQUIRE(buffer[7] == 0xBE);
+        }
+
+        THEN( "it does not encode into a buffer that is too small" )
+        {
+            REQUIRE(frame.encode(buffer, sensorFrameSize - 1) == 0);
+        }
+
+        THEN( "it decodes to the same values" )
+        {
+            SensorFrame decoded;
+            REQUIRE(decoded.decode(buffer, len));
+            REQUIRE(decoded.version == sensorFrameVersion);
+            REQUIRE(decoded.type == SensorFrame::Type::StateReport);
+            REQUIRE(decoded.wakeupReason == ESP_SLEEP_WAKEUP_EXT0);
+            REQUIRE(decoded.state == SensorState::Open);
+            REQUIRE(decoded.vccMillivolts == 3291);
+            REQUIRE(decoded.sequence == 0xBEEF);
+            REQUIRE(decoded.sequenceReset);
+
+            auto state = decoded.toSensorState();
+            REQUIRE(state.state == SensorState::Open);
+            REQUIRE(state.vcc == Approx(3.291));
+        }
+
+        THEN( "any single bit error is rejected" )
+        {
+            for (size_t bit = 0; bit < len * 8; ++bit)
+            {
+                uint8_t corrupted[sensorFrameSize];
+                memcpy(corrupted, buffer, len);
+                corrupted[bit / 8] ^= 1 << (bit % 8);
+                SensorFrame decoded;
+                REQUIRE_FALSE(decoded.decode(corrupted, len));
+            }
+        }
+
+        THEN( "truncated frames are rejected" )
+        {
+            SensorFrame decoded;
+            for (size_t i = 0; i < len; ++i)
+            {
+                REQUIRE_FALSE(decoded.decode(buffer, i));
+            }
+        }
+    }
+
+    GIVEN( "a batch of state changes" )
+    {
+        SensorFrame frame;
+        frame.type = SensorFrame::Type::BatchReport;
+        frame.wakeupReason = ESP_SLEEP_WAKEUP_TIMER;
+        frame.vccMillivolts = 3100;
+        frame.sequence = 300;
+        frame.edgeCount = 3;
+        frame.edges[0] = { SensorState::Open, 1500 };
+        frame.edges[1] = { SensorState::Closed, 700 };
+        frame.edges[2] = { SensorState::Open, 0 };
+
+        uint8_t buffer[sensorBatchFrameSize(SensorFrame::maxEdges)];
+        auto len = frame.encode(buffer, sizeof(buffer));
+
+        THEN( "the header carries the last state" )
+        {
+            REQUIRE(len == sensorBatchFrameSize(3));
+            REQUIRE(buffer[1] == static_cast<uint8_t>(SensorFrame::Type::BatchReport));
+            REQUIRE(buffer[2] == SensorState::Open);
+            REQUIRE(buffer[8] == 3);
+        }
+
+        THEN( "it decodes to the same changes in order" )
+        {
+            SensorFrame decoded;
+            REQUIRE(decoded.decode(buffer, len));
+            REQUIRE(decoded.type == SensorFrame::Type::BatchReport);
+            REQUIRE(decoded.state == SensorState::Open);
+            REQUIRE(decoded.sequence == 300);
+            REQUIRE(decoded.edgeCount == 3);
+            for (size_t i = 0; i < 3; ++i)
+            {
+                REQUIRE(decoded.edges[i].state == frame.edges[i].state);
+                REQUIRE(decoded.edges[i].ageMs == frame.edges[i].ageMs);
+            }
+        }
+
+        THEN( "any single bit error is rejected" )
+        {
+            for (size_t bit = 0; bit < len * 8; ++bit)
+            {
+                uint8_t corrupted[sizeof(buffer)];
+                memcpy(corrupted, buffer, len);
+                corrupted[bit / 8] ^= 1 << (bit % 8);
+                SensorFrame decoded;
+                REQUIRE_FALSE(decoded.decode(corrupted, len));
+            }
+        }
+
+        THEN( "truncated frames are rejected" )
+        {
+            SensorFrame decoded;
+            for (size_t i = sensorFrameSize + 1; i < len; ++i)
+            {
+                REQUIRE_FALSE(decoded.decode(buffer, i));
+            }
+        }
+
+        THEN( "a count that does not match the length is rejected" )
+        {
+            buffer[8] = 2;
+            auto crc = SensorFrame::crc16(buffer, len - 2);
+            buffer[len - 2] = crc & 0xFF;
+            buffer[len - 1] = crc >> 8;
+            SensorFrame decoded;
+            REQUIRE_FALSE(decoded.decode(buffer, len));
+        }
+
+        THEN( "a header state that is not the last change is rejected" )
+        {
+            buffer[2] = SensorState::Closed;
+            auto crc = SensorFrame::crc16(buffer, len - 2);
+            buffer[len - 2] = crc & 0xFF;
+            buffer[len - 1] = crc >> 8;
+            SensorFrame decoded;
+            REQUIRE_FALSE(decoded.decode(buffer, len));
+        }
+
+        THEN( "batches that are too small or too large do not encode" )
+        {
+            frame.edgeCount = 1;
+            REQUIRE(frame.encode(buffer, sizeof(buffer)) == 0);
+            frame.edgeCount = SensorFrame::maxEdges + 1;
+            REQUIRE(frame.encode(buffer, sizeof(buffer)) == 0);
+            frame.edgeCount = 3;
+            REQUIRE(frame.encode(buffer, sensorBatchFrameSize(3) - 1) == 0);
+        }
+    }
+
+    GIVEN( "a batch whose bytes after the header also read as a version 1 state" )
+    {
+        SensorFrame frame;
+        frame.type = SensorFrame::Type::BatchReport;
+        frame.wakeupReason = ESP_SLEEP_WAKEUP_TIMER;
+        frame.vccMillivolts = 0;
+        frame.sequence = 0;
+        frame.edgeCount = 2;
+        frame.edges[0] = { SensorState::Closed, 300 };
+        frame.edges[1] = { SensorState::Open, 0 };
+
+        uint8_t buffer[sensorBatchFrameSize(SensorFrame::maxEdges)];
+        auto len = frame.encode(buffer, sizeof(buffer));
+        REQUIRE(len > sensorFrameV1Size);
+
+        THEN( "any single bit error is rejected, not decoded as version 1" )
+        {
+            for (size_t bit = 0; bit < len * 8; ++bit)
+            {
+                uint8_t corrupted[sizeof(buffer)];
+                memcpy(corrupted, buffer, len);
+                corrupted[bit / 8] ^= 1 << (bit % 8);
+                SensorFrame decoded;
+                REQUIRE_FALSE(decoded.decode(corrupted, len));
+            }
+        }
+    }
+
+    GIVEN( "a legacy version 1 frame" )
+    {
+        SensorState state{ESP_SLEEP_WAKEUP_TIMER, SensorState::Closed, 3.3};
+
+        THEN( "it is still accepted" )
+        {
+            SensorFrame decoded;
+            REQUIRE(decoded.decode(reinterpret_cast<const uint8_t*>(&state), sizeof(state)));
+            REQUIRE(decoded.version == 1);
+            REQUIRE(decoded.state == SensorState::Closed);
+            REQUIRE(decoded.wakeupReason == ESP_SLEEP_WAKEUP_TIMER);
+            REQUIRE(decoded.vccMillivolts == 3300);
+            REQUIRE(decoded.sequence == 0);
+            REQUIRE_FALSE(decoded.sequenceReset);
+        }
+
+        THEN( "an invalid state is rejected" )
+        {
+            state.state = static_cast<SensorState::State>(42);
+            SensorFrame decoded;
+            REQUIRE_FALSE(decoded.decode(reinterpret_cast<const uint8_t*>(&state), sizeof(state)));
+        }
+
+        THEN( "a frame with trailing bytes is rejected" )
+        {
+            uint8_t buffer[sizeof(state) + 1] = {};
+            memcpy(buffer, &state, sizeof(state));
+            SensorFrame decoded;
+            REQUIRE_FALSE(decoded.decode(buffer, sizeof(buffer)));
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#include <catch.hpp>
+
+#include "SensorIdSet.h"
+
+#include <memory>
+
+
+using Membership = SensorIdSet::Membership;
+
+
+SCENARIO( "Test SensorIdSet", "" )
+{
+    auto sensorIds = std::make_unique<SensorIdSet>();
+
+    GIVEN( "an empty set" )
+    {
+        REQUIRE(sensorIds->size() == 0);
+        REQUIRE(sensorIds->find(0x30AEA405CE1C) == Membership::Unknown);
+
+        WHEN( "sensors are added" )
+        {
+            REQUIRE(sensorIds->set(0x30AEA405CE1C, false));
+            REQUIRE(sensorIds->set(0x30AEA405CEAB, true));
+
+            THEN( "they are found with their enabled state" )
+            {
+                REQUIRE(sensorIds->size() == 2);
+                REQUIRE(sensorIds->find(0x30AEA405CE1C) == Membership::Disabled);
+                REQUIRE(sensorIds->find(0x30AEA405CEAB) == Membership::Enabled);
+                REQUIRE(sensorIds->find(0x30AEA405CE00) == Membership::Unknown);
+            }
+
+            THEN( "a sensor can be enabled and disabled" )
+            {
+                REQUIRE(sensorIds->set(0x30AEA405CE1C, true));
+                REQUIRE(sensorIds->find(0x30AEA405CE1C) == Membership::Enabled);
+                REQUIRE(sensorIds->set(0x30AEA405CE1C, false));
+                REQUIRE(sensorIds->find(0x30AEA405CE1C) == Membership::Disabled);
+                REQUIRE(sensorIds->size() == 2);
+            }
+        }
+
+        WHEN( "the set is filled" )
+        {
+            for (uint64_t id = 1; id <= SensorIdSet::maxSensors; ++id)
+            {
+                REQUIRE(sensorIds->set(id, (id & 1) != 0));
+            }
+
+            THEN( "every sensor can be found" )
+            {
+                for (uint64_t id = 1; id <= SensorIdSet::maxSensors; ++id)
+                {
+                    REQUIRE(sensorIds->find(id) == ((id & 1) != 0 ? Membership::Enabled : Membership::Disabled));
+                }
+            }
+
+            THEN( "sensors never added are still unknown" )
+            {
+                for (uint64_t id = 0x246F28000000; id < 0x246F28000000 + 1000; ++id)
+                {
+                    REQUIRE(sensorIds->find(id) == Membership::Unknown);
+                }
+            }
+
+            THEN( "no more sensors fit" )
+            {
+                REQUIRE_FALSE(sensorIds->set(SensorIdSet::maxSensors + 1, true));
+                REQUIRE(sensorIds->find(SensorIdSet::maxSensors + 1) == Membership::Unknown);
+                REQUIRE(sensorIds->set(5, false));
+            }
+        }
+    }
+}
@@ -0,0 +1,168 @@
+#include <catch.hpp>
+
+#include "SensorLinkStats.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+
+namespace
+{
+
+SensorFrame makeFrame(uint16_t sequence, uint16_t vccMillivolts, bool sequenceReset = false)
+{
+    SensorFrame frame;
+    frame.state = SensorState::Closed;
+    frame.sequence = sequence;
+    frame.sequenceReset = sequenceReset;
+    frame.vccMillivolts = vccMillivolts;
+    return frame;
+}
+
+}
+
+
+SCENARIO( "Test SensorLinkStats", "" )
+{
+    auto linkStats = std::make_unique<SensorLinkStats>();
+    SensorLinkStats::Stats stats;
+
+    GIVEN( "a sensor that has not reported" )
+    {
+        THEN( "it has no stats" )
+        {
+            REQUIRE_FALSE(linkStats->get(1, stats));
+        }
+
+        THEN( "invalid frames from it are not tracked" )
+        {
+            linkStats->recordInvalidFrame(1);
+            REQUIRE_FALSE(linkStats->get(1, stats));
+        }
+    }
+
+    GIVEN( "a sensor reporting every 30 seconds" )
+    {
+        unsigned long now = 1000;
+        for (uint16_t sequence = 100; sequence < 110; ++sequence)
+        {
+            linkStats->recordFrame(1, makeFrame(sequence, 3300 - sequence), now);
+            now += 30000;
+        }
+
+        THEN( "the frames and intervals are counted" )
+        {
+            REQUIRE(linkStats->get(1, stats));
+            REQUIRE(stats.framesReceived == 10);
+            REQUIRE(stats.framesLost == 0);
+            REQUIRE(stats.framesRepeated == 0);
+            REQUIRE(stats.lastFrameMs == now - 30000);
+            REQUIRE(stats.meanIntervalMs == 30000);
+            REQUIRE(stats.intervalJitterMs == 0);
+        }
+
+        THEN( "the last and lowest battery voltage are kept" )
+        {
+            REQUIRE(linkStats->get(1, stats));
+            REQUIRE(stats.lastVccMillivolts == 3300 - 109);
+            REQUIRE(stats.minVccMillivolts == 3300 - 109);
+        }
+
+        THEN( "gaps in the sequence numbers are counted as lost" )
+        {
+            linkStats->recordFrame(1, makeFrame(113, 3300), now);
+            REQUIRE(linkStats->get(1, stats));
+            REQUIRE(stats.framesLost == 3);
+            REQUIRE(stats.minVccMillivolts == 3300 - 109);
+            REQUIRE(stats.lastVccMillivolts == 3300);
+        }
+
+        THEN( "retries are counted as repeated and don't skew the intervals" )
+        {
+            linkStats->recordFrame(1, makeFrame(109, 3300), now);
+            linkStats->recordFrame(1, makeFrame(105, 3300), now);
+            REQUIRE(linkStats->get(1, stats));
+            REQUIRE(stats.framesReceived == 12);
+            REQUIRE(stats.framesRepeated == 2);
+            REQUIRE(stats.meanIntervalMs == 30000);
+            REQUIRE(stats.lastFrameMs == now - 30000);
+        }
+
+        THEN( "irregular intervals show up as jitter" )
+        {
+            linkStats->recordFrame(1, makeFrame(110, 3300), now - 30000 + 14000);
+            linkStats->recordFrame(1, makeFrame(111, 3300), now - 30000 + 60000);
+            REQUIRE(linkStats->get(1, stats));
+            REQUIRE(stats.intervalJitterMs > 0);
+            REQUIRE(stats.meanIntervalMs != 30000);
+        }
+
+        THEN( "a sensor reboot does not count as lost frames" )
+        {
+            linkStats->recordFrame(1, makeFrame(7, 3300, true), now);
+            REQUIRE(linkStats->get(1, stats));
+            REQUIRE(stats.framesLost == 0);
+            REQUIRE(stats.framesReceived == 11);
+        }
+
+        THEN( "invalid frames are counted" )
+        {
+            linkStats->recordInvalidFrame(1);
+            REQUIRE(linkStats->get(1, stats));
+            REQUIRE(stats.framesInvalid == 1);
+            REQUIRE(stats.framesReceived == 10);
+        }
+    }
+
+    GIVEN( "more sensors than the table holds" )
+    {
+        for (uint64_t id = 1; id <= SensorLinkStats::maxSensors + 10; ++id)
+        {
+            linkStats->recordFrame(id, makeFrame(1, 3300), 0);
+        }
+
+        THEN( "the sensors that fit are tracked" )
+        {
+            REQUIRE(linkStats->get(1, stats));
+            REQUIRE(linkStats->get(SensorLinkStats::maxSensors, stats));
+            REQUIRE_FALSE(linkStats->get(SensorLinkStats::maxSensors + 1, stats));
+        }
+    }
+}
+
+SCENARIO( "Read SensorLinkStats while the receive callback updates it", "" )
+{
+    auto linkStats = std::make_unique<SensorLinkStats>();
+    const uint32_t frames = 100000;
+
+    // Every frame moves all the stats in step, so a torn read would show
+    // fields from different frames.
+    std::atomic<bool> done(false);
+    std::thread writer([&]() {
+        for (uint32_t i = 1; i <= frames; ++i)
+        {
+            linkStats->recordFrame(1, makeFrame(static_cast<uint16_t>(i), static_cast<uint16_t>(i % 60000 + 1)), i * 10);
+        }
+        done = true;
+    });
+
+    bool consistent = true;
+    while (!done)
+    {
+        SensorLinkStats::Stats stats;
+        if (linkStats->get(1, stats) && stats.framesReceived > 0)
+        {
+            consistent = consistent &&
+                stats.lastFrameMs == stats.framesReceived * 10 &&
+                stats.lastVccMillivolts == stats.framesReceived % 60000 + 1;
+        }
+    }
+    writer.join();
+
+    REQUIRE(consistent);
+    SensorLinkStats::Stats stats;
+    REQUIRE(linkStats->get(1, stats));
+    REQUIRE(stats.framesReceived == frames);
+    REQUIRE(stats.framesLost == 0);
+}
@@ -0,0 +1,114 @@
+#include <catch.hpp>
+
+#include "SensorSequenceFilter.h"
+
+#include <memory>
+
+
+using Result = SensorSequenceFilter::Result;
+
+
+SCENARIO( "Test SensorSequenceFilter", "" )
+{
+    auto filter = std::make_unique<SensorSequenceFilter>();
+
+    GIVEN( "a sensor that has not reported" )
+    {
+        THEN( "any sequence number is accepted" )
+        {
+            REQUIRE(filter->accept(1, 1234, false) == Result::Accepted);
+        }
+    }
+
+    GIVEN( "a sensor that has reported" )
+    {
+        REQUIRE(filter->accept(1, 10, false) == Result::Accepted);
+
+        THEN( "newer frames are accepted" )
+        {
+            REQUIRE(filter->accept(1, 11, false) == Result::Accepted);
+            REQUIRE(filter->accept(1, 15, false) == Result::Accepted);
+            REQUIRE(filter->accept(1, 1000, false) == Result::Accepted);
+        }
+
+        THEN( "a retransmitted frame is dropped as a duplicate" )
+        {
+            REQUIRE(filter->accept(1, 10, false) == Result::Duplicate);
+            REQUIRE(filter->accept(1, 11, false) == Result::Accepted);
+            REQUIRE(filter->accept(1, 10, false) == Result::Duplicate);
+            REQUIRE(filter->stats().duplicates == 2);
+        }
+
+        THEN( "a late frame is dropped as out of order, then as a duplicate" )
+        {
+            REQUIRE(filter->accept(1, 12, false) == Result::Accepted);
+            REQUIRE(filter->accept(1, 11, false) == Result::OutOfOrder);
+            REQUIRE(filter->accept(1, 11, false) == Result::Duplicate);
+            REQUIRE(filter->stats().outOfOrder == 1);
+        }
+
+        THEN( "frames older than the window are dropped as stale" )
+        {
+            REQUIRE(filter->accept(1, 10 + SensorSequenceFilter::sequenceWindowSize, false) == Result::Accepted);
+            REQUIRE(filter->accept(1, 10, false) == Result::Stale);
+            REQUIRE(filter->accept(1, 9, false) == Result::Stale);
+            REQUIRE(filter->stats().stale == 2);
+        }
+
+        THEN( "a sequence reset restarts the window" )
+        {
+            REQUIRE(filter->accept(1, 0, true) == Result::Accepted);
+            REQUIRE(filter->accept(1, 1, false) == Result::Accepted);
+            REQUIRE(filter->accept(1, 0, false) == Result::Duplicate);
+        }
+
+        THEN( "a forgotten frame is accepted when it is retried" )
+        {
+            REQUIRE(filter->accept(1, 11, false) == Result::Accepted);
+            filter->forget(1, 11);
+            REQUIRE(filter->accept(1, 11, false) == Result::Accepted);
+            REQUIRE(filter->accept(1, 11, false) == Result::Duplicate);
+        }
+
+        THEN( "other sensors have their own windows" )
+        {
+            REQUIRE(filter->accept(2, 10, false) == Result::Accepted);
+            REQUIRE(filter->accept(2, 9, false) == Result::OutOfOrder);
+        }
+    }
+
+    GIVEN( "a sensor whose sequence number wraps" )
+    {
+        REQUIRE(filter->accept(1, 0xFFFE, false) == Result::Accepted);
+        REQUIRE(filter->accept(1, 0xFFFF, false) == Result::Accepted);
+
+        THEN( "frames after the wrap are accepted" )
+        {
+            REQUIRE(filter->accept(1, 0, false) == Result::Accepted);
+            REQUIRE(filter->accept(1, 1, false) == Result::Accepted);
+            REQUIRE(filter->accept(1, 0xFFFF, false) == Result::Duplicate);
+        }
+    }
+
+    GIVEN( "more sensors than the table holds" )
+    {
+        for (uint64_t id = 1; id <= SensorSequenceFilter::maxSensors; ++id)
+        {
+            REQUIRE(filter->accept(id, 5, false) == Result::Accepted);
+        }
+
+        THEN( "the tracked sensors are still filtered" )
+        {
+            REQUIRE(filter->accept(1, 5, false) == Result::Duplicate);
+            REQUIRE(filter->stats().untracked == 0);
+        }
+
+        THEN( "frames from untracked sensors are let through" )
+        {
+            auto untrackedId = SensorSequenceFilter::maxSensors + 1;
+            REQUIRE(filter->accept(untrackedId, 5, false) == Result::Accepted);
+            REQUIRE(filter->accept(untrackedId, 5, false) == Result::Accepted);
+            REQUIRE(filter->stats().untracked == 2);
+        }
+    }
+}
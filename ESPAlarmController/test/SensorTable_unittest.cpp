@@ -0,0 +1,103 @@
+#include <catch.hpp>
+
+#include "AlarmSensor.h"
+
+#include <map>
+
+
+SCENARIO( "Test SensorTable", "" )
+{
+    GIVEN( "an empty table" )
+    {
+        SensorMap sensors;
+
+        REQUIRE(sensors.empty());
+        REQUIRE(sensors.size() == 0);
+        REQUIRE(sensors.begin() == sensors.end());
+        REQUIRE(sensors.find(1) == sensors.end());
+
+        WHEN( "a sensor is added with operator[]" )
+        {
+            sensors[0x30AEA405CE1C].name = "Front Door";
+
+            THEN( "it can be found" )
+            {
+                REQUIRE(sensors.size() == 1);
+                auto it = sensors.find(0x30AEA405CE1C);
+                REQUIRE(it != sensors.end());
+                REQUIRE(it->first == 0x30AEA405CE1C);
+                REQUIRE(it->second.name == "Front Door");
+                REQUIRE(sensors.count(0x30AEA405CE1C) == 1);
+                REQUIRE(sensors.count(0x30AEA405CEAB) == 0);
+            }
+
+            THEN( "inserting the same ID again keeps the existing sensor" )
+            {
+                auto result = sensors.insert(0x30AEA405CE1C, AlarmSensor(0x30AEA405CE1C, true, "Back Door", SensorState::Closed));
+                REQUIRE_FALSE(result.second);
+                REQUIRE(result.first->second.name == "Front Door");
+                REQUIRE(sensors.size() == 1);
+            }
+        }
+
+        WHEN( "many sensors are added in random order" )
+        {
+            std::map<uint64_t, String> expected;
+            uint64_t id = 0x30AEA4000000;
+            for (auto i = 0; i < 1000; ++i)
+            {
+                id = (id * 6364136223846793005ull + 1442695040888963407ull) & 0xFFFFFFFFFFFFull;
+                auto name = String(i);
+                sensors[id].name = name;
+                expected[id] = name;
+            }
+
+            THEN( "every sensor can be found" )
+            {
+                REQUIRE(sensors.size() == expected.size());
+                for (const auto& pair : expected)
+                {
+                    auto it = sensors.find(pair.first);
+                    REQUIRE(it != sensors.end());
+                    REQUIRE(it->second.name == pair.second);
+                }
+            }
+
+            THEN( "iteration is in ID order like the map" )
+            {
+                auto expectedIt = expected.begin();
+                for (const auto& pair : sensors)
+                {
+                    REQUIRE(expectedIt != expected.end());
+                    REQUIRE(pair.first == expectedIt->first);
+                    ++expectedIt;
+                }
+                REQUIRE(expectedIt == expected.end());
+            }
+
+            THEN( "a copy of the table is independent of the original" )
+            {
+                auto copy = sensors;
+                copy[id].name = "Changed";
+                REQUIRE(copy.find(id)->second.name == "Changed");
+                REQUIRE(sensors.find(id)->second.name != "Changed");
+                REQUIRE(copy.size() == sensors.size());
+            }
+        }
+    }
+
+    GIVEN( "a table built from an initializer list" )
+    {
+        AlarmSensor sensor1(2, true, "Two", SensorState::Closed);
+        AlarmSensor sensor2(1, false, "One", SensorState::Open);
+        SensorMap sensors = { {sensor1.id, sensor1}, {sensor2.id, sensor2} };
+
+        THEN( "it holds the sensors in ID order" )
+        {
+            REQUIRE(sensors.size() == 2);
+            REQUIRE(sensors.begin()->first == 1);
+            REQUIRE(sensors.begin()->second.name == "One");
+            REQUIRE(sensors[2].name == "Two");
+        }
+    }
+}
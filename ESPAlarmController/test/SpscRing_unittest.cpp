@@ -0,0 +1,116 @@
+#include <catch.hpp>
+
+#include <SpscRing.h>
+
+#include <thread>
+
+
+SCENARIO( "Test SpscRing", "" )
+{
+    GIVEN( "an empty ring" )
+    {
+        SpscRing<uint32_t, 4> ring;
+        uint32_t item;
+
+        REQUIRE(ring.empty());
+        REQUIRE(ring.capacity() == 4);
+        REQUIRE_FALSE(ring.pop(item));
+
+        WHEN( "the ring is filled" )
+        {
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                REQUIRE(ring.push(i));
+            }
+
+            THEN( "it reports full and counts overflows" )
+            {
+                REQUIRE(ring.size() == 4);
+                REQUIRE_FALSE(ring.push(4));
+                REQUIRE_FALSE(ring.push(5));
+                REQUIRE(ring.overflows() == 2);
+                REQUIRE(ring.highWater() == 4);
+            }
+
+            THEN( "items come out in order" )
+            {
+                for (uint32_t i = 0; i < 4; ++i)
+                {
+                    REQUIRE(ring.pop(item));
+                    REQUIRE(item == i);
+                }
+                REQUIRE_FALSE(ring.pop(item));
+                REQUIRE(ring.empty());
+            }
+        }
+
+        WHEN( "items are pushed and popped past the end of the buffer" )
+        {
+            for (uint32_t i = 0; i < 100; ++i)
+            {
+                REQUIRE(ring.push(i));
+                REQUIRE(ring.push(i + 1000));
+                REQUIRE(ring.pop(item));
+                REQUIRE(item == i);
+                REQUIRE(ring.pop(item));
+                REQUIRE(item == i + 1000);
+            }
+
+            THEN( "the high-water mark reflects the actual depth" )
+            {
+                REQUIRE(ring.highWater() == 2);
+                REQUIRE(ring.overflows() == 0);
+                REQUIRE(ring.empty());
+            }
+        }
+    }
+}
+
+SCENARIO( "Stress SpscRing with a producer and a consumer thread", "" )
+{
+    // Build with -DENABLE_TSAN=ON to run this under ThreadSanitizer.
+    struct Item
+    {
+        uint32_t sequence;
+        uint32_t check;
+    };
+    SpscRing<Item, 16> ring;
+    const uint32_t itemCount = 1000000;
+    uint32_t producerRetries = 0;
+
+    std::thread producer([&]() {
+        for (uint32_t i = 0; i < itemCount; ++i)
+        {
+            while (!ring.push(Item{i, ~i}))
+            {
+                producerRetries++;
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint32_t received = 0;
+    uint32_t outOfOrder = 0;
+    while (received < itemCount)
+    {
+        Item item;
+        if (!ring.pop(item))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        if (item.sequence != received || item.check != ~received)
+        {
+            outOfOrder++;
+        }
+        received++;
+    }
+
+    producer.join();
+
+    REQUIRE(outOfOrder == 0);
+    REQUIRE(ring.empty());
+    REQUIRE(ring.overflows() == producerRetries);
+    REQUIRE(ring.highWater() <= ring.capacity());
+}
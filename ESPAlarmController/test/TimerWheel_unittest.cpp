@@ -0,0 +1,136 @@
+#include <catch.hpp>
+
+#include <TimerWheel.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+SCENARIO( "Test TimerWheel", "" )
+{
+    auto jobs = std::make_unique<TimerWheel>();
+    std::vector<std::string> ran;
+
+    GIVEN( "no jobs" )
+    {
+        THEN( "there is no deadline" )
+        {
+            REQUIRE(jobs->run(1000) == TimerWheel::noDeadline);
+        }
+    }
+
+    GIVEN( "jobs with different periods" )
+    {
+        unsigned long now = 1000;
+        REQUIRE(jobs->addJob("fast", 2, [&]() { ran.push_back("fast"); }, now));
+        REQUIRE(jobs->addJob("second", 1000, [&]() { ran.push_back("second"); }, now));
+        REQUIRE(jobs->addJob("minute", 60000, [&]() { ran.push_back("minute"); }, now));
+
+        THEN( "nothing runs before its deadline" )
+        {
+            REQUIRE(jobs->run(now + 1) == 1);
+            REQUIRE(ran.empty());
+            REQUIRE(jobs->timeToNextDeadline(now) == 2);
+        }
+
+        THEN( "each job runs once per period" )
+        {
+            for (auto t = now; t <= now + 120000; ++t)
+            {
+                jobs->run(t);
+            }
+            REQUIRE(jobs->jobStats(0).runs == 60000);
+            REQUIRE(jobs->jobStats(1).runs == 120);
+            REQUIRE(jobs->jobStats(2).runs == 2);
+        }
+
+        THEN( "a late pass runs every due job once, in the order they were added" )
+        {
+            auto waitMs = jobs->run(now + 60000);
+            REQUIRE(ran == std::vector<std::string>{ "fast", "second", "minute" });
+            REQUIRE(waitMs == 2);
+        }
+
+        THEN( "the time to the next deadline counts down" )
+        {
+            jobs->run(now + 2);
+            jobs->run(now + 4);
+            ran.clear();
+            for (unsigned long t = now + 5; t < now + 1000; t += 2)
+            {
+                jobs->run(t);
+            }
+            REQUIRE(std::find(ran.begin(), ran.end(), "second") == ran.end());
+            jobs->run(now + 1000);
+            REQUIRE(std::find(ran.begin(), ran.end(), "second") != ran.end());
+        }
+
+        THEN( "the job stats are reported" )
+        {
+            jobs->run(now + 1000);
+            auto stats = jobs->jobStats(1);
+            REQUIRE(std::string(stats.name) == "second");
+            REQUIRE(stats.runs == 1);
+            REQUIRE(stats.maxRunUs <= stats.totalRunUs);
+        }
+    }
+
+    GIVEN( "a job that runs right away" )
+    {
+        REQUIRE(jobs->addJob("second", 1000, [&]() { ran.push_back("second"); }, 1000, 0));
+
+        THEN( "it runs on the first pass and then once per period" )
+        {
+            REQUIRE(jobs->run(1000) == 1000);
+            REQUIRE(ran.size() == 1);
+            jobs->run(1999);
+            REQUIRE(ran.size() == 1);
+            jobs->run(2000);
+            REQUIRE(ran.size() == 2);
+        }
+    }
+
+    GIVEN( "a job that is due after millis() rolls over" )
+    {
+        unsigned long now = 0xFFFFFFFF - 500;
+        REQUIRE(jobs->addJob("second", 1000, [&]() { ran.push_back("second"); }, now));
+
+        THEN( "it runs on time" )
+        {
+            REQUIRE(jobs->timeToNextDeadline(now) == 1000);
+            jobs->run(0xFFFFFFFF);
+            jobs->run(498);
+            REQUIRE(ran.empty());
+            REQUIRE(jobs->run(499) == 1000);
+            REQUIRE(ran.size() == 1);
+        }
+    }
+
+    GIVEN( "more jobs than fit" )
+    {
+        for (size_t i = 0; i < TimerWheel::maxJobs; ++i)
+        {
+            REQUIRE(jobs->addJob("job", 10, []() {}, 0));
+        }
+
+        THEN( "the job is refused" )
+        {
+            REQUIRE_FALSE(jobs->addJob("job", 10, []() {}, 0));
+            REQUIRE(jobs->jobCount() == TimerWheel::maxJobs);
+        }
+    }
+
+    GIVEN( "a loop reporting its idle time" )
+    {
+        THEN( "the idle share is published once per window" )
+        {
+            jobs->recordIdle(0, 0);
+            jobs->recordIdle(TimerWheel::idleWindowUs / 4, TimerWheel::idleWindowUs / 2);
+            REQUIRE(jobs->idlePermille() == 0);
+            jobs->recordIdle(TimerWheel::idleWindowUs / 2, TimerWheel::idleWindowUs);
+            REQUIRE(jobs->idlePermille() == 750);
+        }
+    }
+}
@@ -0,0 +1,134 @@
+// Evaluations per second of AlarmPolicy::handleSensorState() and
+// checkSensor(), which look their actions up in rule tables, against the
+// original chains of ifs kept in AlarmPolicyReference.h. The inputs cycle
+// through every alarm state, sensor state and timing the rules tell apart.
+// The reference appends its events to a vector where the policy calls the
+// mock ActivityLog, so it carries a little extra work.
+#include "ActivityLog.h"
+#include "AlarmPolicy.h"
+#include "AlarmPolicyReference.h"
+#include "alarm_config.h"
+#include "mockControl.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+const size_t passes = 2000;
+
+struct Input
+{
+    AlarmSensor sensor;
+    SensorState::State newState;
+    AlarmState alarmState;
+};
+
+double perSecond(Clock::duration elapsed, size_t operations)
+{
+    return operations / std::chrono::duration<double>(elapsed).count();
+}
+
+std::vector<Input> makeInputs(unsigned long now)
+{
+    const SensorState::State states[] = { SensorState::Open, SensorState::Closed, SensorState::Fault, SensorState::Unknown };
+    const AlarmState alarmStates[] = { AlarmState::Disarmed, AlarmState::Arming, AlarmState::Armed, AlarmState::AlarmTriggered };
+    const unsigned long updateAges[] = { now, 1, MAX_SENSOR_UPDATE_TIMEOUT_ARMED_MS, MAX_SENSOR_UPDATE_TIMEOUT_DISARMED_MS };
+    const unsigned long faultAges[] = { 0, SENSOR_FAULT_CHIME_INTERVAL_MS };
+
+    std::vector<Input> inputs;
+    for (auto alarmState : alarmStates)
+    {
+        for (auto oldState : states)
+        {
+            for (auto newState : states)
+            {
+                for (auto updateAge : updateAges)
+                {
+                    for (auto faultAge : faultAges)
+                    {
+                        Input input{ AlarmSensor(inputs.size() + 1, true, "", oldState), newState, alarmState };
+                        input.sensor.lastUpdate = now - updateAge;
+                        input.sensor.faultLastHandled = now - faultAge;
+                        inputs.push_back(input);
+                    }
+                }
+            }
+        }
+    }
+    return inputs;
+}
+
+// Runs evaluate over every input passes times, starting from fresh sensors
+// each pass so the fault chime timing stays the same. Returns the time spent
+// evaluating and the number of actions taken, which keeps the work alive.
+template<typename Evaluate>
+Clock::duration run(const std::vector<Input>& inputs, Evaluate evaluate, size_t& actionsTaken)
+{
+    Clock::duration elapsed{};
+    std::vector<Input> work;
+    for (size_t pass = 0; pass < passes; ++pass)
+    {
+        work = inputs;
+        auto start = Clock::now();
+        for (auto& input : work)
+        {
+            AlarmPolicy::Actions actions;
+            evaluate(actions, input);
+            actionsTaken += actions.triggerAlarm + actions.cancelArming + actions.playSound;
+        }
+        elapsed += Clock::now() - start;
+    }
+    return elapsed;
+}
+
+}
+
+
+int main()
+{
+    ActivityLog log;
+    AlarmPolicy policy(log);
+    const unsigned long now = 10 * MAX_SENSOR_UPDATE_TIMEOUT_DISARMED_MS;
+    setUptimeMillis(now);
+
+    auto inputs = makeInputs(now);
+    auto evaluations = inputs.size() * passes;
+    std::vector<ActivityLog::EventType> events;
+    events.reserve(inputs.size());
+
+    size_t tableActions = 0;
+    size_t referenceActions = 0;
+    auto reportTable = run(inputs, [&](AlarmPolicy::Actions& actions, Input& input) {
+        policy.handleSensorState(actions, input.sensor, input.newState, input.alarmState);
+    }, tableActions);
+    auto reportReference = run(inputs, [&](AlarmPolicy::Actions& actions, Input& input) {
+        AlarmPolicyReference::handleSensorState(actions, input.sensor, input.newState, input.alarmState, events);
+        events.clear();
+    }, referenceActions);
+    auto checkTable = run(inputs, [&](AlarmPolicy::Actions& actions, Input& input) {
+        policy.checkSensor(actions, input.sensor, input.alarmState);
+    }, tableActions);
+    auto checkReference = run(inputs, [&](AlarmPolicy::Actions& actions, Input& input) {
+        AlarmPolicyReference::checkSensor(actions, input.sensor, input.alarmState, events);
+        events.clear();
+    }, referenceActions);
+
+    if (tableActions != referenceActions)
+    {
+        printf("rule tables took %zu actions, the reference %zu\n", tableActions, referenceActions);
+        return 1;
+    }
+
+    printf("%-20s %18s %18s\n", "", "tables", "reference");
+    printf("%-20s %14.1f M/s %14.1f M/s\n", "handleSensorState()", perSecond(reportTable, evaluations) / 1e6, perSecond(reportReference, evaluations) / 1e6);
+    printf("%-20s %14.1f M/s %14.1f M/s\n", "checkSensor()", perSecond(checkTable, evaluations) / 1e6, perSecond(checkReference, evaluations) / 1e6);
+    printf("%zu evaluations each\n", evaluations);
+
+    return 0;
+}
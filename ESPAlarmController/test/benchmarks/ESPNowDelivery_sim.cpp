@@ -0,0 +1,153 @@
+// Simulates a sensor reporting over a lossy ESP-NOW link and reports the
+// radio-on time per report. It compares the legacy blind send (esp_now_send
+// then delay(10), no way to notice a loss) against acknowledged delivery
+// with the default retry policy.
+#include <ESPNowDelivery.h>
+
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+
+namespace
+{
+
+// Rough ESP-NOW timings for a 10 byte frame
+const double frameAirtimeMs = 0.4;
+const double minAckLatencyMs = 1.0;
+const double maxAckLatencyMs = 4.0;
+const unsigned long legacyDelayMs = 10;
+const int reports = 100000;
+
+class RadioModel
+{
+public:
+    RadioModel(double lossRate, uint32_t seed)
+        :
+        _lossRate(lossRate),
+        _rng(seed),
+        _now(0),
+        _frameLost(false),
+        _ackLost(false)
+    {
+    }
+
+    bool transmit(const uint8_t* /*data*/, size_t /*len*/)
+    {
+        _frameLost = lost();
+        _ackLost = lost();
+        return true;
+    }
+
+    bool waitForSendDone(unsigned long /*timeoutMs*/)
+    {
+        _now += frameAirtimeMs;
+        return !_frameLost;
+    }
+
+    bool waitForAck(uint16_t /*sequence*/, unsigned long timeoutMs)
+    {
+        std::uniform_real_distribution<double> latency(minAckLatencyMs, maxAckLatencyMs);
+        auto ackLatency = latency(_rng) + frameAirtimeMs;
+        if (_ackLost || ackLatency > timeoutMs)
+        {
+            _now += timeoutMs;
+            return false;
+        }
+
+        _now += ackLatency;
+        return true;
+    }
+
+    void backoff(unsigned long ms)
+    {
+        _now += ms;
+    }
+
+    uint32_t random()
+    {
+        return _rng();
+    }
+
+    bool lost()
+    {
+        std::uniform_real_distribution<double> chance(0, 1);
+        return chance(_rng) < _lossRate;
+    }
+
+    double now() const
+    {
+        return _now;
+    }
+
+    void reset()
+    {
+        _now = 0;
+    }
+
+private:
+    double _lossRate;
+    std::mt19937 _rng;
+    double _now;
+    bool _frameLost;
+    bool _ackLost;
+};
+
+void printStats(const char* name, double lossRate, std::vector<double>& radioOnMs, int delivered)
+{
+    std::sort(radioOnMs.begin(), radioOnMs.end());
+    double total = 0;
+    for (auto ms : radioOnMs)
+    {
+        total += ms;
+    }
+    printf("%-8s loss %4.1f%%: radio on mean %6.2f ms, p99 %6.2f ms, delivered %7.3f%%\n",
+            name,
+            lossRate * 100,
+            total / radioOnMs.size(),
+            radioOnMs[radioOnMs.size() * 99 / 100],
+            100.0 * delivered / radioOnMs.size());
+}
+
+}
+
+
+int main()
+{
+    const uint8_t frame[10] = {};
+    for (auto lossRate : { 0.0, 0.05, 0.2 })
+    {
+        RadioModel radio(lossRate, 1);
+        std::vector<double> radioOnMs;
+        int delivered = 0;
+        for (int i = 0; i < reports; ++i)
+        {
+            radio.reset();
+            radio.transmit(frame, sizeof(frame));
+            if (radio.waitForSendDone(legacyDelayMs))
+            {
+                delivered++;
+            }
+            radio.backoff(legacyDelayMs);
+            radioOnMs.push_back(radio.now());
+        }
+        printStats("legacy", lossRate, radioOnMs, delivered);
+
+        radioOnMs.clear();
+        delivered = 0;
+        for (int i = 0; i < reports; ++i)
+        {
+            radio.reset();
+            auto result = deliver(radio, defaultDeliveryPolicy, frame, sizeof(frame), i);
+            if (result.delivered)
+            {
+                delivered++;
+            }
+            radioOnMs.push_back(radio.now());
+        }
+        printStats("acked", lossRate, radioOnMs, delivered);
+    }
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+// Cost of one latency sample: LatencyHistogram::record() on its own, and a
+// LatencyHistogram::Timer around an empty scope, which adds the two micros()
+// calls. The loops record one sample per subsystem per pass, so this needs
+// to stay well under a microsecond.
+#include <LatencyHistogram.h>
+
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+const uint32_t iterations = 10000000;
+
+double nsPer(Clock::duration elapsed, size_t operations)
+{
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / operations;
+}
+
+}
+
+
+int main()
+{
+    auto histogram = std::make_unique<LatencyHistogram>();
+
+    // Spread over the buckets, like real loop timings
+    auto start = Clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        histogram->record((i * 2654435761u) >> (12 + i % 20));
+    }
+    auto recordTime = Clock::now() - start;
+
+    histogram->reset();
+    start = Clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        LatencyHistogram::Timer timer(*histogram);
+    }
+    auto timerTime = Clock::now() - start;
+
+    printf("%-24s %8.1f ns\n", "record()", nsPer(recordTime, iterations));
+    printf("%-24s %8.1f ns\n", "Timer", nsPer(timerTime, iterations));
+    printf("%u samples, p99 < %u us\n", histogram->snapshot().count, histogram->snapshot().percentileUs(0.99));
+
+    return 0;
+}
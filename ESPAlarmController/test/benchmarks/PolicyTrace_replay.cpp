@@ -0,0 +1,173 @@
+// Replays a policy trace downloaded from /alarm_system/policy_trace through
+// AlarmPolicy::handleSensorState() and checkSensor() on the mock clock,
+// reports any record where the policy now takes different actions than it
+// did on the device, and how many evaluations per second it replays.
+//
+//   ./test/benchmarks/PolicyTrace_replay [trace file]
+//
+// Without a file it records a trace of its own first, from sensors going
+// through every state under every alarm state, so it doubles as a check
+// that recording and replaying agree.
+#include "ActivityLog.h"
+#include "AlarmPolicy.h"
+#include "PolicyTrace.h"
+#include "alarm_config.h"
+#include "mockControl.h"
+
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdio.h>
+#include <vector>
+
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+const size_t passes = 20000;
+
+double perSecond(Clock::duration elapsed, size_t operations)
+{
+    return operations / std::chrono::duration<double>(elapsed).count();
+}
+
+AlarmPolicy::Actions evaluate(const AlarmPolicy& policy, const PolicyTrace::Record& record)
+{
+    setUptimeMillis(record.timeMs);
+    auto sensor = record.sensor();
+    AlarmPolicy::Actions actions;
+    if (record.inputType() == PolicyTrace::Input::SensorState)
+    {
+        policy.handleSensorState(actions, sensor, record.newState(), record.alarmState());
+    }
+    else
+    {
+        policy.checkSensor(actions, sensor, record.alarmState());
+    }
+    return actions;
+}
+
+bool operator==(const AlarmPolicy::Actions& a, const AlarmPolicy::Actions& b)
+{
+    return a.triggerAlarm == b.triggerAlarm && a.cancelArming == b.cancelArming
+        && a.playSound == b.playSound && (!a.playSound || a.sound == b.sound);
+}
+
+bool readTrace(const char* path, std::vector<PolicyTrace::Record>& records)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        printf("can't open %s\n", path);
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (!PolicyTrace::parse(data.data(), data.size(), records))
+    {
+        printf("%s is not a policy trace\n", path);
+        return false;
+    }
+    return true;
+}
+
+// Records the policy the way AlarmSystem does, with the clock moving on
+// enough between inputs to cross the sensor update timeouts and fault
+// chime interval.
+std::vector<PolicyTrace::Record> recordTrace(const AlarmPolicy& policy)
+{
+    const SensorState::State states[] = { SensorState::Open, SensorState::Closed, SensorState::Fault, SensorState::Unknown };
+    const AlarmState alarmStates[] = { AlarmState::Disarmed, AlarmState::Arming, AlarmState::Armed, AlarmState::AlarmTriggered };
+    const unsigned long steps[] = { 1, SENSOR_FAULT_CHIME_INTERVAL_MS, MAX_SENSOR_UPDATE_TIMEOUT_ARMED_MS, MAX_SENSOR_UPDATE_TIMEOUT_DISARMED_MS };
+
+    auto trace = std::make_unique<PolicyTrace>();
+    unsigned long now = 1;
+    AlarmSensor sensor(1, true, "", SensorState::Unknown);
+    for (auto alarmState : alarmStates)
+    {
+        for (auto newState : states)
+        {
+            for (auto step : steps)
+            {
+                now += step;
+                setUptimeMillis(now);
+
+                AlarmPolicy::Actions actions;
+                auto record = PolicyTrace::capture(PolicyTrace::Input::SensorState, sensor, newState, alarmState, millis());
+                policy.handleSensorState(actions, sensor, newState, alarmState);
+                trace->add(record, actions);
+                sensor.updateState(newState);
+
+                now += step;
+                setUptimeMillis(now);
+                actions = AlarmPolicy::Actions();
+                record = PolicyTrace::capture(PolicyTrace::Input::SensorCheck, sensor, sensor.state, alarmState, millis());
+                policy.checkSensor(actions, sensor, alarmState);
+                trace->add(record, actions);
+            }
+        }
+    }
+
+    std::vector<PolicyTrace::Record> records;
+    auto data = trace->serialize();
+    PolicyTrace::parse(data.data(), data.size(), records);
+    return records;
+}
+
+}
+
+
+int main(int argc, char** argv)
+{
+    ActivityLog log;
+    AlarmPolicy policy(log);
+
+    std::vector<PolicyTrace::Record> records;
+    if (argc > 1)
+    {
+        if (!readTrace(argv[1], records))
+        {
+            return 2;
+        }
+    }
+    else
+    {
+        records = recordTrace(policy);
+    }
+
+    size_t differences = 0;
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        const auto& record = records[i];
+        auto recorded = record.policyActions();
+        auto replayed = evaluate(policy, record);
+        if (!(replayed == recorded))
+        {
+            printf("record %zu, sensor %llu at %u ms: recorded trigger %d cancel %d sound %d, replayed trigger %d cancel %d sound %d\n",
+                   i, static_cast<unsigned long long>(record.sensorId), record.timeMs,
+                   recorded.triggerAlarm, recorded.cancelArming, recorded.playSound ? static_cast<int>(recorded.sound) : -1,
+                   replayed.triggerAlarm, replayed.cancelArming, replayed.playSound ? static_cast<int>(replayed.sound) : -1);
+            differences++;
+        }
+    }
+
+    size_t actionsTaken = 0;
+    auto start = Clock::now();
+    for (size_t pass = 0; pass < passes; ++pass)
+    {
+        for (const auto& record : records)
+        {
+            auto actions = evaluate(policy, record);
+            actionsTaken += actions.triggerAlarm + actions.cancelArming + actions.playSound;
+        }
+    }
+    auto elapsed = Clock::now() - start;
+
+    auto evaluations = records.size() * passes;
+    printf("%zu records, %zu differ from the recorded actions\n", records.size(), differences);
+    printf("%zu evaluations, %.1f M/s (%zu actions)\n", evaluations, perSecond(elapsed, evaluations) / 1e6, actionsTaken);
+
+    return differences == 0 ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+// How long loading the sensors at startup takes at different numbers of
+// sensors: opening the sensor database and filling the sensor table the
+// alarm system keeps, like AlarmSystem::loadAlarmSensorsFromDb() does.
+// Streaming moves each sensor from the file straight into the table.
+// Copying first reads the whole list with getAlarmSensors() and then
+// copies it into the table, holding every sensor twice for a while.
+#include "SensorDb.h"
+
+#include <SPIFFS.h>
+#include <chrono>
+#include <stdio.h>
+
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+const size_t loadedSensors = 100000;
+
+double microseconds(Clock::duration elapsed, size_t operations)
+{
+    return std::chrono::duration<double, std::micro>(elapsed).count() / operations;
+}
+
+template<typename Load>
+Clock::duration run(size_t passes, Load load, size_t& sensorsLoaded)
+{
+    auto start = Clock::now();
+    for (size_t pass = 0; pass < passes; ++pass)
+    {
+        SensorDataBase db;
+        db.begin();
+        SensorMap sensors;
+        load(db, sensors);
+        sensorsLoaded += sensors.size();
+    }
+    return Clock::now() - start;
+}
+
+}
+
+
+int main()
+{
+    const size_t sensorCounts[] = { 10, 100, 1000 };
+
+    printf("%8s %16s %16s %16s\n", "sensors", "streaming", "copying", "copy held");
+    for (auto sensorCount : sensorCounts)
+    {
+        SPIFFS.format();
+        {
+            SensorDataBase db;
+            db.begin();
+            for (size_t i = 0; i < sensorCount; ++i)
+            {
+                auto name = String("Sensor ") + String(static_cast<unsigned>(i));
+                if (!db.storeSensor(AlarmSensor(i + 1, true, name, SensorState::Unknown)))
+                {
+                    printf("failed to store sensor %zu\n", i + 1);
+                    return 1;
+                }
+            }
+        }
+
+        auto passes = loadedSensors / sensorCount;
+        size_t streamed = 0;
+        auto streaming = run(passes, [](SensorDataBase& db, SensorMap& sensors) {
+            sensors.reserve(db.sensorCount());
+            db.forEachSensor([&sensors](AlarmSensor&& sensor) { sensors[sensor.id] = std::move(sensor); });
+        }, streamed);
+
+        size_t copied = 0;
+        size_t copyHeld = 0;
+        auto copying = run(passes, [&copyHeld](SensorDataBase& db, SensorMap& sensors) {
+            SensorList list;
+            db.getAlarmSensors(list);
+            copyHeld = list.capacity() * sizeof(AlarmSensor);
+            for (const auto& sensor : list)
+            {
+                sensors[sensor.id] = sensor;
+            }
+        }, copied);
+
+        if (streamed != passes * sensorCount || copied != streamed)
+        {
+            printf("loaded %zu sensors streaming and %zu copying, expected %zu\n", streamed, copied, passes * sensorCount);
+            return 1;
+        }
+
+        printf("%8zu %13.1f us %13.1f us %14zu B\n", sensorCount, microseconds(streaming, passes), microseconds(copying, passes), copyHeld);
+    }
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+// Bytes written to the file system per sensor update, with the journaled
+// sensor database, at different numbers of sensors. Every update renames a
+// sensor and toggles whether it is enabled, going round all of them, so the
+// file gets compacted along the way. A whole file rewrite, which is what
+// every update cost with the JSON database, is shown for comparison.
+#include "SensorDb.h"
+#include "mockControl.h"
+
+#include <SPIFFS.h>
+#include <stdio.h>
+
+
+namespace
+{
+
+const size_t updatesPerSensor = 20;
+
+size_t fileSize(const char* path)
+{
+    auto file = SPIFFS.open(path, FILE_READ);
+    auto size = file.size();
+    file.close();
+    return size;
+}
+
+}
+
+
+int main()
+{
+    const size_t sensorCounts[] = { 10, 100, 1000 };
+
+    printf("%8s %8s %18s %18s\n", "sensors", "updates", "bytes/update", "whole file");
+    for (auto sensorCount : sensorCounts)
+    {
+        SPIFFS.format();
+        SensorDataBase db;
+        if (!db.begin())
+        {
+            printf("failed to create the database\n");
+            return 1;
+        }
+        for (size_t i = 0; i < sensorCount; ++i)
+        {
+            if (!db.storeSensor(AlarmSensor(i + 1, true, "Sensor", SensorState::Unknown)))
+            {
+                printf("failed to store sensor %zu\n", i + 1);
+                return 1;
+            }
+        }
+
+        // Nothing has been replaced yet, so this is what rewriting the
+        // whole file costs
+        auto wholeFile = fileSize("/sensors.bin");
+
+        auto updates = sensorCount * updatesPerSensor;
+        resetFileBytesWritten();
+        for (size_t i = 0; i < updates; ++i)
+        {
+            AlarmSensor sensor(i % sensorCount + 1, i % 2 == 0, String("Sensor ") + String(static_cast<unsigned>(i)), SensorState::Unknown);
+            if (!db.updateSensor(sensor))
+            {
+                printf("failed to update sensor %llu\n", static_cast<unsigned long long>(sensor.id));
+                return 1;
+            }
+        }
+        auto bytesPerUpdate = static_cast<double>(fileBytesWritten()) / updates;
+
+        printf("%8zu %8zu %18.1f %18zu\n", sensorCount, updates, bytesPerUpdate, wholeFile);
+    }
+
+    return 0;
+}
@@ -0,0 +1,152 @@
+// Compares the SpscRing used between the ESP-NOW receive callback and the
+// alarm loop against the FreeRTOS queue path it replaced (the host
+// xQueueSend/xQueueReceive mock, guarded by a mutex for the two thread runs
+// to stand in for the FreeRTOS queue critical section).
+#include <Arduino.h>
+#include <SpscRing.h>
+
+#include "protocol.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+struct SensorEventMessage
+{
+    uint8_t macAddress[6];
+    SensorState state;
+    int64_t sentNs;
+};
+
+const size_t queueLength = 16;
+const uint32_t singleThreadIterations = 2000000;
+const uint32_t twoThreadItems = 200000;
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+class RingPath
+{
+public:
+    bool send(const SensorEventMessage& message)
+    {
+        return _ring.push(message);
+    }
+    bool receive(SensorEventMessage& message)
+    {
+        return _ring.pop(message);
+    }
+private:
+    SpscRing<SensorEventMessage, queueLength> _ring;
+};
+
+class QueuePath
+{
+public:
+    QueuePath()
+        :
+        _queue(xQueueCreate(queueLength, sizeof(SensorEventMessage)))
+    {
+    }
+    bool send(const SensorEventMessage& message)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return xQueueSend(_queue, &message, 0) == pdTRUE;
+    }
+    bool receive(SensorEventMessage& message)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return xQueueReceive(_queue, &message, 0) == pdTRUE;
+    }
+private:
+    QueueHandle_t _queue;
+    std::mutex _mutex;
+};
+
+template<typename Path>
+void runSingleThread(const char* name)
+{
+    Path path;
+    SensorEventMessage message{};
+    uint32_t checksum = 0;
+
+    auto start = Clock::now();
+    for (uint32_t i = 0; i < singleThreadIterations; ++i)
+    {
+        message.macAddress[5] = static_cast<uint8_t>(i);
+        path.send(message);
+        path.receive(message);
+        checksum += message.macAddress[5];
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+    printf("%-12s single thread: %8.1f ns per send+receive (checksum %u)\n",
+           name, elapsed / singleThreadIterations, checksum);
+}
+
+template<typename Path>
+void runTwoThreads(const char* name)
+{
+    Path path;
+    std::vector<int64_t> latencies;
+    latencies.reserve(twoThreadItems);
+
+    auto start = Clock::now();
+    std::thread producer([&]() {
+        SensorEventMessage message{};
+        for (uint32_t i = 0; i < twoThreadItems; ++i)
+        {
+            message.sentNs = nowNs();
+            while (!path.send(message))
+            {
+                std::this_thread::yield();
+                message.sentNs = nowNs();
+            }
+        }
+    });
+
+    SensorEventMessage message;
+    while (latencies.size() < twoThreadItems)
+    {
+        if (!path.receive(message))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        latencies.push_back(nowNs() - message.sentNs);
+    }
+    producer.join();
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-12s two threads:   %8.2f M events/s, latency p50 %6lld ns, p99 %7lld ns, max %9lld ns\n",
+           name,
+           twoThreadItems / elapsed / 1e6,
+           static_cast<long long>(latencies[latencies.size() / 2]),
+           static_cast<long long>(latencies[latencies.size() * 99 / 100]),
+           static_cast<long long>(latencies.back()));
+}
+
+}
+
+
+int main()
+{
+    runSingleThread<QueuePath>("xQueue");
+    runSingleThread<RingPath>("SpscRing");
+    runTwoThreads<QueuePath>("xQueue");
+    runTwoThreads<RingPath>("SpscRing");
+    return 0;
+}
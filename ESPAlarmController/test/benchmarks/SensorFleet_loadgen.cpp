@@ -0,0 +1,512 @@
+// Drives a real AlarmSystem with a fleet of simulated contact sensors on the
+// mocked virtual clock, to size a deployment before installing hardware.
+//
+// Every sensor sends version 2 frames through the mocked ESP-NOW server:
+// heartbeats every --heartbeat-ms (+/- --jitter-ms) and, at --flaps-per-hour,
+// an open followed by a close --open-ms later. Frames can be lost, corrupted,
+// duplicated (a retry after a lost ack) or sent after a sensor reboot.
+// The controller loop runs every --loop-ms of virtual time. The system is
+// armed whenever it can be, and disarmed again after each trigger.
+//
+// Example, from the build directory:
+//   ./test/benchmarks/SensorFleet_loadgen --sensors 1000 --minutes 30 --flaps-per-hour 6
+//
+// Latencies are in virtual time plus the measured run time of the loop pass
+// that handled the frame, so they include queueing behind other sensors.
+#include "AlarmSystem.h"
+
+#include <alarm_config.h>
+
+#include <SPIFFS.h>
+
+#include "mockControl.h"
+#include "protocol.h"
+#include "TestESPNowServer.h"
+#include "TestWavFilePlayer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <queue>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    unsigned long sensors = 100;
+    unsigned long minutes = 10;
+    unsigned long heartbeatMs = SENSOR_UPDATE_INTERVAL_MS;
+    unsigned long jitterMs = 2000;
+    double flapsPerHour = 2;
+    unsigned long openMs = 3000;
+    double lossRate = 0;
+    double corruptRate = 0;
+    double duplicateRate = 0;
+    double rebootRate = 0;
+    unsigned long loopMs = 1;
+    unsigned long seed = 1;
+};
+
+struct OptionInfo
+{
+    const char* name;
+    const char* help;
+};
+
+const OptionInfo optionInfo[] = {
+    { "--sensors", "number of simulated sensors" },
+    { "--minutes", "virtual time to simulate" },
+    { "--heartbeat-ms", "heartbeat period" },
+    { "--jitter-ms", "random heartbeat jitter, +/-" },
+    { "--flaps-per-hour", "open/close cycles per sensor per hour" },
+    { "--open-ms", "how long a sensor stays open per flap" },
+    { "--loss-rate", "fraction of frames lost, after the sensor's own retries" },
+    { "--corrupt-rate", "fraction of frames with a bit error" },
+    { "--duplicate-rate", "fraction of frames received twice" },
+    { "--reboot-rate", "fraction of frames sent right after a sensor reboot" },
+    { "--loop-ms", "virtual time between controller loop passes" },
+    { "--seed", "random seed" },
+};
+
+void usage(const char* program)
+{
+    printf("Usage: %s [option value]...\n", program);
+    for (const auto& info : optionInfo)
+    {
+        printf("  %-18s %s\n", info.name, info.help);
+    }
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; i += 2)
+    {
+        if (i + 1 >= argc)
+        {
+            return false;
+        }
+
+        const char* name = argv[i];
+        const char* value = argv[i + 1];
+        if (strcmp(name, "--sensors") == 0) options.sensors = strtoul(value, nullptr, 0);
+        else if (strcmp(name, "--minutes") == 0) options.minutes = strtoul(value, nullptr, 0);
+        else if (strcmp(name, "--heartbeat-ms") == 0) options.heartbeatMs = strtoul(value, nullptr, 0);
+        else if (strcmp(name, "--jitter-ms") == 0) options.jitterMs = strtoul(value, nullptr, 0);
+        else if (strcmp(name, "--flaps-per-hour") == 0) options.flapsPerHour = strtod(value, nullptr);
+        else if (strcmp(name, "--open-ms") == 0) options.openMs = strtoul(value, nullptr, 0);
+        else if (strcmp(name, "--loss-rate") == 0) options.lossRate = strtod(value, nullptr);
+        else if (strcmp(name, "--corrupt-rate") == 0) options.corruptRate = strtod(value, nullptr);
+        else if (strcmp(name, "--duplicate-rate") == 0) options.duplicateRate = strtod(value, nullptr);
+        else if (strcmp(name, "--reboot-rate") == 0) options.rebootRate = strtod(value, nullptr);
+        else if (strcmp(name, "--loop-ms") == 0) options.loopMs = strtoul(value, nullptr, 0);
+        else if (strcmp(name, "--seed") == 0) options.seed = strtoul(value, nullptr, 0);
+        else return false;
+    }
+
+    return options.sensors > 0 && options.sensors <= 0xFFFFFF && options.heartbeatMs > options.jitterMs && options.loopMs > 0;
+}
+
+struct VirtualSensor
+{
+    uint8_t macAddress[6];
+    SensorState::State state;
+    uint16_t sequence;
+    bool sequenceReset;
+};
+
+enum class SensorAction
+{
+    Heartbeat,
+    Toggle
+};
+
+struct ScheduledAction
+{
+    unsigned long timeMs;
+    uint32_t sensor;
+    SensorAction action;
+
+    bool operator>(const ScheduledAction& other) const
+    {
+        return timeMs > other.timeMs;
+    }
+};
+
+struct Percentiles
+{
+    std::vector<double> samples;
+
+    void print(const char* name, const char* unit)
+    {
+        if (samples.empty())
+        {
+            printf("%-24s no samples\n", name);
+            return;
+        }
+
+        std::sort(samples.begin(), samples.end());
+        auto at = [&](double p) {
+            return samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))];
+        };
+        printf("%-24s p50 %9.3f  p90 %9.3f  p99 %9.3f  max %9.3f %s (%zu samples)\n",
+                name, at(0.5), at(0.9), at(0.99), samples.back(), unit, samples.size());
+    }
+};
+
+// The same histograms /alarm_system/metrics serves, one line per entry
+void printLatency(const char* title, const std::vector<AlarmSystem::LatencyStats>& latencyStats)
+{
+    printf("\n%s:\n", title);
+    for (const auto& entry : latencyStats)
+    {
+        const auto& latency = entry.latency;
+        printf("%-24s p50 <%7u  p99 <%7u  max %7u us (%u samples)\n", entry.name,
+                latency.percentileUs(0.5), latency.percentileUs(0.99), latency.maxUs, latency.count);
+        printf("%-24s", "");
+        for (size_t i = 0; i < LatencyHistogram::bucketCount; ++i)
+        {
+            if (latency.buckets[i] == 0)
+            {
+                continue;
+            }
+            if (i < LatencyHistogram::bucketCount - 1)
+            {
+                printf(" <%u: %u", LatencyHistogram::bucketLimitUs(i), latency.buckets[i]);
+            }
+            else
+            {
+                printf(" more: %u", latency.buckets[i]);
+            }
+        }
+        printf("\n");
+    }
+}
+
+class SensorFleet
+{
+public:
+    SensorFleet(const Options& options)
+        :
+        _options(options),
+        _rng(options.seed),
+        _sensorsOpen(0),
+        _framesSent(0),
+        _framesLost(0),
+        _framesCorrupted(0),
+        _framesDuplicated(0)
+    {
+        _sensors.resize(options.sensors);
+        for (uint32_t i = 0; i < options.sensors; ++i)
+        {
+            auto& sensor = _sensors[i];
+            const uint8_t macAddress[6] = { 0x30, 0xAE, 0xA4, uint8_t(i >> 16), uint8_t(i >> 8), uint8_t(i) };
+            memcpy(sensor.macAddress, macAddress, sizeof(macAddress));
+            sensor.state = SensorState::Closed;
+            sensor.sequence = static_cast<uint16_t>(_rng());
+            sensor.sequenceReset = true;
+        }
+    }
+
+    // Every sensor reports once, spread over the first heartbeat period
+    void start(unsigned long now)
+    {
+        std::uniform_int_distribution<unsigned long> phase(0, _options.heartbeatMs - 1);
+        for (uint32_t i = 0; i < _sensors.size(); ++i)
+        {
+            _actions.push({ now + phase(_rng), i, SensorAction::Heartbeat });
+            scheduleFlap(now, i);
+        }
+    }
+
+    size_t size() const
+    {
+        return _sensors.size();
+    }
+
+    void report(uint32_t sensor)
+    {
+        send(_sensors[sensor], true);
+    }
+
+    // Runs the sensor actions due by now. Returns when the first sensor
+    // opened, or 0 if none did.
+    unsigned long runUntil(unsigned long now)
+    {
+        unsigned long firstOpened = 0;
+        while (!_actions.empty() && _actions.top().timeMs <= now)
+        {
+            auto action = _actions.top();
+            _actions.pop();
+            auto& sensor = _sensors[action.sensor];
+            if (action.action == SensorAction::Heartbeat)
+            {
+                send(sensor, false);
+                std::uniform_int_distribution<long> jitter(-static_cast<long>(_options.jitterMs), _options.jitterMs);
+                _actions.push({ action.timeMs + _options.heartbeatMs + jitter(_rng), action.sensor, SensorAction::Heartbeat });
+            }
+            else
+            {
+                sensor.state = sensor.state == SensorState::Open ? SensorState::Closed : SensorState::Open;
+                if (sensor.state == SensorState::Open)
+                {
+                    _sensorsOpen++;
+                    if (firstOpened == 0)
+                    {
+                        firstOpened = action.timeMs;
+                    }
+                    _actions.push({ action.timeMs + _options.openMs, action.sensor, SensorAction::Toggle });
+                }
+                else
+                {
+                    _sensorsOpen--;
+                    scheduleFlap(action.timeMs, action.sensor);
+                }
+                send(sensor, false);
+            }
+        }
+
+        return firstOpened;
+    }
+
+    bool anyOpen() const
+    {
+        return _sensorsOpen > 0;
+    }
+
+    uint64_t framesSent() const { return _framesSent; }
+    uint64_t framesLost() const { return _framesLost; }
+    uint64_t framesCorrupted() const { return _framesCorrupted; }
+    uint64_t framesDuplicated() const { return _framesDuplicated; }
+
+private:
+    void scheduleFlap(unsigned long now, uint32_t sensor)
+    {
+        if (_options.flapsPerHour <= 0)
+        {
+            return;
+        }
+
+        std::exponential_distribution<double> untilFlap(_options.flapsPerHour / (3600.0 * 1000.0));
+        _actions.push({ now + 1 + static_cast<unsigned long>(untilFlap(_rng)), sensor, SensorAction::Toggle });
+    }
+
+    bool chance(double rate)
+    {
+        return rate > 0 && std::uniform_real_distribution<double>(0, 1)(_rng) < rate;
+    }
+
+    void send(VirtualSensor& sensor, bool reliable)
+    {
+        if (!reliable && chance(_options.rebootRate))
+        {
+            sensor.sequence = static_cast<uint16_t>(_rng());
+            sensor.sequenceReset = true;
+        }
+
+        SensorFrame frame;
+        frame.wakeupReason = ESP_SLEEP_WAKEUP_TIMER;
+        frame.state = sensor.state;
+        frame.vccMillivolts = 3300;
+        frame.sequence = sensor.sequence++;
+        frame.sequenceReset = sensor.sequenceReset;
+        sensor.sequenceReset = false;
+
+        uint8_t buffer[sensorFrameSize];
+        auto len = frame.encode(buffer, sizeof(buffer));
+        _framesSent++;
+
+        if (!reliable && chance(_options.lossRate))
+        {
+            _framesLost++;
+            return;
+        }
+
+        if (!reliable && chance(_options.corruptRate))
+        {
+            _framesCorrupted++;
+            std::uniform_int_distribution<size_t> bit(0, len * 8 - 1);
+            auto b = bit(_rng);
+            buffer[b / 8] ^= 1 << (b % 8);
+        }
+
+        TestESPNowServer::instance().send(sensor.macAddress, buffer, len);
+        if (!reliable && chance(_options.duplicateRate))
+        {
+            _framesDuplicated++;
+            TestESPNowServer::instance().send(sensor.macAddress, buffer, len);
+        }
+    }
+
+    const Options& _options;
+    std::mt19937 _rng;
+    std::vector<VirtualSensor> _sensors;
+    std::priority_queue<ScheduledAction, std::vector<ScheduledAction>, std::greater<ScheduledAction>> _actions;
+    size_t _sensorsOpen;
+    uint64_t _framesSent;
+    uint64_t _framesLost;
+    uint64_t _framesCorrupted;
+    uint64_t _framesDuplicated;
+};
+
+double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void drainSideEffects()
+{
+    TestESPNowServer::instance().clearReplies();
+    while (numberOfAudioFilesPlayed() > 0)
+    {
+        lastAudioFilePlayed();
+    }
+}
+
+}
+
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("%lu sensors, %lu minutes, heartbeat %lu +/- %lu ms, %.1f flaps/hour, loop every %lu ms\n",
+            options.sensors, options.minutes, options.heartbeatMs, options.jitterMs, options.flapsPerHour, options.loopMs);
+    printf("loss %.3f, corrupt %.3f, duplicate %.3f, reboot %.3f\n",
+            options.lossRate, options.corruptRate, options.duplicateRate, options.rebootRate);
+
+    setUptimeMillis(1);
+    SPIFFS.format();
+    auto alarm = std::make_unique<AlarmSystem>("", "", 0, 0, 0);
+    alarm->begin();
+
+    // Provision: every sensor reports in and is enabled. The queue only
+    // holds a few events, so let the loop keep up.
+    auto provisionStart = Clock::now();
+    SensorFleet fleet(options);
+    for (uint32_t i = 0; i < fleet.size(); ++i)
+    {
+        fleet.report(i);
+        alarm->onLoop();
+    }
+    for (auto pair : alarm->sensors())
+    {
+        auto sensor = pair.second;
+        sensor.enabled = true;
+        alarm->updateSensor(sensor);
+    }
+    printf("Provisioned %zu sensors in %.2f s\n", alarm->sensors().size(), secondsSince(provisionStart));
+    drainSideEffects();
+
+    auto baseline = alarm->ingestStats();
+    auto runStart = Clock::now();
+    Clock::duration loopTime(0);
+    Percentiles loopUs;
+    Percentiles sirenMs;
+    uint32_t triggers = 0;
+    uint32_t triggersWithoutOpen = 0;
+    uint32_t armings = 0;
+    unsigned long openedWhileArmed = 0;
+
+    auto start = millis();
+    auto end = start + options.minutes * 60 * 1000;
+    fleet.start(start);
+    if (alarm->arm())
+    {
+        armings++;
+    }
+    for (auto now = start; now < end; now += options.loopMs)
+    {
+        setUptimeMillis(now);
+        auto firstOpened = fleet.runUntil(now);
+        auto armed = alarm->state() == AlarmState::Armed;
+        if (armed && firstOpened != 0 && openedWhileArmed == 0)
+        {
+            openedWhileArmed = firstOpened;
+        }
+
+        auto loopStart = Clock::now();
+        alarm->onLoop();
+        auto elapsed = Clock::now() - loopStart;
+        loopTime += elapsed;
+        auto elapsedMs = std::chrono::duration<double, std::milli>(elapsed).count();
+        loopUs.samples.push_back(elapsedMs * 1000.0);
+
+        switch (alarm->state())
+        {
+        case AlarmState::AlarmTriggered:
+            triggers++;
+            if (openedWhileArmed != 0)
+            {
+                sirenMs.samples.push_back(now - openedWhileArmed + elapsedMs);
+            }
+            else
+            {
+                // A sensor timed out, because its frames were lost or dropped
+                triggersWithoutOpen++;
+            }
+            openedWhileArmed = 0;
+            alarm->disarm();
+            break;
+        case AlarmState::Disarmed:
+            if (!fleet.anyOpen() && alarm->arm())
+            {
+                armings++;
+                openedWhileArmed = 0;
+            }
+            break;
+        default:
+            break;
+        }
+
+        drainSideEffects();
+    }
+
+    auto wallSeconds = secondsSince(runStart);
+    auto loopSeconds = std::chrono::duration<double>(loopTime).count();
+    auto stats = alarm->ingestStats();
+    auto eventsProcessed = stats.eventsProcessed - baseline.eventsProcessed;
+
+    printf("\nSimulated %lu minutes in %.2f s\n", options.minutes, wallSeconds);
+    printf("Frames sent %llu, lost %llu, corrupted %llu, duplicated %llu\n",
+            static_cast<unsigned long long>(fleet.framesSent()),
+            static_cast<unsigned long long>(fleet.framesLost()),
+            static_cast<unsigned long long>(fleet.framesCorrupted()),
+            static_cast<unsigned long long>(fleet.framesDuplicated()));
+    printf("Offered load %.1f frames/s of virtual time\n", fleet.framesSent() / (options.minutes * 60.0));
+    printf("Events processed %u, merged %u, dropped %u, queue high water %u\n",
+            eventsProcessed,
+            stats.eventsMerged - baseline.eventsMerged,
+            stats.eventsDropped - baseline.eventsDropped,
+            stats.queueHighWater);
+    printf("Priority lane events %u, high water %u\n",
+            stats.priorityEvents - baseline.priorityEvents,
+            stats.priorityQueueHighWater);
+    printf("Frames rejected: invalid %u, duplicate %u, out of order %u, stale %u\n",
+            stats.framesInvalid - baseline.framesInvalid,
+            stats.framesDuplicate - baseline.framesDuplicate,
+            stats.framesOutOfOrder - baseline.framesOutOfOrder,
+            stats.framesStale - baseline.framesStale);
+    printf("Ingest capacity %.0f events/s of loop time (%.3f s in onLoop())\n",
+            loopSeconds > 0 ? eventsProcessed / loopSeconds : 0.0, loopSeconds);
+    printf("Armed %u times, triggered %u times, %u by sensor timeout\n", armings, triggers, triggersWithoutOpen);
+    loopUs.print("onLoop() time", "us");
+    sirenMs.print("Frame to siren", "ms");
+    printLatency("Loop time per subsystem", alarm->latencyStats());
+    printLatency("Sensor event time per stage", alarm->frameLatencyStats());
+
+    return 0;
+}
@@ -0,0 +1,81 @@
+// Encode/decode cost of the version 2 sensor frame against the version 1
+// raw SensorState memcpy it replaced.
+#include "protocol.h"
+
+#include <chrono>
+#include <stdio.h>
+
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+const uint32_t iterations = 10000000;
+
+double nsPer(Clock::duration elapsed, size_t operations)
+{
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / operations;
+}
+
+}
+
+
+int main()
+{
+    uint8_t buffer[sensorFrameV1Size];
+    volatile uint32_t sink = 0;
+
+    // Version 1: raw struct copy both ways
+    auto start = Clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        SensorState state{ESP_SLEEP_WAKEUP_EXT0, static_cast<SensorState::State>(i & 1), 3.3f};
+        memcpy(buffer, &state, sizeof(state));
+        sink = sink + buffer[4];
+    }
+    auto v1EncodeTime = Clock::now() - start;
+
+    start = Clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        buffer[4] = i & 1;
+        SensorFrame frame;
+        sink = sink + frame.decode(buffer, sensorFrameV1Size) + frame.state;
+    }
+    auto v1DecodeTime = Clock::now() - start;
+
+    // Version 2: byte serialization with CRC
+    start = Clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        SensorFrame frame;
+        frame.wakeupReason = ESP_SLEEP_WAKEUP_EXT0;
+        frame.state = static_cast<SensorState::State>(i & 1);
+        frame.vccMillivolts = 3300;
+        frame.sequence = i;
+        sink = sink + frame.encode(buffer, sizeof(buffer)) + buffer[8];
+    }
+    auto v2EncodeTime = Clock::now() - start;
+
+    uint8_t frames[2][sensorFrameSize];
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        SensorFrame frame;
+        frame.state = static_cast<SensorState::State>(i);
+        frame.encode(frames[i], sensorFrameSize);
+    }
+    start = Clock::now();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        SensorFrame frame;
+        sink = sink + frame.decode(frames[i & 1], sensorFrameSize) + frame.state;
+    }
+    auto v2DecodeTime = Clock::now() - start;
+
+    printf("v1 (%2zu bytes): encode %5.1f ns, decode %5.1f ns\n", sensorFrameV1Size, nsPer(v1EncodeTime, iterations), nsPer(v1DecodeTime, iterations));
+    printf("v2 (%2zu bytes): encode %5.1f ns, decode %5.1f ns\n", sensorFrameSize, nsPer(v2EncodeTime, iterations), nsPer(v2DecodeTime, iterations));
+    printf("(%u)\n", static_cast<unsigned>(sink));
+
+    return 0;
+}
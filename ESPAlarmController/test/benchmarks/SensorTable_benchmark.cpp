@@ -0,0 +1,176 @@
+// Compares the flat SensorTable behind SensorMap against the std::map it
+// replaced: ID lookup, inserting new sensors, a full scan like
+// AlarmPolicy::canArm() and heap memory per sensor.
+#include "AlarmSensor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+
+namespace
+{
+
+// Live heap bytes, tracked by the operator new/delete replacements below.
+size_t liveBytes = 0;
+
+// The malloc() block behind a pointer handed out by operator new. Going
+// through an integer keeps the compiler from taking the block's free() for
+// a mismatched delete of the pointer.
+size_t* mallocBlock(void* p)
+{
+    return reinterpret_cast<size_t*>(reinterpret_cast<uintptr_t>(p) - sizeof(max_align_t));
+}
+
+}
+
+void* operator new(size_t size)
+{
+    // Keep the size in front of the block so delete can account for it.
+    auto* block = static_cast<size_t*>(std::malloc(size + sizeof(max_align_t)));
+    if (block == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    *block = size;
+    liveBytes += size;
+    return reinterpret_cast<char*>(block) + sizeof(max_align_t);
+}
+
+void operator delete(void* p) noexcept
+{
+    if (p == nullptr)
+    {
+        return;
+    }
+    auto* block = mallocBlock(p);
+    liveBytes -= *block;
+    std::free(block);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+using StdSensorMap = std::map<uint64_t, AlarmSensor>;
+
+const size_t sensorCounts[] = { 16, 256, 4096 };
+const size_t lookupsPerRun = 2000000;
+const size_t scansPerRun = 2000000;
+
+std::vector<uint64_t> makeSensorIds(size_t count)
+{
+    // MAC address like IDs from a couple of vendor prefixes, in random order.
+    std::vector<uint64_t> ids;
+    uint64_t state = 12345;
+    for (size_t i = 0; i < count; ++i)
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        uint64_t prefix = (i & 1) ? 0x30AEA4000000ull : 0x246F28000000ull;
+        ids.push_back(prefix | ((state >> 40) & 0xFFFFFF));
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    state = 999;
+    for (size_t i = ids.size() - 1; i > 0; --i)
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        std::swap(ids[i], ids[(state >> 33) % (i + 1)]);
+    }
+    return ids;
+}
+
+double nsPer(Clock::duration elapsed, size_t operations)
+{
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / operations;
+}
+
+template<typename Map>
+void insertSensors(Map& sensors, const std::vector<uint64_t>& ids)
+{
+    for (auto id : ids)
+    {
+        sensors[id] = AlarmSensor(id, (id & 1) != 0, "", SensorState::Closed);
+    }
+}
+
+template<typename Map>
+void benchmark(const char* name, const std::vector<uint64_t>& ids)
+{
+    // Insert
+    const size_t insertRuns = std::max<size_t>(1, 65536 / ids.size());
+    auto bytesBefore = liveBytes;
+    Clock::duration insertTime(0);
+    size_t bytesPerSensor = 0;
+    for (size_t run = 0; run < insertRuns; ++run)
+    {
+        auto start = Clock::now();
+        Map sensors;
+        insertSensors(sensors, ids);
+        insertTime += Clock::now() - start;
+        bytesPerSensor = (liveBytes - bytesBefore) / ids.size();
+    }
+
+    Map sensors;
+    insertSensors(sensors, ids);
+
+    // Lookup
+    uint64_t found = 0;
+    auto start = Clock::now();
+    for (size_t i = 0; i < lookupsPerRun; ++i)
+    {
+        auto it = sensors.find(ids[i % ids.size()]);
+        found += it->second.enabled;
+    }
+    auto lookupTime = Clock::now() - start;
+
+    // Full scan, like AlarmPolicy::canArm()
+    const size_t scans = std::max<size_t>(1, scansPerRun / ids.size());
+    uint64_t enabled = 0;
+    start = Clock::now();
+    for (size_t i = 0; i < scans; ++i)
+    {
+        for (const auto& pair : sensors)
+        {
+            enabled += pair.second.enabled && pair.second.state != SensorState::Open;
+        }
+    }
+    auto scanTime = Clock::now() - start;
+
+    printf("%-12s %6zu sensors: insert %8.1f ns, lookup %6.1f ns, scan %6.2f ns/sensor, %4zu bytes/sensor (%llu %llu)\n",
+            name,
+            ids.size(),
+            nsPer(insertTime, insertRuns * ids.size()),
+            nsPer(lookupTime, lookupsPerRun),
+            nsPer(scanTime, scans * ids.size()),
+            bytesPerSensor,
+            static_cast<unsigned long long>(found),
+            static_cast<unsigned long long>(enabled));
+}
+
+}
+
+
+int main()
+{
+    printf("sizeof(AlarmSensor) = %zu\n", sizeof(AlarmSensor));
+    for (auto count : sensorCounts)
+    {
+        auto ids = makeSensorIds(count);
+        benchmark<StdSensorMap>("std::map", ids);
+        benchmark<SensorMap>("SensorTable", ids);
+    }
+
+    return 0;
+}
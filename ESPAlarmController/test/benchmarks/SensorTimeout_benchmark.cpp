@@ -0,0 +1,150 @@
+// Per-tick cost of finding the sensors that missed their heartbeat, by
+// calling AlarmPolicy::checkSensor on every sensor like checkSensors() used
+// to, against popping the due sensors off the SensorDeadlines heap. The
+// fleet is armed and healthy: every sensor reports on time, so no tick has
+// anything to do. Also measures what rescheduling costs on each heartbeat.
+#include "ActivityLog.h"
+#include "AlarmPolicy.h"
+#include "alarm_config.h"
+#include "mockControl.h"
+#include "SensorDeadlines.h"
+
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <vector>
+
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+const size_t sensorCounts[] = { 1000, 2500, 5000, 10000 };
+const unsigned long tickMs = 1000;
+// Four heartbeat intervals, so every sensor reports several times
+const unsigned long ticks = 4 * SENSOR_UPDATE_INTERVAL_MS / tickMs;
+
+double nsPer(Clock::duration elapsed, size_t operations)
+{
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / operations;
+}
+
+SensorMap makeSensors(size_t count)
+{
+    SensorMap sensors;
+    sensors.reserve(count);
+    for (uint64_t id = 1; id <= count; ++id)
+    {
+        sensors.insert(0x30AEA4000000ull + id, AlarmSensor(0x30AEA4000000ull + id, true, "", SensorState::Closed));
+    }
+    return sensors;
+}
+
+// Runs the fleet for ticks seconds. Each sensor reports once per heartbeat
+// interval, staggered over the interval. Returns the time spent in check.
+template<typename Heartbeat, typename Check>
+Clock::duration run(SensorMap& sensors, Heartbeat heartbeat, Check check, size_t& heartbeats)
+{
+    Clock::duration checkTime{};
+    heartbeats = 0;
+    unsigned long start = 1000;
+    const unsigned long ticksPerHeartbeat = SENSOR_UPDATE_INTERVAL_MS / tickMs;
+    for (unsigned long tick = 0; tick < ticks; ++tick)
+    {
+        auto now = start + tick * tickMs;
+        setUptimeMillis(now);
+
+        size_t i = 0;
+        for (auto& pair : sensors)
+        {
+            if (i++ % ticksPerHeartbeat == tick % ticksPerHeartbeat)
+            {
+                pair.second.updateState(SensorState::Closed);
+                heartbeat(pair.second);
+                heartbeats++;
+            }
+        }
+
+        auto checkStart = Clock::now();
+        check();
+        checkTime += Clock::now() - checkStart;
+    }
+    return checkTime;
+}
+
+}
+
+
+int main()
+{
+    ActivityLog log;
+    AlarmPolicy policy(log);
+    auto alarmState = AlarmState::Armed;
+
+    printf("%-10s %20s %20s %22s\n", "sensors", "scan per tick", "heap per tick", "heap per heartbeat");
+    for (auto sensorCount : sensorCounts)
+    {
+        size_t heartbeats = 0;
+        size_t actionsTaken = 0;
+
+        auto sensors = makeSensors(sensorCount);
+        auto scanTime = run(sensors, [](const AlarmSensor&) {}, [&]() {
+            for (auto& pair : sensors)
+            {
+                AlarmPolicy::Actions actions;
+                policy.checkSensor(actions, pair.second, alarmState);
+                actionsTaken += actions.triggerAlarm || actions.playSound;
+            }
+        }, heartbeats);
+
+        // The heartbeats here include rescheduling, so time them separately
+        // from the ticks.
+        sensors = makeSensors(sensorCount);
+        auto deadlines = std::make_unique<SensorDeadlines>();
+        std::vector<uint64_t> expired;
+        Clock::duration rescheduleTime{};
+        auto schedule = [&](const AlarmSensor& sensor) {
+            auto start = Clock::now();
+            unsigned long checkTime;
+            if (policy.nextSensorCheck(sensor, alarmState, checkTime))
+            {
+                deadlines->set(sensor.id, checkTime);
+            }
+            else
+            {
+                deadlines->remove(sensor.id);
+            }
+            rescheduleTime += Clock::now() - start;
+        };
+        setUptimeMillis(1000);
+        for (auto& pair : sensors)
+        {
+            pair.second.updateState(SensorState::Closed);
+            schedule(pair.second);
+        }
+        rescheduleTime = Clock::duration{};
+        auto heapTime = run(sensors, schedule, [&]() {
+            expired.clear();
+            deadlines->popExpired(millis(), expired);
+            for (auto sensorId : expired)
+            {
+                auto it = sensors.find(sensorId);
+                AlarmPolicy::Actions actions;
+                policy.checkSensor(actions, it->second, alarmState);
+                actionsTaken += actions.triggerAlarm || actions.playSound;
+                schedule(it->second);
+            }
+        }, heartbeats);
+
+        if (actionsTaken != 0)
+        {
+            printf("unexpected sensor timeouts: %zu\n", actionsTaken);
+            return 1;
+        }
+        printf("%-10zu %17.1f ns %17.1f ns %19.1f ns\n", sensorCount,
+               nsPer(scanTime, ticks), nsPer(heapTime, ticks), nsPer(rescheduleTime, heartbeats));
+    }
+
+    return 0;
+}
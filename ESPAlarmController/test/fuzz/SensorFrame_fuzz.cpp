@@ -0,0 +1,78 @@
+// Fuzz target for SensorFrame::decode(), the first code to touch bytes
+// received over the air.
+//
+// With clang and -DENABLE_FUZZING=ON this builds as a libFuzzer target:
+//   ./test/fuzz/SensorFrame_fuzz ../test/fuzz/corpus/SensorFrame
+// Otherwise it builds a driver that replays the files given on the command
+// line, which CTest uses to run the corpus as a regression test.
+#include "protocol.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <vector>
+
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    SensorFrame frame;
+    if (!frame.decode(data, size))
+    {
+        return 0;
+    }
+
+    assert(frame.state <= SensorState::Fault);
+    assert(frame.type == SensorFrame::Type::StateReport || frame.type == SensorFrame::Type::BatchReport);
+    assert(frame.edgeCount >= 1 && frame.edgeCount <= SensorFrame::maxEdges);
+    assert(frame.edges[frame.edgeCount - 1].state == frame.state);
+
+    // Anything accepted must survive a round trip through the v2 encoding.
+    uint8_t buffer[sensorBatchFrameSize(SensorFrame::maxEdges)];
+    auto len = frame.encode(buffer, sizeof(buffer));
+    assert(len == (frame.edgeCount > 1 ? sensorBatchFrameSize(frame.edgeCount) : sensorFrameSize));
+
+    SensorFrame decoded;
+    bool decodedOk = decoded.decode(buffer, len);
+    assert(decodedOk);
+    assert(decoded.state == frame.state);
+    assert(decoded.wakeupReason == frame.wakeupReason);
+    assert(decoded.vccMillivolts == frame.vccMillivolts);
+    assert(decoded.sequence == frame.sequence);
+    assert(decoded.sequenceReset == frame.sequenceReset);
+    assert(decoded.edgeCount == frame.edgeCount);
+    for (size_t i = 0; i < frame.edgeCount; ++i)
+    {
+        assert(decoded.edges[i].state == frame.edges[i].state);
+        assert(decoded.edges[i].ageMs == frame.edges[i].ageMs);
+    }
+    (void)decodedOk;
+
+    return 0;
+}
+
+#ifndef FUZZING_BUILD
+int main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        auto* file = fopen(argv[i], "rb");
+        if (file == nullptr)
+        {
+            fprintf(stderr, "Cannot open %s\n", argv[i]);
+            return 1;
+        }
+
+        std::vector<uint8_t> data;
+        int c;
+        while ((c = fgetc(file)) != EOF)
+        {
+            data.push_back(static_cast<uint8_t>(c));
+        }
+        fclose(file);
+
+        LLVMFuzzerTestOneInput(data.data(), data.size());
+    }
+
+    printf("Replayed %d inputs\n", argc - 1);
+    return 0;
+}
+#endif
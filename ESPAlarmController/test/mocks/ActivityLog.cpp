@@ -1,5 +1,30 @@
 #include "ActivityLog.h"
 
+#include "TestActivityLog.h"
+
+
+namespace
+{
+
+bool _recordEvents = false;
+std::vector<ActivityLog::EventType> _loggedEvents;
+
+}
+
+
+void recordLoggedEvents(bool record)
+{
+    _recordEvents = record;
+    _loggedEvents.clear();
+}
+
+std::vector<ActivityLog::EventType> takeLoggedEvents()
+{
+    std::vector<ActivityLog::EventType> events;
+    events.swap(_loggedEvents);
+    return events;
+}
+
 
 ActivityLog::ActivityLog()
 {
@@ -9,5 +34,8 @@ ActivityLog::ActivityLog()
 
 void ActivityLog::logEvent(EventType type, uint64_t sensorId)
 {
-    
+    if (_recordEvents)
+    {
+        _loggedEvents.push_back(type);
+    }
 }
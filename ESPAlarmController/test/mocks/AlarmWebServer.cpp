@@ -1,5 +1,20 @@
 #include "AlarmWebServer.h"
 
+#include "TestAlarmWebServer.h"
+
+
+namespace
+{
+
+std::function<void()> webServerLoopHook;
+
+}
+
+void setWebServerLoopHook(std::function<void()> hook)
+{
+    webServerLoopHook = hook;
+}
+
 
 AlarmSystemWebServer::AlarmSystemWebServer(AlarmSystem& alarmSystem, ActivityLog& activityLog)
     :
@@ -16,5 +31,8 @@ void AlarmSystemWebServer::begin()
 
 void AlarmSystemWebServer::onLoop()
 {
-
+    if (webServerLoopHook)
+    {
+        webServerLoopHook();
+    }
 }
@@ -44,6 +44,21 @@ bool TestESPNowServer::send(const uint8_t * mac_addr, const uint8_t *incomingDat
     return true;
 }
 
+void TestESPNowServer::recordReply(const uint8_t * mac_addr, const uint8_t *data, size_t len)
+{
+    _replies.push_back(std::vector<uint8_t>(data, data + len));
+}
+
+const std::vector<std::vector<uint8_t>>& TestESPNowServer::replies() const
+{
+    return _replies;
+}
+
+void TestESPNowServer::clearReplies()
+{
+    _replies.clear();
+}
+
 ESPNowServer* ESPNowServer::_this = nullptr;
 
 ESPNowServer::ESPNowServer(const String& apSSID, const String& apPassword, OnReceiveCallback onReceive)
@@ -73,3 +88,9 @@ bool ESPNowServer::begin()
 {
     return true;
 }
+
+bool ESPNowServer::send(const uint8_t * mac_addr, const uint8_t *data, size_t len)
+{
+    TestESPNowServer::instance().recordReply(mac_addr, data, len);
+    return true;
+}
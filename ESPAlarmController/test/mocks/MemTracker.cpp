@@ -1,7 +1,7 @@
 #include <MemTracker.h>
 
 
-void MemTracker::onLoop()
+void MemTracker::report()
 {
     
 }
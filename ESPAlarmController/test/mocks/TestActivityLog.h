@@ -0,0 +1,13 @@
+#pragma once
+
+#include "ActivityLog.h"
+
+#include <vector>
+
+
+// The mock ActivityLog drops events unless a test asks for them. Not thread
+// safe, only turn it on in single threaded tests.
+void recordLoggedEvents(bool record);
+
+// Events logged since the last call
+std::vector<ActivityLog::EventType> takeLoggedEvents();
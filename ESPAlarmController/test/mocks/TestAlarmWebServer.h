@@ -0,0 +1,7 @@
+#pragma once
+
+#include <functional>
+
+
+// Called from AlarmSystemWebServer::onLoop() to simulate web client handling.
+void setWebServerLoopHook(std::function<void()> hook);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <vector>
 
 #include <ESPNowServer.h>
 
@@ -14,10 +15,15 @@ public:
     void registerServer(ESPNowServer* self, OnReceiveCallback onReceive);
     void unregisterServer(ESPNowServer* self);
     bool send(const uint8_t * mac_addr, const uint8_t *incomingData, int len);
+    // Replies sent by the server, oldest first
+    void recordReply(const uint8_t * mac_addr, const uint8_t *data, size_t len);
+    const std::vector<std::vector<uint8_t>>& replies() const;
+    void clearReplies();
 protected:
     TestESPNowServer();
     static TestESPNowServer _instance;
 private:
     ESPNowServer* _self;
     OnReceiveCallback _onReceive;
+    std::vector<std::vector<uint8_t>> _replies;
 };
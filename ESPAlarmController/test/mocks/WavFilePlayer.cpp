@@ -1,5 +1,7 @@
 #include <WavFilePlayer.h>
 
+#include <Arduino.h>
+
 #include "TestWavFilePlayer.h"
 
 #include <deque>
@@ -9,6 +11,11 @@ namespace
 {
 
 std::deque<String> _soundFilesPlayed;
+// Like the real player, the first samples go out on the next onLoop().
+// Not every test build calls the functions that use these.
+[[maybe_unused]] bool _waitingForOutput = false;
+[[maybe_unused]] bool _outputStarted = false;
+[[maybe_unused]] uint32_t _firstOutputUs = 0;
 
 }
 
@@ -44,6 +51,8 @@ bool WavFilePlayer::begin()
 bool WavFilePlayer::playWavFile(const String& wavFileName)
 {
     _soundFilesPlayed.push_back(wavFileName);
+    _waitingForOutput = true;
+    _outputStarted = false;
     return true;
 }
 
@@ -54,8 +63,28 @@ bool WavFilePlayer::filePlaying() const
 
 void WavFilePlayer::silence()
 {
+    _waitingForOutput = false;
+    _outputStarted = false;
 }
 
 void WavFilePlayer::onLoop()
 {
+    if (_waitingForOutput)
+    {
+        _waitingForOutput = false;
+        _outputStarted = true;
+        _firstOutputUs = micros();
+    }
+}
+
+bool WavFilePlayer::takeFirstOutputTime(uint32_t& outputUs)
+{
+    if (!_outputStarted)
+    {
+        return false;
+    }
+
+    _outputStarted = false;
+    outputUs = _firstOutputUs;
+    return true;
 }
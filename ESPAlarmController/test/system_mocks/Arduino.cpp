@@ -1,7 +1,10 @@
 #include "Arduino.h"
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <deque>
+#include <mutex>
 #include <thread>
 #include <vector>
 
@@ -27,18 +30,42 @@ int log_printf(const char *format, ...)
     return 0;
 }
 
-static unsigned long upTimeMillis = 0;
+static std::atomic<unsigned long> upTimeMillis(0);
+static std::atomic<bool> realTimeMillis(false);
+static std::chrono::steady_clock::time_point realTimeStart;
 
 void setUptimeMillis(unsigned long ms)
 {
     upTimeMillis = ms;
 }
 
+void setRealTimeMillis(bool enabled)
+{
+    if (enabled)
+    {
+        realTimeStart = std::chrono::steady_clock::now();
+    }
+    else
+    {
+        upTimeMillis = millis();
+    }
+    realTimeMillis = enabled;
+}
+
 unsigned long millis()
 {
+    if (realTimeMillis)
+    {
+        return upTimeMillis + std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - realTimeStart).count();
+    }
     return upTimeMillis;
 }
 
+unsigned long micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 void delay(uint32_t ms)
 {
     upTimeMillis += ms; // Just fast forward time. Make it so!
@@ -115,6 +142,10 @@ public:
         _queue.pop_front();
         return true;
     }
+    size_t size() const
+    {
+        return _queue.size();
+    }
     QueueItem allocateItem(const void *data) const
     {
         QueueItem item(_itemSize);
@@ -163,3 +194,131 @@ BaseType_t xQueueReceive( QueueHandle_t xQueue, void * const pvBuffer, TickType_
     memcpy(pvBuffer, &item._data[0], item._data.size());
     return pdTRUE;
 }
+
+UBaseType_t uxQueueMessagesWaiting( const QueueHandle_t xQueue )
+{
+    const Queue* queue = reinterpret_cast<const Queue*>(xQueue);
+
+    return queue->size();
+}
+
+
+class Task
+{
+public:
+    void notify()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _notifyCount++;
+        _notified.notify_one();
+    }
+    uint32_t take(bool clearCountOnExit, TickType_t ticksToWait)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto notified = [this]() { return _notifyCount > 0; };
+        if (ticksToWait == portMAX_DELAY)
+        {
+            _notified.wait(lock, notified);
+        }
+        else
+        {
+            _notified.wait_for(lock, std::chrono::milliseconds(ticksToWait), notified);
+        }
+
+        auto count = _notifyCount;
+        if (count > 0)
+        {
+            _notifyCount = clearCountOnExit ? 0 : _notifyCount - 1;
+        }
+        return count;
+    }
+private:
+    std::mutex _mutex;
+    std::condition_variable _notified;
+    uint32_t _notifyCount = 0;
+};
+
+// Like the queues, tasks are never freed so a late notification can't touch freed memory.
+std::mutex tasksMutex;
+std::vector<std::unique_ptr<Task>> tasks;
+thread_local Task* currentTask = nullptr;
+
+Task* createTask()
+{
+    std::lock_guard<std::mutex> lock(tasksMutex);
+    tasks.push_back(std::make_unique<Task>());
+    return tasks.back().get();
+}
+
+BaseType_t xTaskCreatePinnedToCore( TaskFunction_t pvTaskCode, const char * const pcName, const uint32_t usStackDepth,
+                                    void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pvCreatedTask,
+                                    const BaseType_t xCoreID )
+{
+    auto* task = createTask();
+    if (pvCreatedTask != nullptr)
+    {
+        *pvCreatedTask = task;
+    }
+
+    std::thread([task, pvTaskCode, pvParameters]() {
+        currentTask = task;
+        pvTaskCode(pvParameters);
+    }).detach();
+
+    return pdPASS;
+}
+
+void vTaskDelete( TaskHandle_t xTaskToDelete )
+{
+}
+
+void vTaskDelay( const TickType_t xTicksToDelay )
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(xTicksToDelay));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle( void )
+{
+    if (currentTask == nullptr)
+    {
+        currentTask = createTask();
+    }
+
+    return currentTask;
+}
+
+BaseType_t xTaskNotifyGive( TaskHandle_t xTaskToNotify )
+{
+    reinterpret_cast<Task*>(xTaskToNotify)->notify();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake( BaseType_t xClearCountOnExit, TickType_t xTicksToWait )
+{
+    return reinterpret_cast<Task*>(xTaskGetCurrentTaskHandle())->take(xClearCountOnExit == pdTRUE, xTicksToWait);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex( void )
+{
+    return new std::recursive_mutex;
+}
+
+void vSemaphoreDelete( SemaphoreHandle_t xSemaphore )
+{
+    delete reinterpret_cast<std::recursive_mutex*>(xSemaphore);
+}
+
+BaseType_t xSemaphoreTakeRecursive( SemaphoreHandle_t xMutex, TickType_t xTicksToWait )
+{
+    // TODO: suppor this as needed
+    assert(xTicksToWait == portMAX_DELAY);
+
+    reinterpret_cast<std::recursive_mutex*>(xMutex)->lock();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive( SemaphoreHandle_t xMutex )
+{
+    reinterpret_cast<std::recursive_mutex*>(xMutex)->unlock();
+    return pdTRUE;
+}
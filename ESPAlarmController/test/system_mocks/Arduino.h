@@ -33,6 +33,8 @@ typedef enum {
 
 
 unsigned long millis();
+// Real time, unlike millis(), for measuring how long code takes.
+unsigned long micros();
 void delay(uint32_t);
 
 const char * pathToFileName(const char * path);
@@ -67,5 +69,29 @@ typedef uint16_t        TickType_t;
 QueueHandle_t xQueueCreate( const UBaseType_t uxQueueLength, const UBaseType_t uxItemSize );
 BaseType_t xQueueSend( QueueHandle_t xQueue, const void * const pvItemToQueue, TickType_t xTicksToWait );
 BaseType_t xQueueReceive( QueueHandle_t xQueue, void * const pvBuffer, TickType_t xTicksToWait );
+UBaseType_t uxQueueMessagesWaiting( const QueueHandle_t xQueue );
+
+// Tasks are backed by std::threads. Tick periods are real milliseconds.
+typedef void * TaskHandle_t;
+typedef void (*TaskFunction_t)( void * );
+#define portMAX_DELAY       ( TickType_t ) 0xffff
+#define pdMS_TO_TICKS( xTimeInMs )  ( ( TickType_t ) ( xTimeInMs ) )
+
+BaseType_t xTaskCreatePinnedToCore( TaskFunction_t pvTaskCode, const char * const pcName, const uint32_t usStackDepth,
+                                    void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pvCreatedTask,
+                                    const BaseType_t xCoreID );
+// On the host this only returns. The calling task function must return right after it.
+void vTaskDelete( TaskHandle_t xTaskToDelete );
+void vTaskDelay( const TickType_t xTicksToDelay );
+TaskHandle_t xTaskGetCurrentTaskHandle( void );
+BaseType_t xTaskNotifyGive( TaskHandle_t xTaskToNotify );
+uint32_t ulTaskNotifyTake( BaseType_t xClearCountOnExit, TickType_t xTicksToWait );
+
+typedef void * SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex( void );
+void vSemaphoreDelete( SemaphoreHandle_t xSemaphore );
+BaseType_t xSemaphoreTakeRecursive( SemaphoreHandle_t xMutex, TickType_t xTicksToWait );
+BaseType_t xSemaphoreGiveRecursive( SemaphoreHandle_t xMutex );
 
 #include "Stream.h"
\ No newline at end of file
@@ -1,9 +1,31 @@
 #include "FileData.h"
 
+#include "mockControl.h"
+
+#include <atomic>
 #include <cassert>
 #include <string.h>
 
 
+static std::atomic<size_t> bytesWritten(0);
+static std::atomic<size_t> storageAllocations(0);
+
+size_t fileBytesWritten()
+{
+    return bytesWritten;
+}
+
+void resetFileBytesWritten()
+{
+    bytesWritten = 0;
+}
+
+size_t fileStorageAllocations()
+{
+    return storageAllocations;
+}
+
+
 bool FileData::isOpen() const
 {
     return _openCount > 0;
@@ -57,6 +79,10 @@ size_t FileData::size() const
 
 void FileData::setSize(size_t newSize)
 {
+    if (newSize > _data.capacity())
+    {
+        storageAllocations++;
+    }
     _data.resize(newSize);
 }
 
@@ -79,5 +105,6 @@ bool FileData::write(const uint8_t* buf, size_t offset, size_t len)
     }
 
     memcpy(&_data[offset], buf, len);
+    bytesWritten += len;
     return true;
 }
@@ -68,6 +68,11 @@ File FSImpl::open(const String& path, const char* mode)
             if (fileData->open(FileData::OpenMode::Write))
             {
                 size_t startOffset = modeString == FILE_APPEND ? fileData->size() : 0;
+                if (modeString == FILE_WRITE)
+                {
+                    // Like SPIFFS, writing replaces the file's contents
+                    fileData->setSize(0);
+                }
                 return File(std::make_shared<FileImpl>(this, fileData, startOffset, false));
             }
             return File(nullptr);
@@ -128,7 +133,7 @@ bool FSImpl::rename(const String& pathFrom, const String& pathTo)
     // TODO: For now don't allow the use of directories.
     String mapNameFrom;
     String mapNameTo;
-    if (!validatePath(pathFrom, mapNameFrom) && !validatePath(pathTo, mapNameTo))
+    if (!validatePath(pathFrom, mapNameFrom) || !validatePath(pathTo, mapNameTo))
     {
         return false;
     }
@@ -1,4 +1,16 @@
 #pragma once
 
+#include <stddef.h>
 
-void setUptimeMillis(unsigned long ms);
\ No newline at end of file
+
+void setUptimeMillis(unsigned long ms);
+// By default millis() only moves on with delay() and setUptimeMillis(). With
+// real time enabled it follows the wall clock, for tests running tasks.
+void setRealTimeMillis(bool enabled);
+// Bytes written to files since the last reset, to measure how much a change
+// to a file costs.
+size_t fileBytesWritten();
+void resetFileBytesWritten();
+// Heap allocations made to hold file contents, which stand in for flash, so
+// tests counting allocations can leave them out.
+size_t fileStorageAllocations();
@@ -24,11 +24,64 @@
 #include <alarm_config.h>
 #include "protocol.h"
 
+#include <string.h>
+#include <sys/time.h>
+
 
 // TODO: This does not work :(
 extern "C" int rom_phy_get_vdd33();
 
 
+namespace
+{
+
+// Survives deep sleep, reset to the initial values on power on.
+RTC_DATA_ATTR uint16_t nextFrameSequence = 0;
+RTC_DATA_ATTR bool frameSequenceStarted = false;
+
+// State changes not delivered to the controller yet, oldest first.
+RTC_DATA_ATTR SensorState::State pendingStates[SensorFrame::maxEdges];
+RTC_DATA_ATTR int64_t pendingTimesMs[SensorFrame::maxEdges];
+RTC_DATA_ATTR uint8_t pendingCount = 0;
+RTC_DATA_ATTR SensorState::State lastRecordedState = SensorState::Unknown;
+RTC_DATA_ATTR int64_t lastTransmitMs = 0;
+RTC_DATA_ATTR bool hasTransmitted = false;
+// Reports that failed since the last one delivered, for the retry backoff.
+RTC_DATA_ATTR uint8_t failedReports = 0;
+
+// Unlike millis(), this keeps counting through deep sleep.
+int64_t rtcMillis()
+{
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return static_cast<int64_t>(tv.tv_sec) * 1000 + tv.tv_usec / 1000;
+}
+
+void recordState(SensorState::State state, int64_t now)
+{
+    if (state == lastRecordedState)
+    {
+        return;
+    }
+
+    if (pendingCount == SensorFrame::maxEdges)
+    {
+        // Can't happen: the sensor stops holding off when the batch is full.
+        // Keep the newest changes so the controller ends up in the right state.
+        memmove(pendingStates, pendingStates + 1, sizeof(pendingStates[0]) * (pendingCount - 1));
+        memmove(pendingTimesMs, pendingTimesMs + 1, sizeof(pendingTimesMs[0]) * (pendingCount - 1));
+        pendingCount--;
+    }
+
+    pendingStates[pendingCount] = state;
+    pendingTimesMs[pendingCount] = now;
+    pendingCount++;
+    lastRecordedState = state;
+}
+
+}
+
+
 ContactSensorApp::ContactSensorApp(gpio_num_t sensorPin, const String& ssid, const ESPNowClient::BroadCastAddress& broadCastAddress)
     :
     _switchSensor(sensorPin),
@@ -39,18 +92,71 @@ ContactSensorApp::ContactSensorApp(gpio_num_t sensorPin, const String& ssid, con
 
 void ContactSensorApp::run()
 {
-    if (!reportState())
+    auto now = rtcMillis();
+    if (!setup())
     {
-        Serial.println("Failed to report state. Rebooting in 3 seconds...\n");
+        Serial.println("Failed to setup contact sensor app. Rebooting in 3 seconds...\n");
         delay(3 * 1000);
         ESP.restart();
         return;
     }
 
+    recordState(_initialState, now);
+    if (holdOff(now))
+    {
+        Serial.printf("Holding off %u state changes\n", pendingCount);
+        _deepSleep.sleep();
+        return;
+    }
+
+    if (!reportState())
+    {
+        // A restart would reinitialize RTC memory, losing the changes not
+        // delivered yet and the sequence number. Deep sleep keeps both.
+        // Back off like deliver() does between attempts, only in steps of
+        // seconds, so a controller that is down doesn't drain the battery.
+        if (failedReports < UINT8_MAX)
+        {
+            failedReports++;
+        }
+        auto window = backoffWindowMs(SENSOR_RETRY_BACKOFF_MS, SENSOR_UPDATE_INTERVAL_MS, failedReports);
+        auto retryMs = window / 2 + esp_random() % (window / 2 + 1);
+        Serial.printf("Failed to report state. Retrying in %lu ms\n", retryMs);
+        _deepSleep.wakeupOnTimer(static_cast<uint64_t>(retryMs) * 1000);
+        _deepSleep.sleep();
+        return;
+    }
+    failedReports = 0;
+
     Serial.println("Sleeping...");
     _deepSleep.sleep();
 }
 
+bool ContactSensorApp::holdOff(int64_t now)
+{
+    // Bringing up the radio costs far more than a frame, so a sensor that
+    // just transmitted collects further state changes for a while and sends
+    // them together. The first change after a quiet period goes out at once.
+    if (!hasTransmitted || pendingCount == 0 || pendingCount >= SensorFrame::maxEdges)
+    {
+        return false;
+    }
+
+    if (_deepSleep.wakeupCause() != ESP_SLEEP_WAKEUP_EXT0)
+    {
+        return false;
+    }
+
+    auto sinceTransmit = now - lastTransmitMs;
+    if (sinceTransmit < 0 || sinceTransmit >= SENSOR_EDGE_HOLDOFF_MS)
+    {
+        return false;
+    }
+
+    // Wake up to send the batch when the hold off ends, or on the next change.
+    return _deepSleep.wakeupOnTimer((SENSOR_EDGE_HOLDOFF_MS - sinceTransmit) * 1000) == ESP_OK;
+}
+
 bool ContactSensorApp::setup()
 {
     _switchSensor.begin();
@@ -73,12 +179,6 @@ bool ContactSensorApp::setup()
 
 bool ContactSensorApp::reportState()
 {
-    if (!setup())
-    {
-        Serial.println("Failed to setup contact sensor app");
-        return false;
-    }
-
     Serial.printf("Wakeup caused by \"%s\"\n", SensorState::wakeupReasontoString(_deepSleep.wakeupCause()));
 
     //Init ESP-NOW
@@ -88,32 +188,64 @@ bool ContactSensorApp::reportState()
         return false;
     }
 
-    SensorState myData;
-    myData.wakeupReason = _deepSleep.wakeupCause();
-    myData.state = _initialState;
-    myData.vcc = ((float)rom_phy_get_vdd33()) / 1000;
-    auto result = _espNowClient.send((uint8_t *)&myData, sizeof(myData));
-    if (result != ESP_OK)
+    if (!sendPendingStates())
     {
-        Serial.printf("Error %d sending the data\n", result);
         return false;
     }
-    Serial.println("Sent with success");
 
     if (_switchSensor.currentState() != _initialState)
     {
         Serial.println("Current sensor state does not match initial state. Sending update");
-        myData.wakeupReason = _deepSleep.wakeupCause();
-        myData.state = _switchSensor.currentState();
-        myData.vcc = ((float)rom_phy_get_vdd33()) / 1000;
-        auto result = _espNowClient.send((uint8_t *)&myData, sizeof(myData));
-        if (result != ESP_OK)
+        recordState(_switchSensor.currentState(), rtcMillis());
+        if (!sendPendingStates())
         {
-            Serial.printf("Error %d sending the data\n", result);
             return false;
         }
-        Serial.println("Sent with success");
     }
 
     return true;
 }
+
+bool ContactSensorApp::sendPendingStates()
+{
+    auto now = rtcMillis();
+
+    SensorFrame frame;
+    frame.wakeupReason = _deepSleep.wakeupCause();
+    frame.vccMillivolts = rom_phy_get_vdd33();
+    frame.sequence = nextFrameSequence++;
+    frame.sequenceReset = !frameSequenceStarted;
+    frameSequenceStarted = true;
+    if (pendingCount > 1)
+    {
+        frame.type = SensorFrame::Type::BatchReport;
+        frame.edgeCount = pendingCount;
+        for (size_t i = 0; i < pendingCount; ++i)
+        {
+            auto age = now - pendingTimesMs[i];
+            frame.edges[i].state = pendingStates[i];
+            frame.edges[i].ageMs = age < 0 ? 0 : age > 0xFFFF ? 0xFFFF : static_cast<uint16_t>(age);
+        }
+    }
+    else
+    {
+        // A single change, or a periodic report of the current state
+        frame.state = lastRecordedState;
+    }
+
+    uint8_t buffer[sensorBatchFrameSize(SensorFrame::maxEdges)];
+    auto frameSize = frame.encode(buffer, sizeof(buffer));
+    auto result = _espNowClient.sendWithAck(buffer, frameSize, frame.sequence);
+    if (!result.delivered)
+    {
+        // The changes stay in RTC memory for the next attempt.
+        Serial.printf("Frame %u not acknowledged after %u attempts\n", frame.sequence, result.attempts);
+        return false;
+    }
+    Serial.printf("Sent %u state changes with success after %u attempts\n", pendingCount, result.attempts);
+
+    pendingCount = 0;
+    lastTransmitMs = now;
+    hasTransmitted = true;
+    return true;
+}
@@ -33,7 +33,9 @@ public:
     void run();
 private:
     bool setup();
+    bool holdOff(int64_t now);
     bool reportState();
+    bool sendPendingStates();
     SwitchSensor _switchSensor;
     ESPNowClient _espNowClient;
     ESPDeepSleep _deepSleep;
@@ -14,6 +14,11 @@
 #define MAX_SENSOR_UPDATE_TIMEOUT_DISARMED_MS   (2 * 60 * 1000) // 2 minutes
 #define MAX_SENSOR_UPDATE_TIMEOUT_ARMED_MS      (1 * 60 * 1000) // 1 minute
 #define SENSOR_FAULT_CHIME_INTERVAL_MS          SENSOR_UPDATE_INTERVAL_MS
+#define SENSOR_EDGE_HOLDOFF_MS                  1000            // Batch state changes within 1 second of a report
+#define SENSOR_RETRY_BACKOFF_MS                 1000            // First retry of a failed report, doubling up to SENSOR_UPDATE_INTERVAL_MS
+
+// Run the alarm system on its own tasks instead of the Arduino loop task.
+#define ALARM_SYSTEM_USE_TASKS  1
 
 // TODO: Store on flash and make user configurable.
 #define TZ_OFFSET       (-7 * 3600)
@@ -23,6 +23,8 @@
 
 #include <Arduino.h>
 
+#include <string.h>
+
 
 struct SensorState
 {
@@ -80,3 +82,341 @@ struct SensorState
     }
 };
 
+
+
+// Version 2 sensor frame. Version 1 frames were a raw SensorState, whose
+// layout depends on the compiler (enum size, padding and float format).
+// Version 2 frames are serialized byte by byte, multi-byte fields little
+// endian:
+//
+//   0  version (sensorFrameVersion)
+//   1  message type (SensorFrame::Type)
+//   2  state in the low nibble, flags in the high nibble
+//   3  wakeup reason
+//   4  battery voltage in millivolts (uint16_t)
+//   6  sequence number (uint16_t)
+//   8  CRC-16/CCITT-FALSE of bytes 0-7 (uint16_t)
+//
+// A batch report carries several state changes recorded while the sensor
+// held off transmitting. Bytes 0-7 are the same, with the state of the last
+// change at byte 2, followed by:
+//
+//   8  number of changes (2 to SensorFrame::maxEdges)
+//   9  per change, oldest first: state (uint8_t) and how long before the
+//      frame was sent it happened in ms (uint16_t, saturating)
+//   n  CRC-16/CCITT-FALSE of the preceding bytes (uint16_t)
+const uint8_t sensorFrameVersion = 2;
+const size_t sensorFrameSize = 10;
+const size_t sensorFrameV1Size = sizeof(SensorState);
+const size_t sensorFrameEdgeSize = 3;
+
+inline size_t sensorBatchFrameSize(size_t edgeCount)
+{
+    return 9 + edgeCount * sensorFrameEdgeSize + 2;
+}
+
+struct SensorFrame
+{
+    enum class Type : uint8_t
+    {
+        StateReport = 1,
+        Ack = 2,
+        BatchReport = 3
+    };
+
+    struct Edge
+    {
+        SensorState::State state;
+        uint16_t ageMs;
+    };
+    static const size_t maxEdges = 8;
+
+    // Set on the first frame after the sensor lost its sequence number,
+    // i.e. after a power on reset.
+    static const uint8_t flagSequenceReset = 0x10;
+
+    SensorFrame()
+        :
+        version(sensorFrameVersion),
+        type(Type::StateReport),
+        wakeupReason(0),
+        state(SensorState::Unknown),
+        vccMillivolts(0),
+        sequence(0),
+        sequenceReset(false),
+        edgeCount(0)
+    {
+    }
+
+    uint8_t version;
+    Type type;
+    uint8_t wakeupReason;
+    SensorState::State state;
+    uint16_t vccMillivolts;
+    uint16_t sequence;
+    bool sequenceReset;
+    // State changes in the order they happened. Decoding a single state
+    // report yields one change, for the reported state.
+    uint8_t edgeCount;
+    Edge edges[maxEdges];
+
+    static uint16_t crc16(const uint8_t* data, size_t len)
+    {
+        static const uint16_t table[16] = {
+            0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+            0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+        };
+        uint16_t crc = 0xFFFF;
+        for (size_t i = 0; i < len; ++i)
+        {
+            crc = (crc << 4) ^ table[(crc >> 12) ^ (data[i] >> 4)];
+            crc = (crc << 4) ^ table[(crc >> 12) ^ (data[i] & 0x0F)];
+        }
+        return crc;
+    }
+
+    // Writes a version 2 frame. Returns the frame size or 0 if the buffer is
+    // too small. Batch reports take their state from the last edge.
+    size_t encode(uint8_t* buffer, size_t bufferSize) const
+    {
+        if (type == Type::BatchReport)
+        {
+            return encodeBatch(buffer, bufferSize);
+        }
+
+        if (bufferSize < sensorFrameSize)
+        {
+            return 0;
+        }
+
+        encodeHeader(buffer, Type::StateReport, state);
+        auto crc = crc16(buffer, sensorFrameSize - 2);
+        buffer[8] = crc & 0xFF;
+        buffer[9] = crc >> 8;
+        return sensorFrameSize;
+    }
+
+    // Accepts version 2 frames and legacy version 1 (raw SensorState) frames.
+    // Returns false for anything malformed.
+    bool decode(const uint8_t* data, size_t len)
+    {
+        if (len >= sensorBatchFrameSize(2) && data[0] == sensorFrameVersion &&
+            data[1] == static_cast<uint8_t>(Type::BatchReport))
+        {
+            return decodeBatch(data, len);
+        }
+
+        if (len == sensorFrameSize && data[0] == sensorFrameVersion)
+        {
+            uint16_t crc = data[8] | (data[9] << 8);
+            if (crc != crc16(data, sensorFrameSize - 2))
+            {
+                return false;
+            }
+
+            if (data[1] != static_cast<uint8_t>(Type::StateReport))
+            {
+                return false;
+            }
+
+            if (!decodeHeader(data))
+            {
+                return false;
+            }
+
+            type = Type::StateReport;
+            setSingleEdge();
+            return true;
+        }
+
+        // Only an exact fit, so a damaged version 2 frame that failed the
+        // checks above can't pass as version 1, which has no CRC.
+        if (len == sensorFrameV1Size)
+        {
+            SensorState v1;
+            memcpy(&v1, data, sizeof(v1));
+            if (!validState(static_cast<uint32_t>(v1.state)))
+            {
+                return false;
+            }
+
+            version = 1;
+            type = Type::StateReport;
+            state = v1.state;
+            wakeupReason = v1.wakeupReason;
+            vccMillivolts = v1.vcc > 0 && v1.vcc < 65.535f ? static_cast<uint16_t>(v1.vcc * 1000 + 0.5f) : 0;
+            // Version 1 frames have no sequence number.
+            sequence = 0;
+            sequenceReset = false;
+            setSingleEdge();
+            return true;
+        }
+
+        return false;
+    }
+
+    SensorState toSensorState() const
+    {
+        SensorState sensorState;
+        sensorState.wakeupReason = wakeupReason;
+        sensorState.state = state;
+        sensorState.vcc = static_cast<float>(vccMillivolts) / 1000;
+        return sensorState;
+    }
+
+private:
+    static bool validState(uint32_t state)
+    {
+        return state <= SensorState::Fault;
+    }
+
+    void encodeHeader(uint8_t* buffer, Type frameType, SensorState::State frameState) const
+    {
+        buffer[0] = sensorFrameVersion;
+        buffer[1] = static_cast<uint8_t>(frameType);
+        buffer[2] = (static_cast<uint8_t>(frameState) & 0x0F) | (sequenceReset ? flagSequenceReset : 0);
+        buffer[3] = wakeupReason;
+        buffer[4] = vccMillivolts & 0xFF;
+        buffer[5] = vccMillivolts >> 8;
+        buffer[6] = sequence & 0xFF;
+        buffer[7] = sequence >> 8;
+    }
+
+    bool decodeHeader(const uint8_t* data)
+    {
+        uint8_t flags = data[2] & 0xF0;
+        if ((flags & ~flagSequenceReset) != 0 || !validState(data[2] & 0x0F))
+        {
+            return false;
+        }
+
+        version = sensorFrameVersion;
+        state = static_cast<SensorState::State>(data[2] & 0x0F);
+        sequenceReset = (flags & flagSequenceReset) != 0;
+        wakeupReason = data[3];
+        vccMillivolts = data[4] | (data[5] << 8);
+        sequence = data[6] | (data[7] << 8);
+        return true;
+    }
+
+    size_t encodeBatch(uint8_t* buffer, size_t bufferSize) const
+    {
+        if (edgeCount < 2 || edgeCount > maxEdges || bufferSize < sensorBatchFrameSize(edgeCount))
+        {
+            return 0;
+        }
+
+        encodeHeader(buffer, Type::BatchReport, edges[edgeCount - 1].state);
+        buffer[8] = edgeCount;
+        auto* edgeData = buffer + 9;
+        for (size_t i = 0; i < edgeCount; ++i, edgeData += sensorFrameEdgeSize)
+        {
+            edgeData[0] = static_cast<uint8_t>(edges[i].state);
+            edgeData[1] = edges[i].ageMs & 0xFF;
+            edgeData[2] = edges[i].ageMs >> 8;
+        }
+        auto len = sensorBatchFrameSize(edgeCount);
+        auto crc = crc16(buffer, len - 2);
+        buffer[len - 2] = crc & 0xFF;
+        buffer[len - 1] = crc >> 8;
+        return len;
+    }
+
+    bool decodeBatch(const uint8_t* data, size_t len)
+    {
+        uint8_t count = data[8];
+        if (count < 2 || count > maxEdges || len != sensorBatchFrameSize(count))
+        {
+            return false;
+        }
+
+        uint16_t crc = data[len - 2] | (data[len - 1] << 8);
+        if (crc != crc16(data, len - 2))
+        {
+            return false;
+        }
+
+        const auto* edgeData = data + 9;
+        for (size_t i = 0; i < count; ++i, edgeData += sensorFrameEdgeSize)
+        {
+            if (!validState(edgeData[0]))
+            {
+                return false;
+            }
+        }
+
+        // The header state must be the last change.
+        if (!decodeHeader(data) || state != data[9 + (count - 1) * sensorFrameEdgeSize])
+        {
+            return false;
+        }
+
+        type = Type::BatchReport;
+        edgeCount = count;
+        edgeData = data + 9;
+        for (size_t i = 0; i < count; ++i, edgeData += sensorFrameEdgeSize)
+        {
+            edges[i].state = static_cast<SensorState::State>(edgeData[0]);
+            edges[i].ageMs = edgeData[1] | (edgeData[2] << 8);
+        }
+        return true;
+    }
+
+    void setSingleEdge()
+    {
+        edgeCount = 1;
+        edges[0].state = state;
+        edges[0].ageMs = 0;
+    }
+};
+
+
+// Sent by the controller back to a sensor for each version 2 frame it has
+// taken responsibility for, so the sensor can stop retrying and sleep:
+//
+//   0  version (sensorFrameVersion)
+//   1  message type (SensorFrame::Type::Ack)
+//   2  acknowledged sequence number (uint16_t)
+//   4  CRC-16/CCITT-FALSE of bytes 0-3 (uint16_t)
+const size_t sensorAckSize = 6;
+
+struct SensorAck
+{
+    uint16_t sequence;
+
+    size_t encode(uint8_t* buffer, size_t bufferSize) const
+    {
+        if (bufferSize < sensorAckSize)
+        {
+            return 0;
+        }
+
+        buffer[0] = sensorFrameVersion;
+        buffer[1] = static_cast<uint8_t>(SensorFrame::Type::Ack);
+        buffer[2] = sequence & 0xFF;
+        buffer[3] = sequence >> 8;
+        auto crc = SensorFrame::crc16(buffer, sensorAckSize - 2);
+        buffer[4] = crc & 0xFF;
+        buffer[5] = crc >> 8;
+        return sensorAckSize;
+    }
+
+    bool decode(const uint8_t* data, size_t len)
+    {
+        if (len != sensorAckSize ||
+            data[0] != sensorFrameVersion ||
+            data[1] != static_cast<uint8_t>(SensorFrame::Type::Ack))
+        {
+            return false;
+        }
+
+        uint16_t crc = data[4] | (data[5] << 8);
+        if (crc != SensorFrame::crc16(data, sensorAckSize - 2))
+        {
+            return false;
+        }
+
+        sequence = data[2] | (data[3] << 8);
+        return true;
+    }
+};
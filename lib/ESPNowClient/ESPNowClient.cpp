@@ -25,6 +25,8 @@
 #include <esp_wifi.h>
 #include <WiFi.h>
 
+#include "protocol.h"
+
 
 namespace
 {
@@ -59,6 +61,9 @@ ESPNowClient::ESPNowClient(const String& ssid, const BroadCastAddress& broadCast
         Serial.println("ERROR: ESPNowClient singleton already created");
     }
     _singletonCreated = true;
+
+    _sendDone = xSemaphoreCreateBinary();
+    _ackReceived = xSemaphoreCreateBinary();
 }
 
 bool ESPNowClient::begin()
@@ -93,6 +98,7 @@ bool ESPNowClient::begin()
     // Once ESPNow is successfully Init, we will register for Send CB to
     // get the status of Trasnmitted packet
     esp_now_register_send_cb(onDataSent);
+    esp_now_register_recv_cb(onDataRecv);
     
     // Register peer
     memcpy(_peerInfo.peer_addr, _broadCastAddress.getBytes(), 6);
@@ -111,21 +117,99 @@ bool ESPNowClient::begin()
 
 esp_err_t ESPNowClient::send(const uint8_t *data, size_t len)
 {
+    xSemaphoreTake(_sendDone, 0);
     auto ret = esp_now_send(_broadCastAddress.getBytes(), data, len);
     if (ret == ESP_OK)
     {
-        // TODO: Wait for a response
-        delay(10);
+        // Wait for the frame to go out before the caller can sleep.
+        waitForSendDone(defaultDeliveryPolicy.sendTimeoutMs);
     }
 
     return ret;
 }
 
-// TODO: Make this do something someday. Too bad it doesn't take a context. :(
+DeliveryResult ESPNowClient::sendWithAck(const uint8_t *data, size_t len, uint16_t sequence, const DeliveryPolicy& policy)
+{
+    return deliver(*this, policy, data, len, sequence);
+}
+
+bool ESPNowClient::transmit(const uint8_t *data, size_t len)
+{
+    // Drop stale completions from an earlier attempt.
+    xSemaphoreTake(_sendDone, 0);
+    xSemaphoreTake(_ackReceived, 0);
+
+    auto ret = esp_now_send(_broadCastAddress.getBytes(), data, len);
+    if (ret != ESP_OK)
+    {
+        Serial.printf("Error %d sending ESP-NOW frame\n", ret);
+        return false;
+    }
+
+    return true;
+}
+
+bool ESPNowClient::waitForSendDone(unsigned long timeoutMs)
+{
+    if (xSemaphoreTake(_sendDone, pdMS_TO_TICKS(timeoutMs)) != pdTRUE)
+    {
+        return false;
+    }
+
+    return _lastSendSucceeded;
+}
+
+bool ESPNowClient::waitForAck(uint16_t sequence, unsigned long timeoutMs)
+{
+    auto start = millis();
+    while (millis() - start < timeoutMs)
+    {
+        auto remaining = timeoutMs - (millis() - start);
+        if (xSemaphoreTake(_ackReceived, pdMS_TO_TICKS(remaining)) != pdTRUE)
+        {
+            return false;
+        }
+
+        if (_ackedSequence == sequence)
+        {
+            return true;
+        }
+        // Ack for an earlier frame. Keep waiting.
+    }
+
+    return false;
+}
+
+void ESPNowClient::backoff(unsigned long ms)
+{
+    delay(ms);
+}
+
+uint32_t ESPNowClient::random()
+{
+    return esp_random();
+}
+
 void ESPNowClient::onDataSent(const uint8_t *mac_addr, esp_now_send_status_t status)
 {
-    Serial.print("\r\nLast Packet Send Status:\t");
-    Serial.println(status == ESP_NOW_SEND_SUCCESS ? "Delivery Success" : "Delivery Fail");
+    _lastSendSucceeded = status == ESP_NOW_SEND_SUCCESS;
+    xSemaphoreGive(_sendDone);
+}
+
+void ESPNowClient::onDataRecv(const uint8_t *mac_addr, const uint8_t *data, int len)
+{
+    SensorAck ack;
+    if (len < 0 || !ack.decode(data, len))
+    {
+        return;
+    }
+
+    _ackedSequence = ack.sequence;
+    xSemaphoreGive(_ackReceived);
 }
 
-bool ESPNowClient::_singletonCreated = false;
\ No newline at end of file
+bool ESPNowClient::_singletonCreated = false;
+SemaphoreHandle_t ESPNowClient::_sendDone = nullptr;
+SemaphoreHandle_t ESPNowClient::_ackReceived = nullptr;
+volatile bool ESPNowClient::_lastSendSucceeded = false;
+volatile uint16_t ESPNowClient::_ackedSequence = 0;
\ No newline at end of file
@@ -21,10 +21,13 @@
 // SOFTWARE.
 #pragma once
 
+#include <Arduino.h>
 #include <esp_now.h>
 #include <stdint.h>
 #include <WString.h>
 
+#include "ESPNowDelivery.h"
+
 
 class ESPNowClient
 {
@@ -48,12 +51,28 @@ public:
     bool begin();
 
     esp_err_t send(const uint8_t *data, size_t len);
+    // Sends a frame and waits for the controller to ack its sequence
+    // number, retrying as the policy allows.
+    DeliveryResult sendWithAck(const uint8_t *data, size_t len, uint16_t sequence, const DeliveryPolicy& policy = defaultDeliveryPolicy);
+
+    // Transport interface for deliver()
+    bool transmit(const uint8_t *data, size_t len);
+    bool waitForSendDone(unsigned long timeoutMs);
+    bool waitForAck(uint16_t sequence, unsigned long timeoutMs);
+    void backoff(unsigned long ms);
+    uint32_t random();
 
 protected:
     static void onDataSent(const uint8_t *mac_addr, esp_now_send_status_t status);
+    static void onDataRecv(const uint8_t *mac_addr, const uint8_t *data, int len);
 private:
     String _ssid;
     BroadCastAddress _broadCastAddress;
     esp_now_peer_info_t _peerInfo;
     static bool _singletonCreated;
+    // The ESP-NOW callbacks take no context, so their state is static.
+    static SemaphoreHandle_t _sendDone;
+    static SemaphoreHandle_t _ackReceived;
+    static volatile bool _lastSendSucceeded;
+    static volatile uint16_t _ackedSequence;
 };
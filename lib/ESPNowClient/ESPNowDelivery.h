@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Retry policy for acknowledged ESP-NOW delivery. Everything here is plain
+// C++ so it can be exercised on the host with a simulated radio.
+struct DeliveryPolicy
+{
+    uint8_t maxAttempts;
+    // How long to wait for the send callback (the MAC level ack).
+    unsigned long sendTimeoutMs;
+    // How long to wait for the controller's ack after a successful send.
+    unsigned long ackTimeoutMs;
+    // Backoff before attempt n is random in [0, min(initialBackoffMs << n, maxBackoffMs)].
+    unsigned long initialBackoffMs;
+    unsigned long maxBackoffMs;
+};
+
+const DeliveryPolicy defaultDeliveryPolicy = { 4, 5, 10, 2, 16 };
+
+// The backoff window before retry n, counting from 1: initialMs doubling
+// up to maxMs. Also used for retries on later wakeups, in longer steps.
+inline unsigned long backoffWindowMs(unsigned long initialMs, unsigned long maxMs, unsigned retry)
+{
+    auto window = initialMs;
+    for (unsigned i = 1; i < retry && window < maxMs; ++i)
+    {
+        window <<= 1;
+    }
+    return window < maxMs ? window : maxMs;
+}
+
+struct DeliveryResult
+{
+    bool delivered;
+    uint8_t attempts;
+};
+
+// Sends a frame until the controller acks its sequence number or the
+// attempts run out. The transport provides:
+//   bool transmit(const uint8_t* data, size_t len)    start sending, false on a local error
+//   bool waitForSendDone(unsigned long timeoutMs)      true if the frame was delivered to the peer's MAC
+//   bool waitForAck(uint16_t sequence, unsigned long timeoutMs)
+//   void backoff(unsigned long ms)
+//   uint32_t random()
+template<typename Transport>
+DeliveryResult deliver(Transport& transport, const DeliveryPolicy& policy, const uint8_t* data, size_t len, uint16_t sequence)
+{
+    DeliveryResult result = { false, 0 };
+    while (result.attempts < policy.maxAttempts)
+    {
+        if (result.attempts > 0)
+        {
+            auto window = backoffWindowMs(policy.initialBackoffMs, policy.maxBackoffMs, result.attempts);
+            // Full jitter, so sensors that collided don't collide again.
+            transport.backoff(transport.random() % (window + 1));
+        }
+        result.attempts++;
+
+        if (!transport.transmit(data, len))
+        {
+            continue;
+        }
+
+        // No MAC level ack means the controller never saw the frame, so
+        // there is no point waiting for its ack.
+        if (!transport.waitForSendDone(policy.sendTimeoutMs))
+        {
+            continue;
+        }
+
+        if (transport.waitForAck(sequence, policy.ackTimeoutMs))
+        {
+            result.delivered = true;
+            return result;
+        }
+    }
+
+    return result;
+}
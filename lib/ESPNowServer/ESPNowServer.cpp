@@ -2,6 +2,7 @@
 
 #include <Arduino.h>
 #include <esp_now.h>
+#include <esp_wifi.h>
 #include <Logging.h>
 #include <WiFi.h>
 
@@ -85,3 +86,55 @@ void ESPNowServer::onDataReceive(const uint8_t * mac_addr, const uint8_t *incomi
 {
     _onReceiveCallback(mac_addr, incomingData, len);
 }
+
+
+bool ESPNowServer::send(const uint8_t * mac_addr, const uint8_t *data, size_t len)
+{
+    if (!addPeer(mac_addr))
+    {
+        return false;
+    }
+
+    auto ret = esp_now_send(mac_addr, data, len);
+    if (ret != ESP_OK)
+    {
+        log_e("ERROR %d sending ESP-NOW reply", ret);
+        return false;
+    }
+
+    return true;
+}
+
+bool ESPNowServer::addPeer(const uint8_t * mac_addr)
+{
+    if (esp_now_is_peer_exist(mac_addr))
+    {
+        return true;
+    }
+
+    esp_now_peer_info_t peerInfo = {};
+    memcpy(peerInfo.peer_addr, mac_addr, sizeof(peerInfo.peer_addr));
+    peerInfo.channel = 0;   // Current channel
+    peerInfo.ifidx = WIFI_IF_STA;
+    peerInfo.encrypt = false;
+
+    auto ret = esp_now_add_peer(&peerInfo);
+    if (ret == ESP_ERR_ESPNOW_FULL)
+    {
+        // The peer list is small. Replies are one-shot, so just evict a peer.
+        esp_now_peer_info_t oldPeer;
+        if (esp_now_fetch_peer(true, &oldPeer) == ESP_OK)
+        {
+            esp_now_del_peer(oldPeer.peer_addr);
+        }
+        ret = esp_now_add_peer(&peerInfo);
+    }
+
+    if (ret != ESP_OK)
+    {
+        log_e("ERROR %d adding ESP-NOW peer", ret);
+        return false;
+    }
+
+    return true;
+}
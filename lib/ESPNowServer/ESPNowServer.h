@@ -14,9 +14,12 @@ public:
     ESPNowServer(const String& apSSID, const String& apPassword, OnReceiveCallback);
     ~ESPNowServer();
     bool begin();
+    // Sends a reply to a client. May be called from the receive callback.
+    bool send(const uint8_t * mac_addr, const uint8_t *data, size_t len);
 protected:
     static void onDataRecv(const uint8_t * mac_addr, const uint8_t *incomingData, int len);
     void onDataReceive(const uint8_t * mac_addr, const uint8_t *incomingData, int len);
+    bool addPeer(const uint8_t * mac_addr);
 private:
     static ESPNowServer* _this;
     OnReceiveCallback _onReceiveCallback;
@@ -0,0 +1,108 @@
+#include "LatencyHistogram.h"
+
+#include <Arduino.h>
+
+
+const size_t LatencyHistogram::bucketCount;
+
+
+LatencyHistogram::Timer::Timer(LatencyHistogram& histogram)
+    :
+    _histogram(histogram),
+    _startUs(micros())
+{
+}
+
+LatencyHistogram::Timer::~Timer()
+{
+    _histogram.record(micros() - _startUs);
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::record(uint32_t us)
+{
+    size_t bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+    if (bucket >= bucketCount)
+    {
+        bucket = bucketCount - 1;
+    }
+
+    store(_buckets[bucket], _buckets[bucket].load(std::memory_order_relaxed) + 1);
+    store(_count, _count.load(std::memory_order_relaxed) + 1);
+    if (us > _maxUs.load(std::memory_order_relaxed))
+    {
+        store(_maxUs, us);
+    }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+    Snapshot snapshot;
+    snapshot.count = _count.load(std::memory_order_relaxed);
+    snapshot.maxUs = _maxUs.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < bucketCount; ++i)
+    {
+        snapshot.buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+void LatencyHistogram::reset()
+{
+    store(_count, 0);
+    store(_maxUs, 0);
+    for (auto& bucket : _buckets)
+    {
+        store(bucket, 0);
+    }
+}
+
+uint32_t LatencyHistogram::bucketLimitUs(size_t bucket)
+{
+    return bucket < bucketCount - 1 ? 1u << bucket : 0xFFFFFFFF;
+}
+
+uint32_t LatencyHistogram::Snapshot::percentileUs(double fraction) const
+{
+    // Counted from the buckets rather than count, in case a sample was
+    // recorded while the snapshot was taken.
+    uint64_t total = 0;
+    for (auto bucket : buckets)
+    {
+        total += bucket;
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    auto rank = static_cast<uint64_t>(fraction * total);
+    if (rank >= total)
+    {
+        rank = total - 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucketCount; ++i)
+    {
+        seen += buckets[i];
+        if (seen > rank)
+        {
+            // The worst sample is known exactly, so don't report past it.
+            // It is also the only bound on the last bucket.
+            auto limitUs = bucketLimitUs(i);
+            return limitUs < maxUs ? limitUs : maxUs;
+        }
+    }
+    return maxUs;
+}
+
+void LatencyHistogram::store(std::atomic<uint32_t>& value, uint32_t newValue)
+{
+    // Only the recording task writes.
+    value.store(newValue, std::memory_order_relaxed);
+}
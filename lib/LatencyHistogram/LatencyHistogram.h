@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Distribution of how long something took, in log scale buckets of
+// microseconds, with the sample count and the worst time.
+//
+// Recording a sample never allocates and costs a few instructions: the
+// bucket is found from the position of the highest bit set. Bucket 0 counts
+// samples under 1 us, bucket i > 0 counts samples of [2^(i-1), 2^i) us, and
+// the last bucket also counts everything longer.
+//
+// Only one task may record samples. The counts are kept in atomics, so
+// snapshot() may be called from any task. A snapshot taken while a sample
+// is recorded may be off by that one sample.
+class LatencyHistogram
+{
+public:
+    static const size_t bucketCount = 20;
+    struct Snapshot
+    {
+        uint32_t count;
+        uint32_t maxUs;
+        uint32_t buckets[bucketCount];
+        // The upper bound of the bucket holding the sample at the given
+        // fraction of the distribution, e.g. 0.99. 0 if there are no samples.
+        uint32_t percentileUs(double fraction) const;
+    };
+
+    // Times the enclosing scope.
+    class Timer
+    {
+    public:
+        Timer(LatencyHistogram& histogram);
+        ~Timer();
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+    private:
+        LatencyHistogram& _histogram;
+        uint32_t _startUs;
+    };
+
+    LatencyHistogram();
+    void record(uint32_t us);
+    Snapshot snapshot() const;
+    void reset();
+    // The first time in us that falls in the next bucket, or 0xFFFFFFFF for
+    // the last bucket.
+    static uint32_t bucketLimitUs(size_t bucket);
+private:
+    static void store(std::atomic<uint32_t>& value, uint32_t newValue);
+    std::atomic<uint32_t> _count;
+    std::atomic<uint32_t> _maxUs;
+    std::atomic<uint32_t> _buckets[bucketCount];
+};
@@ -4,7 +4,8 @@
 class MemTracker
 {
 public:
-    void onLoop();
-private:
-    unsigned long _lastReport = 0;
+    // Logs the free heap. Meant to be run every reportIntervalMs.
+    void report();
+
+    static const unsigned long reportIntervalMs = 5 * 1000; // 5 seconds
 };
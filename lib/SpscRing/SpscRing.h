@@ -0,0 +1,150 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#ifndef SPSC_RING_CACHE_LINE_SIZE
+#define SPSC_RING_CACHE_LINE_SIZE   64
+#endif
+
+
+// Fixed-capacity, lock-free, single-producer/single-consumer ring buffer.
+//
+// push() must only ever be called from one task (e.g. the WiFi task running
+// the ESP-NOW receive callback) and pop() from one other task (e.g. the
+// Arduino loop). The producer and consumer indexes live on separate cache
+// lines so the two sides don't false-share, and each side keeps a cached
+// copy of the other side's index so it only touches the other cache line
+// when the ring looks full/empty.
+//
+// The indexes are free-running 32 bit counters, so they also serve as
+// sequence numbers for the items passing through the ring.
+template<typename T, size_t Capacity>
+class SpscRing
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of 2");
+    static_assert(Capacity <= (1u << 31), "SpscRing capacity too large");
+public:
+    SpscRing()
+        :
+        _tail(0),
+        _cachedHead(0),
+        _overflows(0),
+        _highWater(0),
+        _head(0),
+        _cachedTail(0)
+    {
+    }
+
+    // Producer side
+    bool push(const T& item)
+    {
+        auto tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _cachedHead >= Capacity)
+        {
+            _cachedHead = _head.load(std::memory_order_acquire);
+            if (tail - _cachedHead >= Capacity)
+            {
+                _overflows.store(_overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+
+        _items[tail & mask] = item;
+        _tail.store(tail + 1, std::memory_order_release);
+
+        // The cached head can only over-estimate the depth, so refresh it
+        // before raising the high-water mark.
+        auto highWater = _highWater.load(std::memory_order_relaxed);
+        if (tail + 1 - _cachedHead > highWater)
+        {
+            _cachedHead = _head.load(std::memory_order_acquire);
+            uint32_t depth = tail + 1 - _cachedHead;
+            if (depth > highWater)
+            {
+                _highWater.store(depth, std::memory_order_relaxed);
+            }
+        }
+
+        return true;
+    }
+
+    // Consumer side
+    bool pop(T& item)
+    {
+        auto head = _head.load(std::memory_order_relaxed);
+        if (head == _cachedTail)
+        {
+            _cachedTail = _tail.load(std::memory_order_acquire);
+            if (head == _cachedTail)
+            {
+                return false;
+            }
+        }
+
+        item = _items[head & mask];
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Safe to call from either side. The result may be stale by the time it is used.
+    size_t size() const
+    {
+        auto head = _head.load(std::memory_order_acquire);
+        auto tail = _tail.load(std::memory_order_acquire);
+        return tail - head;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    // Sequence number the next pushed item will get. Producer side.
+    uint32_t nextPushSequence() const
+    {
+        return _tail.load(std::memory_order_relaxed);
+    }
+
+    // Sequence number of the next item pop() will return. Items with
+    // sequence numbers in [nextPopSequence(), nextPushSequence()) are
+    // still in the ring.
+    uint32_t nextPopSequence() const
+    {
+        return _head.load(std::memory_order_acquire);
+    }
+
+    static constexpr size_t capacity()
+    {
+        return Capacity;
+    }
+
+    // Number of items rejected because the ring was full.
+    uint32_t overflows() const
+    {
+        return _overflows.load(std::memory_order_relaxed);
+    }
+
+    // Most items ever held in the ring at once, as seen by the producer.
+    uint32_t highWater() const
+    {
+        return _highWater.load(std::memory_order_relaxed);
+    }
+
+private:
+    static const uint32_t mask = Capacity - 1;
+
+    // Producer cache line
+    alignas(SPSC_RING_CACHE_LINE_SIZE) std::atomic<uint32_t> _tail;
+    uint32_t _cachedHead;
+    std::atomic<uint32_t> _overflows;
+    std::atomic<uint32_t> _highWater;
+
+    // Consumer cache line
+    alignas(SPSC_RING_CACHE_LINE_SIZE) std::atomic<uint32_t> _head;
+    uint32_t _cachedTail;
+
+    alignas(SPSC_RING_CACHE_LINE_SIZE) T _items[Capacity];
+};
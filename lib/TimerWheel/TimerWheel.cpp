@@ -0,0 +1,203 @@
+#include "TimerWheel.h"
+
+#include <Arduino.h>
+
+
+static_assert(TimerWheel::maxJobs <= 8, "TimerWheel slot masks are 8 bit");
+static_assert((TimerWheel::slots & (TimerWheel::slots - 1)) == 0, "TimerWheel slot count must be a power of 2");
+
+const unsigned long TimerWheel::noDeadline;
+const size_t TimerWheel::maxJobs;
+const uint32_t TimerWheel::tickShift;
+const size_t TimerWheel::slots;
+const uint32_t TimerWheel::idleWindowUs;
+
+
+namespace
+{
+
+const uint32_t tickMask = 0xFFFFFFFF >> TimerWheel::tickShift;
+
+bool isDue(uint32_t deadline, uint32_t now)
+{
+    return static_cast<int32_t>(now - deadline) >= 0;
+}
+
+}
+
+
+TimerWheel::TimerWheel()
+    :
+    _jobCount(0),
+    _lastTick(0),
+    _idleUs(0),
+    _windowStartUs(0),
+    _windowStarted(false),
+    _idlePermille(0)
+{
+    for (auto& slot : _slots)
+    {
+        slot = 0;
+    }
+}
+
+bool TimerWheel::addJob(const char* name, unsigned long periodMs, Callback callback, unsigned long now)
+{
+    return addJob(name, periodMs, callback, now, periodMs);
+}
+
+bool TimerWheel::addJob(const char* name, unsigned long periodMs, Callback callback, unsigned long now, unsigned long firstDelayMs)
+{
+    if (_jobCount == maxJobs)
+    {
+        return false;
+    }
+
+    if (_jobCount == 0)
+    {
+        _lastTick = static_cast<uint32_t>(now) >> tickShift;
+    }
+
+    auto& job = _jobs[_jobCount];
+    job.name = name;
+    job.periodMs = periodMs;
+    job.deadline = static_cast<uint32_t>(now + firstDelayMs);
+    job.callback = callback;
+    job.runs = 0;
+    job.totalRunUs = 0;
+    job.maxRunUs = 0;
+    insert(_jobCount);
+    _jobCount++;
+    return true;
+}
+
+unsigned long TimerWheel::run(unsigned long now)
+{
+    auto now32 = static_cast<uint32_t>(now);
+    auto tick = now32 >> tickShift;
+    auto elapsedTicks = (tick - _lastTick) & tickMask;
+    size_t slotsToVisit = elapsedTicks >= slots ? slots : elapsedTicks + 1;
+
+    // Collect first, so a job re-inserted into a slot still to be visited
+    // doesn't run twice.
+    uint8_t due = 0;
+    for (size_t i = 0; i < slotsToVisit; ++i)
+    {
+        auto& slot = _slots[(_lastTick + i) & (slots - 1)];
+        for (size_t job = 0; job < _jobCount; ++job)
+        {
+            uint8_t bit = 1 << job;
+            if ((slot & bit) != 0 && isDue(_jobs[job].deadline, now32))
+            {
+                slot &= ~bit;
+                due |= bit;
+            }
+        }
+    }
+    _lastTick = tick;
+
+    for (size_t i = 0; i < _jobCount; ++i)
+    {
+        if ((due & (1 << i)) == 0)
+        {
+            continue;
+        }
+
+        auto& job = _jobs[i];
+        uint32_t start = micros();
+        job.callback();
+        uint32_t runUs = micros() - start;
+
+        store(job.runs, job.runs.load(std::memory_order_relaxed) + 1);
+        store(job.totalRunUs, job.totalRunUs.load(std::memory_order_relaxed) + runUs);
+        if (runUs > job.maxRunUs.load(std::memory_order_relaxed))
+        {
+            store(job.maxRunUs, runUs);
+        }
+
+        // Like the hand rolled checks this replaces, the period counts from
+        // when the job ran, so a late pass doesn't cause a catch up burst.
+        job.deadline = now32 + job.periodMs;
+        insert(i);
+    }
+
+    return timeToNextDeadline(now);
+}
+
+unsigned long TimerWheel::timeToNextDeadline(unsigned long now) const
+{
+    if (_jobCount == 0)
+    {
+        return noDeadline;
+    }
+
+    // There are few enough jobs that checking each deadline is cheaper than
+    // walking the slots.
+    auto now32 = static_cast<uint32_t>(now);
+    uint32_t nearest = noDeadline;
+    for (size_t job = 0; job < _jobCount; ++job)
+    {
+        if (isDue(_jobs[job].deadline, now32))
+        {
+            return 0;
+        }
+
+        auto untilDue = _jobs[job].deadline - now32;
+        if (untilDue < nearest)
+        {
+            nearest = untilDue;
+        }
+    }
+    return nearest;
+}
+
+size_t TimerWheel::jobCount() const
+{
+    return _jobCount;
+}
+
+TimerWheel::JobStats TimerWheel::jobStats(size_t job) const
+{
+    const auto& entry = _jobs[job];
+    return {
+        entry.name,
+        entry.runs.load(std::memory_order_relaxed),
+        entry.totalRunUs.load(std::memory_order_relaxed),
+        entry.maxRunUs.load(std::memory_order_relaxed)
+    };
+}
+
+void TimerWheel::recordIdle(uint32_t idleUs, uint32_t nowUs)
+{
+    if (!_windowStarted)
+    {
+        _windowStarted = true;
+        _windowStartUs = nowUs - idleUs;
+    }
+
+    _idleUs += idleUs;
+    auto windowUs = nowUs - _windowStartUs;
+    if (windowUs >= idleWindowUs)
+    {
+        auto idle = _idleUs < windowUs ? _idleUs : windowUs;
+        store(_idlePermille, static_cast<uint32_t>(static_cast<uint64_t>(idle) * 1000 / windowUs));
+        _idleUs = 0;
+        _windowStartUs = nowUs;
+    }
+}
+
+uint32_t TimerWheel::idlePermille() const
+{
+    return _idlePermille.load(std::memory_order_relaxed);
+}
+
+void TimerWheel::insert(size_t job)
+{
+    _slots[(_jobs[job].deadline >> tickShift) & (slots - 1)] |= 1 << job;
+}
+
+void TimerWheel::store(std::atomic<uint32_t>& value, uint32_t newValue)
+{
+    // Only the owning loop writes the stats.
+    value.store(newValue, std::memory_order_relaxed);
+}
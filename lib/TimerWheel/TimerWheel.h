@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Runs the periodic work of one loop from a hashed timer wheel, and tells
+// the loop how long it may sleep until the next job is due.
+//
+// Each job sits in the wheel slot of its deadline. A pass only looks at the
+// slots the clock moved through since the last pass, so run() costs the same
+// however far apart the deadlines are. Jobs further out than one turn of the
+// wheel stay in their slot until their turn comes around.
+//
+// Jobs, the wheel and run() belong to the task running the loop. Job stats
+// and the loop's idle share are kept in atomics, so they can be read from
+// any task.
+class TimerWheel
+{
+public:
+    typedef std::function<void()> Callback;
+    struct JobStats
+    {
+        const char* name;
+        uint32_t runs;
+        uint32_t totalRunUs;
+        uint32_t maxRunUs;
+    };
+
+    TimerWheel();
+    // Runs callback every periodMs, the first time firstDelayMs from now, or
+    // periodMs from now if not given. Returns false if there is no room for
+    // another job.
+    bool addJob(const char* name, unsigned long periodMs, Callback callback, unsigned long now);
+    bool addJob(const char* name, unsigned long periodMs, Callback callback, unsigned long now, unsigned long firstDelayMs);
+    // Runs the jobs that are due, in the order they were added. Returns how
+    // long in ms until the next one is.
+    unsigned long run(unsigned long now);
+    // ms until the next job is due, or noDeadline if there are no jobs.
+    unsigned long timeToNextDeadline(unsigned long now) const;
+    size_t jobCount() const;
+    JobStats jobStats(size_t job) const;
+
+    // For the owning loop to report the time it slept, e.g. blocked on a
+    // queue with the timeout run() returned.
+    void recordIdle(uint32_t idleUs, uint32_t nowUs);
+    // Share of the last complete measurement window the loop spent idle
+    uint32_t idlePermille() const;
+
+    static const unsigned long noDeadline = 0xFFFFFFFF;
+    static const size_t maxJobs = 8;
+    // 16 ms ticks and 64 slots, so one turn is about a second. Both are
+    // powers of 2, so slots follow on across the 32 bit millis() rollover.
+    static const uint32_t tickShift = 4;
+    static const size_t slots = 64;
+    static const uint32_t idleWindowUs = 10 * 1000 * 1000;
+private:
+    struct Job
+    {
+        const char* name;
+        uint32_t periodMs;
+        uint32_t deadline;
+        Callback callback;
+        std::atomic<uint32_t> runs;
+        std::atomic<uint32_t> totalRunUs;
+        std::atomic<uint32_t> maxRunUs;
+    };
+    void insert(size_t job);
+    static void store(std::atomic<uint32_t>& value, uint32_t newValue);
+    Job _jobs[maxJobs];
+    size_t _jobCount;
+    // Bit mask of the jobs in each slot
+    uint8_t _slots[slots];
+    uint32_t _lastTick;
+    uint32_t _idleUs;
+    uint32_t _windowStartUs;
+    bool _windowStarted;
+    std::atomic<uint32_t> _idlePermille;
+};
@@ -8,7 +8,10 @@ WavFilePlayer::WavFilePlayer(int bclkPin, int wclkPin, int doutPin)
     _bclkPin(bclkPin),
     _wclkPin(wclkPin),
     _doutPin(doutPin),
-    _inputFile(nullptr)
+    _inputFile(nullptr),
+    _waitingForOutput(false),
+    _outputStarted(false),
+    _firstOutputUs(0)
 {
 }
 
@@ -55,6 +58,10 @@ bool WavFilePlayer::playWavFile(const String& wavFileName)
         return false;
     }
 
+    // begin() only reads the header, the first loop() outputs the first
+    // samples.
+    _waitingForOutput = true;
+    _outputStarted = false;
     return true;
 }
 
@@ -65,6 +72,8 @@ bool WavFilePlayer::filePlaying() const
 
 void WavFilePlayer::silence()
 {
+    _waitingForOutput = false;
+    _outputStarted = false;
     if (_inputFile)
     {
         log_i("checking wave");
@@ -85,7 +94,15 @@ void WavFilePlayer::onLoop()
 {
     if (_wav.isRunning())
     {
-        if (!_wav.loop())
+        auto running = _wav.loop();
+        if (_waitingForOutput)
+        {
+            _waitingForOutput = false;
+            _outputStarted = true;
+            _firstOutputUs = micros();
+        }
+
+        if (!running)
         {
             _wav.stop();
             if (_inputFile)
@@ -100,3 +117,15 @@ void WavFilePlayer::onLoop()
         }
     }
 }
+
+bool WavFilePlayer::takeFirstOutputTime(uint32_t& outputUs)
+{
+    if (!_outputStarted)
+    {
+        return false;
+    }
+
+    _outputStarted = false;
+    outputUs = _firstOutputUs;
+    return true;
+}
@@ -18,6 +18,9 @@ public:
     bool filePlaying() const;
     void silence();
     void onLoop();
+    // Returns true once for each file played, after its first samples were
+    // handed to the I2S output, with the micros() time that happened.
+    bool takeFirstOutputTime(uint32_t& outputUs);
 private:
     int _bclkPin;
     int _wclkPin;
@@ -26,4 +29,7 @@ private:
     AudioGeneratorAAC _aac;
     AudioOutputI2S _output;
     AudioGeneratorWAV _wav;
+    bool _waitingForOutput;
+    bool _outputStarted;
+    uint32_t _firstOutputUs;
 };
\ No newline at end of file